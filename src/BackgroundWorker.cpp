@@ -0,0 +1,109 @@
+// ----------------------------------------------------------------------------
+// BackgroundWorker.cpp
+//
+//
+// Authors:
+// Peter Polidoro polidorop@janelia.hhmi.org
+// ----------------------------------------------------------------------------
+#include "BackgroundWorker.h"
+
+
+// public
+BackgroundWorker::BackgroundWorker()
+{
+  sample_wanted_ = false;
+  running_ = false;
+  update_count_ = 0;
+}
+
+BackgroundWorker::~BackgroundWorker()
+{
+  stop();
+}
+
+void BackgroundWorker::start(const cv::Size image_size,
+                             const int image_type)
+{
+  stop();
+
+  bg_sub_ptr_ = cv::createBackgroundSubtractorMOG2();
+  bg_sub_ptr_->setHistory(BACKGROUND_HISTORY);
+  bg_sub_ptr_->setVarThreshold(BACKGROUND_VAR_THRESHOLD);
+  bg_sub_ptr_->setDetectShadows(BACKGROUND_DETECT_SHADOWS);
+
+  for (int i=0; i<Mailbox<cv::Mat>::BUFFER_COUNT; ++i)
+  {
+    sample_mailbox_.getBuffer(i).create(image_size,image_type);
+    background_mailbox_.getBuffer(i).create(image_size,image_type);
+  }
+
+  sample_wanted_ = true;
+  running_ = true;
+  thread_ = boost::thread(&BackgroundWorker::work,this);
+}
+
+void BackgroundWorker::stop()
+{
+  if (!thread_.joinable())
+  {
+    return;
+  }
+  running_ = false;
+  wakeup_.notify();
+  thread_.join();
+}
+
+bool BackgroundWorker::sampleWanted()
+{
+  return sample_wanted_.load(boost::memory_order_relaxed);
+}
+
+void BackgroundWorker::sample(const cv::Mat & image)
+{
+  sample_wanted_ = false;
+  image.copyTo(sample_mailbox_.getWriteBuffer());
+  sample_mailbox_.publish();
+  wakeup_.notify();
+}
+
+bool BackgroundWorker::updateBackground(cv::Mat & background)
+{
+  if (!background_mailbox_.update())
+  {
+    return false;
+  }
+  background = background_mailbox_.getReadBuffer();
+  return true;
+}
+
+unsigned long BackgroundWorker::getUpdateCount()
+{
+  return update_count_.load(boost::memory_order_relaxed);
+}
+
+// private
+void BackgroundWorker::work()
+{
+  Tracer::setThreadName("background");
+  while (running_)
+  {
+    unsigned long generation = wakeup_.getGeneration();
+    if (!sample_mailbox_.update())
+    {
+      if (running_)
+      {
+        wakeup_.wait(generation);
+      }
+      continue;
+    }
+
+    {
+      TraceSpan trace_span("BackgroundWorker::update");
+      bg_sub_ptr_->apply(sample_mailbox_.getReadBuffer(),foreground_mask_,BACKGROUND_LEARNING_RATE);
+      bg_sub_ptr_->getBackgroundImage(background_mailbox_.getWriteBuffer());
+    }
+    background_mailbox_.publish();
+    update_count_.fetch_add(1,boost::memory_order_relaxed);
+    sample_wanted_ = true;
+  }
+}
@@ -0,0 +1,64 @@
+// ----------------------------------------------------------------------------
+// BackgroundWorker.h
+//
+//
+// Authors:
+// Peter Polidoro polidorop@janelia.hhmi.org
+// ----------------------------------------------------------------------------
+#ifndef _BACKGROUND_WORKER_H_
+#define _BACKGROUND_WORKER_H_
+#include <iostream>
+
+#include <opencv2/core.hpp>
+#include <opencv2/video.hpp>
+
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+
+#include "Mailbox.h"
+#include "Wakeup.h"
+#include "Tracer.h"
+
+
+// Runs the MOG2 background model on its own thread. The tracking thread
+// offers frames and picks up finished backgrounds through mailboxes, so it
+// never waits on the model update.
+class BackgroundWorker
+{
+public:
+  BackgroundWorker();
+  ~BackgroundWorker();
+
+  void start(const cv::Size image_size,
+             const int image_type);
+  void stop();
+
+  // tracking thread
+  bool sampleWanted();
+  void sample(const cv::Mat & image);
+  bool updateBackground(cv::Mat & background);
+
+  unsigned long getUpdateCount();
+
+private:
+  static const size_t BACKGROUND_HISTORY = 200;
+  static const size_t BACKGROUND_VAR_THRESHOLD = 16;
+  static const bool BACKGROUND_DETECT_SHADOWS = false;
+  static const double BACKGROUND_LEARNING_RATE = 0.15;
+
+  cv::Ptr<cv::BackgroundSubtractorMOG2> bg_sub_ptr_;
+  cv::Mat foreground_mask_;
+
+  Mailbox<cv::Mat> sample_mailbox_;
+  Mailbox<cv::Mat> background_mailbox_;
+  boost::atomic<bool> sample_wanted_;
+  boost::atomic<bool> running_;
+  boost::atomic<unsigned long> update_count_;
+
+  boost::thread thread_;
+  Wakeup wakeup_;
+
+  void work();
+};
+
+#endif
@@ -0,0 +1,446 @@
+// ----------------------------------------------------------------------------
+// Benchmark.cpp
+//
+//
+// Authors:
+// Peter Polidoro polidorop@janelia.hhmi.org
+// ----------------------------------------------------------------------------
+#include "Benchmark.h"
+
+
+// public
+Benchmark::Benchmark()
+{
+}
+
+void Benchmark::run()
+{
+  std::cout << std::endl << "Benchmarking with instruction set: " << ImageKernels::getInstructionSet() << std::endl;
+
+  generateImages();
+  benchmarkBlobMoments();
+  benchmarkBlobLabeler();
+  benchmarkBackground("mog2",ImageProcessor::MOG2);
+  benchmarkBackground("running average",ImageProcessor::RUNNING_AVERAGE);
+  benchmarkBackground("mog2 windowed",ImageProcessor::MOG2,TRACKING_MAX_VELOCITY);
+  benchmarkBackground("running average windowed",ImageProcessor::RUNNING_AVERAGE,TRACKING_MAX_VELOCITY);
+  benchmarkStage("text",false);
+  benchmarkStage("binary",true);
+  benchmarkStageResync("text",false);
+  benchmarkStageResync("binary",true);
+  benchmarkStageResync("binary truncated",true,true);
+  benchmarkRecording("without",false);
+  benchmarkRecording("with",true);
+}
+
+// private
+void Benchmark::generateImages()
+{
+  synthetic_source_.setPacing(FrameSource::AS_FAST_AS_POSSIBLE);
+  synthetic_source_.connect();
+  synthetic_source_.allocateMemory();
+  synthetic_source_.start();
+  synthetic_source_.getBackground(background_);
+
+  images_.resize(FRAME_COUNT);
+  for (size_t i=0; i<FRAME_COUNT; ++i)
+  {
+    synthetic_source_.grabImage(images_[i]);
+  }
+  std::cout << "Generated " << FRAME_COUNT << " synthetic frames." << std::endl;
+}
+
+void Benchmark::benchmarkBlobMoments()
+{
+  std::cout << std::endl << "Blob location, microseconds per frame:" << std::endl;
+
+  cv::Mat foreground;
+  cv::Mat threshold;
+  std::vector<cv::Point> locations;
+  std::vector<cv::Point2f> centroids_opencv(FRAME_COUNT);
+  int64 tick_count_start = cv::getTickCount();
+  for (size_t iteration=0; iteration<ITERATION_COUNT; ++iteration)
+  {
+    for (size_t i=0; i<FRAME_COUNT; ++i)
+    {
+      cv::subtract(background_,images_[i],foreground);
+      cv::threshold(foreground,threshold,THRESHOLD_VALUE,MAX_PIXEL_VALUE,cv::THRESH_BINARY);
+      cv::findNonZero(threshold,locations);
+      cv::Point2f sum(0,0);
+      for (size_t j=0; j<locations.size(); ++j)
+      {
+        sum = sum + cv::Point2f(locations[j]);
+      }
+      if (locations.size() > 0)
+      {
+        centroids_opencv[i] = cv::Point2f(sum.x/locations.size(),sum.y/locations.size());
+      }
+    }
+  }
+  double microseconds_opencv = getMicroseconds(tick_count_start,cv::getTickCount(),FRAME_COUNT*ITERATION_COUNT);
+  printResult("opencv subtract threshold findNonZero",microseconds_opencv,microseconds_opencv);
+
+  BlobMoments moments;
+  std::vector<cv::Point2f> centroids_fused(FRAME_COUNT);
+  tick_count_start = cv::getTickCount();
+  for (size_t iteration=0; iteration<ITERATION_COUNT; ++iteration)
+  {
+    for (size_t i=0; i<FRAME_COUNT; ++i)
+    {
+      ImageKernels::thresholdMoments(background_,images_[i],THRESHOLD_VALUE,cv::Point(0,0),moments);
+      if (moments.count > 0)
+      {
+        centroids_fused[i] = cv::Point2f((double)moments.sum_x/moments.count,(double)moments.sum_y/moments.count);
+      }
+    }
+  }
+  double microseconds_fused = getMicroseconds(tick_count_start,cv::getTickCount(),FRAME_COUNT*ITERATION_COUNT);
+  printResult("fused threshold moments",microseconds_fused,microseconds_opencv);
+
+  double error_max = 0;
+  for (size_t i=0; i<FRAME_COUNT; ++i)
+  {
+    cv::Point2f error = centroids_fused[i] - centroids_opencv[i];
+    error_max = std::max(error_max,(double)std::max(fabs(error.x),fabs(error.y)));
+  }
+  std::cout << "  max centroid difference: " << error_max << " pixels" << std::endl;
+}
+
+void Benchmark::benchmarkBlobLabeler()
+{
+  std::cout << std::endl << "Largest connected blob, microseconds per frame:" << std::endl;
+
+  cv::Mat foreground;
+  cv::Mat threshold;
+  cv::Mat labels;
+  cv::Mat stats;
+  cv::Mat centroids;
+  std::vector<cv::Point2d> centroids_opencv(FRAME_COUNT);
+  double blob_count_mean = 0;
+  int64 tick_count_start = cv::getTickCount();
+  for (size_t iteration=0; iteration<ITERATION_COUNT; ++iteration)
+  {
+    for (size_t i=0; i<FRAME_COUNT; ++i)
+    {
+      cv::subtract(background_,images_[i],foreground);
+      cv::threshold(foreground,threshold,THRESHOLD_VALUE,MAX_PIXEL_VALUE,cv::THRESH_BINARY);
+      int label_count = cv::connectedComponentsWithStats(threshold,labels,stats,centroids,8,CV_32S);
+      // label 0 is the background
+      int largest_label = 0;
+      for (int label=1; label<label_count; ++label)
+      {
+        if ((largest_label == 0) ||
+            (stats.at<int>(label,cv::CC_STAT_AREA) > stats.at<int>(largest_label,cv::CC_STAT_AREA)))
+        {
+          largest_label = label;
+        }
+      }
+      if (largest_label > 0)
+      {
+        centroids_opencv[i] = cv::Point2d(centroids.at<double>(largest_label,0),centroids.at<double>(largest_label,1));
+      }
+      blob_count_mean += (double)(label_count - 1)/(FRAME_COUNT*ITERATION_COUNT);
+    }
+  }
+  double microseconds_opencv = getMicroseconds(tick_count_start,cv::getTickCount(),FRAME_COUNT*ITERATION_COUNT);
+  printResult("opencv subtract threshold connectedComponentsWithStats",microseconds_opencv,microseconds_opencv);
+
+  BlobLabeler blob_labeler;
+  blob_labeler.allocateMemory(background_.size());
+  std::vector<cv::Point2d> centroids_labeler(FRAME_COUNT);
+  tick_count_start = cv::getTickCount();
+  for (size_t iteration=0; iteration<ITERATION_COUNT; ++iteration)
+  {
+    for (size_t i=0; i<FRAME_COUNT; ++i)
+    {
+      blob_labeler.label(background_,images_[i],THRESHOLD_VALUE,cv::Point(0,0));
+      int blob_index = blob_labeler.findLargestBlob(1);
+      if (blob_index >= 0)
+      {
+        centroids_labeler[i] = blob_labeler.getBlob(blob_index).getCentroid();
+      }
+    }
+  }
+  double microseconds_labeler = getMicroseconds(tick_count_start,cv::getTickCount(),FRAME_COUNT*ITERATION_COUNT);
+  printResult("run based blob labeler",microseconds_labeler,microseconds_opencv);
+
+  double error_max = 0;
+  for (size_t i=0; i<FRAME_COUNT; ++i)
+  {
+    cv::Point2d error = centroids_labeler[i] - centroids_opencv[i];
+    error_max = std::max(error_max,std::max(fabs(error.x),fabs(error.y)));
+  }
+  std::cout << "  mean blob count: " << blob_count_mean << std::endl;
+  std::cout << "  max centroid difference: " << error_max << " pixels" << std::endl;
+}
+
+void Benchmark::benchmarkBackground(const char * name,
+                                    const ImageProcessor::BackgroundMode background_mode,
+                                    const int max_velocity)
+{
+  std::cout << std::endl << "Tracking with " << name << " background:" << std::endl;
+
+  SyntheticSource synthetic_source;
+  synthetic_source.setPacing(FrameSource::AS_FAST_AS_POSSIBLE);
+  synthetic_source.allocateMemory();
+  synthetic_source.start();
+
+  ImageProcessor image_processor;
+  image_processor.hide();
+  image_processor.setMode(ImageProcessor::BLOB);
+  image_processor.setBackgroundMode(background_mode);
+  image_processor.setTrackingWindow(max_velocity);
+  cv::Mat image;
+  synthetic_source.grabImage(image);
+  image_processor.allocateMemory(image.data,image.size(),image.type(),image.total());
+
+  std::vector<double> microseconds(BACKGROUND_FRAME_COUNT);
+  double error_sum = 0;
+  TrackState track_state;
+  for (size_t i=0; i<BACKGROUND_FRAME_COUNT; ++i)
+  {
+    synthetic_source.grabImage(image);
+    int64 tick_count_start = cv::getTickCount();
+    image_processor.update(image);
+    microseconds[i] = getMicroseconds(tick_count_start,cv::getTickCount(),1);
+    image_processor.getTrackState(track_state);
+    error_sum += cv::norm(cv::Point2f(track_state.position) - synthetic_source.getBlobPosition());
+  }
+
+  double microseconds_mean = 0;
+  for (size_t i=0; i<BACKGROUND_FRAME_COUNT; ++i)
+  {
+    microseconds_mean += microseconds[i]/BACKGROUND_FRAME_COUNT;
+  }
+  std::cout << "  microseconds per frame mean: " << microseconds_mean
+            << " p50: " << getPercentile(microseconds,50)
+            << " p99: " << getPercentile(microseconds,99)
+            << " max: " << getPercentile(microseconds,100) << std::endl;
+  std::cout << "  mean tracking error: " << (error_sum/BACKGROUND_FRAME_COUNT) << " pixels" << std::endl;
+  if (max_velocity > 0)
+  {
+    std::cout << "  full frame searches: " << image_processor.getFullFrameSearchCount() << std::endl;
+  }
+}
+
+void Benchmark::benchmarkStage(const char * name,
+                               const bool binary_protocol)
+{
+  std::cout << std::endl << "Emulated stage with " << name << " protocol:" << std::endl;
+
+  StageEmulator stage_emulator;
+  stage_emulator.setBinaryProtocol(binary_protocol);
+  stage_emulator.start();
+
+  StageController stage_controller;
+  stage_controller.setDeviceName(stage_emulator.getDevicePath());
+  stage_controller.setBinaryProtocol(binary_protocol);
+  stage_controller.setDeadband(0);
+  stage_controller.connect();
+  stage_controller.homeStage().wait();
+  while (!stage_controller.stageHomed().get())
+  {
+    boost::this_thread::sleep(boost::posix_time::milliseconds(STAGE_HOMED_POLL_PERIOD));
+  }
+
+  // one move at a time measures the full command round trip
+  std::vector<double> microseconds(STAGE_COMMAND_COUNT);
+  for (size_t i=0; i<STAGE_COMMAND_COUNT; ++i)
+  {
+    int64 tick_count_start = cv::getTickCount();
+    stage_controller.moveStageTo(i + 1,i + 1).wait();
+    microseconds[i] = getMicroseconds(tick_count_start,cv::getTickCount(),1);
+  }
+  double microseconds_mean = 0;
+  for (size_t i=0; i<STAGE_COMMAND_COUNT; ++i)
+  {
+    microseconds_mean += microseconds[i]/STAGE_COMMAND_COUNT;
+  }
+  std::cout << "  round trip microseconds mean: " << microseconds_mean
+            << " p50: " << getPercentile(microseconds,50)
+            << " p99: " << getPercentile(microseconds,99)
+            << " max: " << getPercentile(microseconds,100) << std::endl;
+
+  // a new target every STAGE_TARGET_PERIOD measures command throughput
+  unsigned long coalesced_count_start = stage_controller.getCoalescedCount();
+  unsigned long command_count_start = stage_emulator.getCommandCount();
+  size_t target_count = 0;
+  boost::shared_future<bool> move_future;
+  int64 tick_count_start = cv::getTickCount();
+  while ((cv::getTickCount() - tick_count_start) < (STAGE_STREAM_DURATION*cv::getTickFrequency()))
+  {
+    ++target_count;
+    move_future = stage_controller.moveStageTo(target_count,0);
+    boost::this_thread::sleep(boost::posix_time::microseconds(STAGE_TARGET_PERIOD));
+  }
+  move_future.wait();
+  double seconds = (cv::getTickCount() - tick_count_start)/cv::getTickFrequency();
+  unsigned long command_count = stage_emulator.getCommandCount() - command_count_start;
+  std::cout << "  targets: " << target_count
+            << " sent: " << command_count
+            << " coalesced: " << (stage_controller.getCoalescedCount() - coalesced_count_start)
+            << " commands per second: " << (command_count/seconds) << std::endl;
+
+  stage_controller.disconnect();
+  stage_emulator.stop();
+}
+
+void Benchmark::benchmarkStageResync(const char * name,
+                                     const bool binary_protocol,
+                                     const bool truncate_late)
+{
+  std::cout << std::endl << "Emulated stage with " << name << " protocol and late answers:" << std::endl;
+
+  StageEmulator stage_emulator;
+  stage_emulator.setBinaryProtocol(binary_protocol);
+  stage_emulator.start();
+
+  StageController stage_controller;
+  stage_controller.setDeviceName(stage_emulator.getDevicePath());
+  stage_controller.setBinaryProtocol(binary_protocol);
+  stage_controller.setDeadband(0);
+  stage_controller.connect();
+  stage_controller.homeStage().wait();
+  while (!stage_controller.stageHomed().get())
+  {
+    boost::this_thread::sleep(boost::posix_time::milliseconds(STAGE_HOMED_POLL_PERIOD));
+  }
+
+  // alternating methods, so an answer matched to the wrong request fails it
+  // too and every failure beyond the late answers is a misanswer
+  stage_emulator.setLateResponsePeriod(STAGE_LATE_RESPONSE_PERIOD);
+  stage_emulator.setTruncateLateResponses(truncate_late);
+  unsigned long failed_count_start = stage_controller.getFailedCount();
+  unsigned long resync_count_start = stage_controller.getResyncCount();
+  size_t false_count = 0;
+  for (size_t i=0; i<STAGE_RESYNC_COMMAND_COUNT; ++i)
+  {
+    boost::shared_future<bool> move_future;
+    if (i % 2)
+    {
+      move_future = stage_controller.moveStageSoftlyTo(i + 1,i + 1);
+    }
+    else
+    {
+      move_future = stage_controller.moveStageTo(i + 1,i + 1);
+    }
+    if (!move_future.get())
+    {
+      ++false_count;
+    }
+  }
+  unsigned long late_response_count = stage_emulator.getLateResponseCount();
+  unsigned long failed_count = stage_controller.getFailedCount() - failed_count_start;
+  std::cout << "  moves: " << STAGE_RESYNC_COMMAND_COUNT
+            << " late: " << late_response_count
+            << " failed: " << failed_count
+            << " resyncs: " << (stage_controller.getResyncCount() - resync_count_start)
+            << " misanswered: " << ((false_count > late_response_count) ? (false_count - late_response_count) : 0) << std::endl;
+
+  stage_controller.disconnect();
+  stage_emulator.stop();
+}
+
+void Benchmark::benchmarkRecording(const char * name,
+                                   const bool recording)
+{
+  std::cout << std::endl << "Real time tracking " << name << " compressed recording:" << std::endl;
+
+  // paced at the camera frame rate, so the encoders see a real frame stream
+  SyntheticSource synthetic_source;
+  synthetic_source.allocateMemory();
+  synthetic_source.start();
+
+  ImageProcessor image_processor;
+  image_processor.hide();
+  image_processor.setMode(ImageProcessor::BLOB);
+  image_processor.setBackgroundMode(ImageProcessor::RUNNING_AVERAGE);
+  cv::Size image_size = synthetic_source.getImageSize();
+  int image_type = synthetic_source.getImageType();
+  image_processor.allocateMemory(synthetic_source.getImageDataPointer(),image_size,image_type,synthetic_source.getImageDataSize());
+
+  FramePool frame_pool;
+  frame_pool.allocateMemory(image_size,image_type,CompressedRecorder::JOB_COUNT + RECORDING_POOL_SPARE_COUNT);
+
+  boost::filesystem::path path = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  CompressedRecorder compressed_recorder;
+  if (recording)
+  {
+    compressed_recorder.setPath(path.string());
+    compressed_recorder.start(image_size,image_type);
+  }
+
+  std::vector<double> microseconds(RECORDING_FRAME_COUNT);
+  TrackState track_state;
+  size_t frame_count = 0;
+  int64 tick_count_start_all = cv::getTickCount();
+  while (frame_count < RECORDING_FRAME_COUNT)
+  {
+    FramePtr frame_ptr = frame_pool.acquire();
+    if (!frame_ptr)
+    {
+      boost::this_thread::yield();
+      continue;
+    }
+    synthetic_source.grabFrame(*frame_ptr);
+    int64 tick_count_start = cv::getTickCount();
+    image_processor.update(frame_ptr->image);
+    image_processor.getTrackState(track_state);
+    if (recording)
+    {
+      compressed_recorder.record(frame_ptr,track_state);
+    }
+    microseconds[frame_count++] = getMicroseconds(tick_count_start,cv::getTickCount(),1);
+  }
+  double seconds = (cv::getTickCount() - tick_count_start_all)/cv::getTickFrequency();
+  compressed_recorder.stop();
+
+  double microseconds_mean = 0;
+  for (size_t i=0; i<RECORDING_FRAME_COUNT; ++i)
+  {
+    microseconds_mean += microseconds[i]/RECORDING_FRAME_COUNT;
+  }
+  std::cout << "  microseconds per frame mean: " << microseconds_mean
+            << " p50: " << getPercentile(microseconds,50)
+            << " p99: " << getPercentile(microseconds,99)
+            << " max: " << getPercentile(microseconds,100) << std::endl;
+  std::cout << "  frames per second: " << (RECORDING_FRAME_COUNT/seconds) << std::endl;
+  if (recording)
+  {
+    std::cout << "  frames written: " << compressed_recorder.getWrittenCount()
+              << " dropped: " << compressed_recorder.getDroppedCount();
+    if (compressed_recorder.getEncodedByteCount() > 0)
+    {
+      std::cout << " compression ratio: " << ((double)compressed_recorder.getRawByteCount()/compressed_recorder.getEncodedByteCount());
+    }
+    std::cout << std::endl;
+    boost::filesystem::remove(path);
+  }
+}
+
+double Benchmark::getMicroseconds(const int64 tick_count_start,
+                                  const int64 tick_count_end,
+                                  const size_t count)
+{
+  return (1000000.0*(tick_count_end - tick_count_start))/(cv::getTickFrequency()*count);
+}
+
+double Benchmark::getPercentile(std::vector<double> & values,
+                                const double percentile)
+{
+  if (values.size() == 0)
+  {
+    return 0;
+  }
+  size_t index = std::min(values.size() - 1,(size_t)((percentile*values.size())/100));
+  std::nth_element(values.begin(),values.begin() + index,values.end());
+  return values[index];
+}
+
+void Benchmark::printResult(const char * name,
+                            const double microseconds,
+                            const double microseconds_reference)
+{
+  std::cout << "  " << name << ": " << microseconds
+            << " (" << (microseconds_reference/microseconds) << "x)" << std::endl;
+}
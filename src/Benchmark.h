@@ -0,0 +1,82 @@
+// ----------------------------------------------------------------------------
+// Benchmark.h
+//
+//
+// Authors:
+// Peter Polidoro polidorop@janelia.hhmi.org
+// ----------------------------------------------------------------------------
+#ifndef _BENCHMARK_H_
+#define _BENCHMARK_H_
+#include <iostream>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "SyntheticSource.h"
+#include "ImageKernels.h"
+#include "ImageProcessor.h"
+#include "BlobLabeler.h"
+#include "StageController.h"
+#include "StageEmulator.h"
+#include "FramePool.h"
+#include "CompressedRecorder.h"
+
+
+// Times the hot path kernels against the OpenCV code they replaced, on
+// synthetic frames so results are comparable from machine to machine.
+class Benchmark
+{
+public:
+  Benchmark();
+
+  void run();
+
+private:
+  static const size_t FRAME_COUNT = 100;
+  static const size_t ITERATION_COUNT = 10;
+  static const int THRESHOLD_VALUE = 10;
+  static const double MAX_PIXEL_VALUE = 255;
+  static const size_t BACKGROUND_FRAME_COUNT = 2000;
+  static const int TRACKING_MAX_VELOCITY = 16;
+  static const size_t STAGE_COMMAND_COUNT = 200;
+  static const long STAGE_TARGET_PERIOD = 1000;
+  static const double STAGE_STREAM_DURATION = 1.0;
+  static const long STAGE_HOMED_POLL_PERIOD = 10;
+  static const size_t STAGE_RESYNC_COMMAND_COUNT = 40;
+  static const unsigned long STAGE_LATE_RESPONSE_PERIOD = 10;
+  static const size_t RECORDING_FRAME_COUNT = 1000;
+  static const size_t RECORDING_POOL_SPARE_COUNT = 2;
+
+  SyntheticSource synthetic_source_;
+  std::vector<cv::Mat> images_;
+  cv::Mat background_;
+
+  void generateImages();
+  void benchmarkBlobMoments();
+  void benchmarkBlobLabeler();
+  void benchmarkBackground(const char * name,
+                           const ImageProcessor::BackgroundMode background_mode,
+                           const int max_velocity=0);
+
+  void benchmarkStage(const char * name,
+                      const bool binary_protocol);
+  void benchmarkStageResync(const char * name,
+                            const bool binary_protocol,
+                            const bool truncate_late=false);
+  void benchmarkRecording(const char * name,
+                          const bool recording);
+
+  static double getMicroseconds(const int64 tick_count_start,
+                                const int64 tick_count_end,
+                                const size_t count);
+  static double getPercentile(std::vector<double> & values,
+                              const double percentile);
+  static void printResult(const char * name,
+                          const double microseconds,
+                          const double microseconds_reference);
+};
+
+#endif
@@ -0,0 +1,307 @@
+// ----------------------------------------------------------------------------
+// BlobLabeler.cpp
+//
+//
+// Authors:
+// Peter Polidoro polidorop@janelia.hhmi.org
+// ----------------------------------------------------------------------------
+#include "BlobLabeler.h"
+
+
+// public
+cv::Point2d Blob::getCentroid() const
+{
+  return cv::Point2d((double)sum_x/area,(double)sum_y/area);
+}
+
+cv::Rect Blob::getBoundingBox() const
+{
+  return cv::Rect(x_min,y_min,x_max - x_min + 1,y_max - y_min + 1);
+}
+
+BlobLabeler::BlobLabeler()
+{
+  run_count_ = 0;
+  blob_count_ = 0;
+}
+
+void BlobLabeler::allocateMemory(const cv::Size image_size)
+{
+  // worst case is alternating foreground and background pixels
+  size_t run_count_max = (size_t)image_size.height*(image_size.width/2 + 1);
+  runs_.resize(run_count_max);
+  run_blob_indices_.resize(run_count_max);
+  blobs_.resize(run_count_max);
+  mask_row_.resize(image_size.width);
+  run_count_ = 0;
+  blob_count_ = 0;
+}
+
+void BlobLabeler::label(const cv::Mat & background,
+                        const cv::Mat & image,
+                        const unsigned char threshold,
+                        const cv::Point origin)
+{
+  run_count_ = 0;
+  blob_count_ = 0;
+  if ((size_t)image.cols > mask_row_.size())
+  {
+    return;
+  }
+
+  size_t previous_begin = 0;
+  size_t previous_end = 0;
+  for (int row=0; row<image.rows; ++row)
+  {
+    ImageKernels::thresholdRow(background.ptr<unsigned char>(row),
+                               image.ptr<unsigned char>(row),
+                               image.cols,
+                               threshold,
+                               &mask_row_[0]);
+    size_t current_begin = run_count_;
+    findRuns(image.cols,origin,row + origin.y);
+    joinRuns(previous_begin,previous_end,current_begin,run_count_);
+    previous_begin = current_begin;
+    previous_end = run_count_;
+  }
+  reduceBlobs();
+}
+
+size_t BlobLabeler::getBlobCount()
+{
+  return blob_count_;
+}
+
+const Blob & BlobLabeler::getBlob(const size_t index)
+{
+  return blobs_[index];
+}
+
+void BlobLabeler::computeIntensityMoments(const cv::Mat & background,
+                                          const cv::Mat & image,
+                                          const cv::Point origin,
+                                          const size_t blob_index,
+                                          IntensityMoments & moments)
+{
+  moments.weight = 0;
+  moments.sum_x = 0;
+  moments.sum_y = 0;
+  moments.sum_xx = 0;
+  moments.sum_yy = 0;
+  moments.sum_xy = 0;
+  for (size_t i=0; i<run_count_; ++i)
+  {
+    if (run_blob_indices_[i] != (int)blob_index)
+    {
+      continue;
+    }
+    const Run & run = runs_[i];
+    const unsigned char * background_ptr = background.ptr<unsigned char>(run.y - origin.y) - origin.x;
+    const unsigned char * image_ptr = image.ptr<unsigned char>(run.y - origin.y) - origin.x;
+    boost::uint64_t y = run.y;
+    boost::uint64_t row_weight = 0;
+    boost::uint64_t row_sum_x = 0;
+    boost::uint64_t row_sum_xx = 0;
+    for (boost::uint64_t x=run.x_start; x<(boost::uint64_t)run.x_end; ++x)
+    {
+      // every run pixel is above threshold so the difference is positive
+      boost::uint64_t weight = background_ptr[x] - image_ptr[x];
+      row_weight += weight;
+      row_sum_x += weight*x;
+      row_sum_xx += weight*x*x;
+    }
+    moments.weight += row_weight;
+    moments.sum_x += row_sum_x;
+    moments.sum_y += row_weight*y;
+    moments.sum_xx += row_sum_xx;
+    moments.sum_yy += row_weight*y*y;
+    moments.sum_xy += row_sum_x*y;
+  }
+}
+
+int BlobLabeler::findLargestBlob(const boost::uint64_t area_min)
+{
+  int largest_index = -1;
+  boost::uint64_t largest_area = area_min;
+  for (size_t i=0; i<blob_count_; ++i)
+  {
+    if (blobs_[i].area >= largest_area)
+    {
+      largest_index = i;
+      largest_area = blobs_[i].area + 1;
+    }
+  }
+  return largest_index;
+}
+
+int BlobLabeler::findClosestBlob(const cv::Point2d & point,
+                                 const boost::uint64_t area_min)
+{
+  int closest_index = -1;
+  double closest_distance_squared = 0;
+  for (size_t i=0; i<blob_count_; ++i)
+  {
+    if (blobs_[i].area < area_min)
+    {
+      continue;
+    }
+    cv::Point2d offset = blobs_[i].getCentroid() - point;
+    double distance_squared = offset.dot(offset);
+    if ((closest_index < 0) || (distance_squared < closest_distance_squared))
+    {
+      closest_index = i;
+      closest_distance_squared = distance_squared;
+    }
+  }
+  return closest_index;
+}
+
+// private
+void BlobLabeler::findRuns(const int cols,
+                           const cv::Point origin,
+                           const int y)
+{
+  const unsigned char * mask_ptr = &mask_row_[0];
+  int col = 0;
+  while (col < cols)
+  {
+    // skip background eight pixels at a time
+    boost::uint64_t word;
+    while (col + 8 <= cols)
+    {
+      std::memcpy(&word,mask_ptr + col,sizeof(word));
+      if (word != 0)
+      {
+        break;
+      }
+      col += 8;
+    }
+    while ((col < cols) && (mask_ptr[col] == 0))
+    {
+      ++col;
+    }
+    if (col == cols)
+    {
+      break;
+    }
+    int x_start = col;
+    while ((col < cols) && (mask_ptr[col] != 0))
+    {
+      ++col;
+    }
+    Run & run = runs_[run_count_];
+    run.x_start = x_start + origin.x;
+    run.x_end = col + origin.x;
+    run.y = y;
+    run.parent = run_count_;
+    ++run_count_;
+  }
+}
+
+void BlobLabeler::joinRuns(const size_t previous_begin,
+                           const size_t previous_end,
+                           const size_t current_begin,
+                           const size_t current_end)
+{
+  // both rows are sorted by x, runs touch diagonally when the previous run
+  // starts at or before the current end and ends at or after its start
+  size_t previous = previous_begin;
+  for (size_t current=current_begin; current<current_end; ++current)
+  {
+    const Run & run = runs_[current];
+    while ((previous < previous_end) && (runs_[previous].x_end < run.x_start))
+    {
+      ++previous;
+    }
+    size_t overlapping = previous;
+    while ((overlapping < previous_end) && (runs_[overlapping].x_start <= run.x_end))
+    {
+      unite(overlapping,current);
+      ++overlapping;
+    }
+    // the last overlapping run may also touch the next current run
+    if (overlapping > previous)
+    {
+      previous = overlapping - 1;
+    }
+  }
+}
+
+int BlobLabeler::findRoot(int run_index)
+{
+  while (runs_[run_index].parent != run_index)
+  {
+    runs_[run_index].parent = runs_[runs_[run_index].parent].parent;
+    run_index = runs_[run_index].parent;
+  }
+  return run_index;
+}
+
+void BlobLabeler::unite(const int run_index_a,
+                        const int run_index_b)
+{
+  // the root is always the earliest run, so roots are reduced before the
+  // runs that point to them
+  int root_a = findRoot(run_index_a);
+  int root_b = findRoot(run_index_b);
+  if (root_a < root_b)
+  {
+    runs_[root_b].parent = root_a;
+  }
+  else if (root_b < root_a)
+  {
+    runs_[root_a].parent = root_b;
+  }
+}
+
+void BlobLabeler::reduceBlobs()
+{
+  for (size_t i=0; i<run_count_; ++i)
+  {
+    const Run & run = runs_[i];
+    int root = findRoot(i);
+    int blob_index;
+    if (root == (int)i)
+    {
+      blob_index = blob_count_++;
+      Blob & blob = blobs_[blob_index];
+      blob.area = 0;
+      blob.sum_x = 0;
+      blob.sum_y = 0;
+      blob.sum_xx = 0;
+      blob.sum_yy = 0;
+      blob.sum_xy = 0;
+      blob.x_min = run.x_start;
+      blob.x_max = run.x_end - 1;
+      blob.y_min = run.y;
+      blob.y_max = run.y;
+    }
+    else
+    {
+      blob_index = run_blob_indices_[root];
+    }
+    run_blob_indices_[i] = blob_index;
+
+    // closed form sums over x = x_start .. x_end - 1
+    Blob & blob = blobs_[blob_index];
+    boost::uint64_t x_first = run.x_start;
+    boost::uint64_t x_last = run.x_end - 1;
+    boost::uint64_t length = run.x_end - run.x_start;
+    boost::uint64_t y = run.y;
+    boost::uint64_t sum_x = (length*(x_first + x_last))/2;
+    boost::uint64_t sum_xx = (x_last*(x_last + 1)*(2*x_last + 1))/6;
+    if (x_first > 0)
+    {
+      sum_xx -= ((x_first - 1)*x_first*(2*x_first - 1))/6;
+    }
+    blob.area += length;
+    blob.sum_x += sum_x;
+    blob.sum_y += length*y;
+    blob.sum_xx += sum_xx;
+    blob.sum_yy += length*y*y;
+    blob.sum_xy += sum_x*y;
+    blob.x_min = std::min(blob.x_min,run.x_start);
+    blob.x_max = std::max(blob.x_max,run.x_end - 1);
+    blob.y_max = run.y;
+  }
+}
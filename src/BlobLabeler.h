@@ -0,0 +1,112 @@
+// ----------------------------------------------------------------------------
+// BlobLabeler.h
+//
+//
+// Authors:
+// Peter Polidoro polidorop@janelia.hhmi.org
+// ----------------------------------------------------------------------------
+#ifndef _BLOB_LABELER_H_
+#define _BLOB_LABELER_H_
+#include <vector>
+#include <cstring>
+#include <algorithm>
+
+#include <opencv2/core.hpp>
+
+#include <boost/cstdint.hpp>
+
+#include "ImageKernels.h"
+
+
+struct Blob
+{
+  boost::uint64_t area;
+  boost::uint64_t sum_x;
+  boost::uint64_t sum_y;
+  boost::uint64_t sum_xx;
+  boost::uint64_t sum_yy;
+  boost::uint64_t sum_xy;
+  int x_min;
+  int x_max;
+  int y_min;
+  int y_max;
+
+  cv::Point2d getCentroid() const;
+  cv::Rect getBoundingBox() const;
+};
+
+// Moments weighted by how far each pixel is below the background
+struct IntensityMoments
+{
+  boost::uint64_t weight;
+  boost::uint64_t sum_x;
+  boost::uint64_t sum_y;
+  boost::uint64_t sum_xx;
+  boost::uint64_t sum_yy;
+  boost::uint64_t sum_xy;
+};
+
+// Single pass 8-connected component labelling of the thresholded foreground.
+// Foreground runs are found row by row, joined to overlapping runs on the
+// previous row with union-find, then reduced to per blob area, bounding box
+// and moments. All buffers are sized in allocateMemory, so labelling a frame
+// never allocates.
+class BlobLabeler
+{
+public:
+  BlobLabeler();
+
+  void allocateMemory(const cv::Size image_size);
+
+  // labels pixels where background - image > threshold, coordinates are
+  // offset by origin so windows report full image positions
+  void label(const cv::Mat & background,
+             const cv::Mat & image,
+             const unsigned char threshold,
+             const cv::Point origin);
+
+  size_t getBlobCount();
+  const Blob & getBlob(const size_t index);
+
+  // background and image must be the ones passed to the last label call
+  void computeIntensityMoments(const cv::Mat & background,
+                               const cv::Mat & image,
+                               const cv::Point origin,
+                               const size_t blob_index,
+                               IntensityMoments & moments);
+
+  // return -1 when no blob has at least area_min pixels
+  int findLargestBlob(const boost::uint64_t area_min);
+  int findClosestBlob(const cv::Point2d & point,
+                      const boost::uint64_t area_min);
+
+private:
+  struct Run
+  {
+    int x_start;
+    int x_end;
+    int y;
+    int parent;
+  };
+
+  std::vector<Run> runs_;
+  std::vector<int> run_blob_indices_;
+  std::vector<Blob> blobs_;
+  std::vector<unsigned char> mask_row_;
+  size_t run_count_;
+  size_t blob_count_;
+
+  void findRuns(const int cols,
+                const cv::Point origin,
+                const int y);
+  void joinRuns(const size_t previous_begin,
+                const size_t previous_end,
+                const size_t current_begin,
+                const size_t current_end);
+  int findRoot(int run_index);
+  void unite(const int run_index_a,
+             const int run_index_b);
+  void reduceBlobs();
+};
+
+#endif
@@ -11,240 +11,304 @@
 // public
 Calibration::Calibration()
 {
+  captured_count_ = 0;
+  next_view_index_ = 0;
+  capture_finished_ = false;
 }
 
-void Calibration::recalibrate()
+void Calibration::recalibrate(FrameSource & frame_source,
+                              StageController & stage_controller)
 {
-  // boost::filesystem::path chessboard_path = configuration_repository_path_;
-  // chessboard_path /= "images/chessboard.png";
-
-  // //////
-  // cv::Mat chessboard = cv::imread(chessboard_path.string(),cv::IMREAD_GRAYSCALE);
-  // if(!chessboard.data)
-  // {
-  //   std::cout <<  "Could not open or find the chessboard image!" << std::endl;
-  //   return false;
-  // }
-  // else
-  // {
-  //   std::cout <<  "Found chessboard image!" << std::endl;
-  // }
-
-  // size_t pattern_count_col = 6;
-  // size_t pattern_count_row = 8;
-  // cv::Size patternsize(pattern_count_col,pattern_count_row);
-  // std::vector<cv::Point2f> corners;
-
-  // bool patternfound = cv::findChessboardCorners(chessboard,
-  //                                               patternsize,
-  //                                               corners,
-  //                                               cv::CALIB_CB_ADAPTIVE_THRESH + cv::CALIB_CB_NORMALIZE_IMAGE + cv::CALIB_CB_FAST_CHECK);
-
-  // if(!patternfound)
-  // {
-  //   std::cout <<  "Could not find the chessboard corners!" << std::endl;
-  //   return false;
-  // }
-  // if(patternfound)
-  // {
-  //   std::cout <<  "Found the chessboard corners!" << std::endl;
-  //   cv::cornerSubPix(chessboard,
-  //                    corners,
-  //                    cv::Size(11, 11),
-  //                    cv::Size(-1, -1),
-  //                    cv::TermCriteria(CV_TERMCRIT_EPS + CV_TERMCRIT_ITER, 30, 0.1));
-  // }
-
-  // std::vector<cv::Point2f> image_points;
-  // for (size_t row=0; row<pattern_count_row; ++row)
-  // {
-  //   for (size_t col=0; col<pattern_count_col; ++col)
-  //   {
-  //     if ((col % (pattern_count_col - 1)) == 0)
-  //     {
-  //       image_points.push_back(corners[row*pattern_count_col + col]);
-  //     }
-  //   }
-  // }
-  // std::vector<cv::Point2i> image_points_i;
-  // cv::Mat(image_points).copyTo(image_points_i);
-  // boost::filesystem::path image_points_path = configuration_repository_path_;
-  // image_points_path /= "calibration/image_points.yml";
-  // cv::FileStorage image_points_fs(image_points_path.string(), cv::FileStorage::WRITE);
-  // image_points_fs << "image_points" << image_points_i;
-  // image_points_fs.release();
-
-
-  // float font_scale = 0.55;
-  // int font_thickness = 2;
-
-  // cv::Mat chessboard_image_points;
-  // cv::cvtColor(chessboard,chessboard_image_points,CV_GRAY2BGR);
-  // cv::drawChessboardCorners(chessboard_image_points,patternsize,cv::Mat(corners),patternfound);
-  // size_t index = 0;
-  // for (std::vector<cv::Point2i>::iterator it = image_points_i.begin(); it != image_points_i.end(); ++it)
-  // {
-  //   cv::Point2i image_pt = *it;
-  //   std::stringstream image_pt_ss;
-  //   image_pt_ss << "i" << index << image_pt;
-  //   cv::Point2i text_location;
-  //   if (((index % 4) == 0) || (((index - 1) % 4) == 0))
-  //   {
-  //     text_location = cv::Point2i(image_pt.x,image_pt.y - 10);
-  //   }
-  //   else
-  //   {
-  //     text_location = cv::Point2i(image_pt.x,image_pt.y + 30);
-  //   }
-  //   cv::putText(chessboard_image_points,
-  //               image_pt_ss.str(),
-  //               text_location,
-  //               cv::FONT_HERSHEY_SIMPLEX,
-  //               font_scale,
-  //               cv::Scalar(0,0,255),
-  //               font_thickness);
-  //   ++index;
-  // }
-  // boost::filesystem::path chessboard_image_points_path = configuration_repository_path_;
-  // chessboard_image_points_path /= "images/chessboard_image_points.png";
-  // cv::imwrite(chessboard_image_points_path.string(),chessboard_image_points);
-
-  // boost::filesystem::path stage_points_path = configuration_repository_path_;
-  // stage_points_path /= "calibration/stage_points.yml";
-  // cv::FileStorage stage_points_fs(stage_points_path.string(), cv::FileStorage::READ);
-  // std::vector<cv::Point2f> stage_points;
-  // stage_points_fs["stage_points"] >> stage_points;
-  // stage_points_fs.release();
-
-  // std::vector<cv::Point2i> stage_points_i;
-  // cv::Mat(stage_points).copyTo(stage_points_i);
-
-  // cv::Mat chessboard_stage_points;
-  // cv::cvtColor(chessboard,chessboard_stage_points,CV_GRAY2BGR);
-  // cv::drawChessboardCorners(chessboard_stage_points,patternsize,cv::Mat(corners),patternfound);
-  // for (size_t i=0; i<stage_points_i.size(); ++i)
-  // {
-  //   cv::Point2i stage_pt = stage_points_i[i];
-  //   cv::Point2i image_pt = image_points_i[i];
-  //   std::stringstream stage_pt_ss;
-  //   stage_pt_ss << "s" << i << stage_pt;
-  //   cv::Point2i text_location;
-  //   if (((i % 4) == 0) || (((i - 1) % 4) == 0))
-  //   {
-  //     text_location = cv::Point2i(image_pt.x,image_pt.y - 10);
-  //   }
-  //   else
-  //   {
-  //     text_location = cv::Point2i(image_pt.x,image_pt.y + 30);
-  //   }
-  //   cv::putText(chessboard_stage_points,
-  //               stage_pt_ss.str(),
-  //               text_location,
-  //               cv::FONT_HERSHEY_SIMPLEX,
-  //               font_scale,
-  //               cv::Scalar(0,0,255),
-  //               font_thickness);
-  // }
-  // boost::filesystem::path chessboard_stage_points_path = configuration_repository_path_;
-  // chessboard_stage_points_path /= "images/chessboard_stage_points.png";
-  // cv::imwrite(chessboard_stage_points_path.string(),chessboard_stage_points);
-
-  // cv::FileStorage calibration_fs(calibration_path.string(), cv::FileStorage::WRITE);
-  // cv::Mat homography_image_to_stage = cv::findHomography(image_points,stage_points,CV_RANSAC);
-  // cv::Mat homography_stage_to_image = cv::findHomography(stage_points,image_points,CV_RANSAC);
-  // calibration_fs << "homography_image_to_stage" << homography_image_to_stage;
-  // calibration_fs << "homography_stage_to_image" << homography_stage_to_image;
-
-  // calibration_fs.release();
-
-  // cv::Mat calibrated;
-  // cv::cvtColor(chessboard,calibrated,CV_GRAY2BGR);
-
-  // std::vector<cv::Point2f> stage_points_in;
-  // std::vector<cv::Point2f> image_points_out;
-
-  // cv::Point2f stage_offset(15000,15000);
-  // cv::Point2f stage_limit(100000,100000);
-
-  // stage_points_in.push_back(stage_offset);
-  // stage_points_in.push_back(cv::Point2f((stage_limit.x - stage_offset.x),stage_offset.y));
-  // stage_points_in.push_back(cv::Point2f(stage_offset.x,(stage_limit.y - stage_offset.y)));
-  // stage_points_in.push_back(cv::Point2f((stage_limit.x - stage_offset.x),(stage_limit.y - stage_offset.y)));
-
-  // cv::perspectiveTransform(stage_points_in,image_points_out,homography_stage_to_image);
-  // std::vector<cv::Point2i> stage_points_in_i;
-  // cv::Mat(stage_points_in).copyTo(stage_points_in_i);
-  // std::vector<cv::Point2i> image_points_out_i;
-  // cv::Mat(image_points_out).copyTo(image_points_out_i);
-
-  // cv::line(calibrated,
-  //          image_points_out[0],
-  //          image_points_out[1],
-  //          cv::Scalar(255,0,0),
-  //          4);
-  // cv::line(calibrated,
-  //          image_points_out[0],
-  //          image_points_out[2],
-  //          cv::Scalar(0,255,0),
-  //          4);
-  // cv::line(calibrated,
-  //          image_points_out[1],
-  //          image_points_out[3],
-  //          cv::Scalar(255,255,0),
-  //          4);
-  // cv::line(calibrated,
-  //          image_points_out[2],
-  //          image_points_out[3],
-  //          cv::Scalar(255,255,0),
-  //          4);
-
-  // std::stringstream image_out_ss_0;
-  // image_out_ss_0 << "s" << stage_points_in_i[0];
-  // cv::Point2f image_out_0(image_points_out[0].x + 20,image_points_out[0].y - 20);
-  // cv::putText(calibrated,
-  //             image_out_ss_0.str(),
-  //             image_out_0,
-  //             cv::FONT_HERSHEY_SIMPLEX,
-  //             font_scale,
-  //             cv::Scalar(0,0,255),
-  //             font_thickness);
-
-  // std::stringstream image_out_ss_1;
-  // image_out_ss_1 << "s" << stage_points_in_i[1];
-  // cv::Point2f image_out_1(image_points_out[1].x + 20,image_points_out[1].y + 30);
-  // cv::putText(calibrated,
-  //             image_out_ss_1.str(),
-  //             image_out_1,
-  //             cv::FONT_HERSHEY_SIMPLEX,
-  //             font_scale,
-  //             cv::Scalar(0,0,255),
-  //             font_thickness);
-
-  // std::stringstream image_out_ss_2;
-  // image_out_ss_2 << "s" << stage_points_in_i[2];
-  // cv::Point2f image_out_2(image_points_out[2].x,image_points_out[2].y + 20);
-  // cv::putText(calibrated,
-  //             image_out_ss_2.str(),
-  //             image_out_2,
-  //             cv::FONT_HERSHEY_SIMPLEX,
-  //             font_scale,
-  //             cv::Scalar(0,0,255),
-  //             font_thickness);
-
-  // std::stringstream image_out_ss_3;
-  // image_out_ss_3 << "s" << stage_points_in_i[3];
-  // cv::Point2f image_out_3(image_points_out[3].x,image_points_out[3].y + 20);
-  // cv::putText(calibrated,
-  //             image_out_ss_3.str(),
-  //             image_out_3,
-  //             cv::FONT_HERSHEY_SIMPLEX,
-  //             font_scale,
-  //             cv::Scalar(0,0,255),
-  //             font_thickness);
-
-  // boost::filesystem::path calibrated_path = configuration_repository_path_;
-  // calibrated_path /= "images/calibrated.png";
-  // cv::imwrite(calibrated_path.string(),calibrated);
+  int64 tick_count_start = cv::getTickCount();
+
+  homeStage(stage_controller);
+
+  views_.clear();
+  views_.resize(STAGE_GRID_COUNT*STAGE_GRID_COUNT);
+  captured_count_ = 0;
+  next_view_index_ = 0;
+  capture_finished_ = false;
+
+  boost::thread_group refine_threads;
+  unsigned int refine_thread_count = std::max(boost::thread::hardware_concurrency(),1u);
+  for (unsigned int i=0; i<refine_thread_count; ++i)
+  {
+    refine_threads.create_thread(boost::bind(&Calibration::refineCorners,this));
+  }
+
+  try
+  {
+    captureViews(frame_source,stage_controller);
+  }
+  catch (...)
+  {
+    {
+      boost::mutex::scoped_lock lock(view_mutex_);
+      capture_finished_ = true;
+    }
+    view_condition_.notify_all();
+    refine_threads.join_all();
+    throw;
+  }
+  {
+    boost::mutex::scoped_lock lock(view_mutex_);
+    capture_finished_ = true;
+  }
+  view_condition_.notify_all();
+  refine_threads.join_all();
+
+  std::vector<cv::Point2d> board_centers;
+  std::vector<cv::Point2d> stage_points;
+  for (size_t i=0; i<views_.size(); ++i)
+  {
+    const View & view = views_[i];
+    if (!view.found)
+    {
+      continue;
+    }
+    cv::Point2d board_center(0,0);
+    for (size_t j=0; j<view.corners.size(); ++j)
+    {
+      board_center.x += view.corners[j].x;
+      board_center.y += view.corners[j].y;
+    }
+    board_center.x /= view.corners.size();
+    board_center.y /= view.corners.size();
+    board_centers.push_back(board_center);
+    stage_points.push_back(view.stage_point);
+  }
+  std::cout << std::endl << "Found the chessboard corners in " << board_centers.size();
+  std::cout << " of " << views_.size() << " views, refined using " << refine_thread_count << " threads." << std::endl;
+  if (board_centers.size() < VIEW_COUNT_MIN)
+  {
+    throw std::runtime_error("Too few chessboard views to recalibrate.");
+  }
+
+  cv::Size image_size = views_[0].image.size();
+  cv::Mat camera_matrix;
+  cv::Mat distortion_coefficients;
+  if (fitCameraModel(image_size,camera_matrix,distortion_coefficients))
+  {
+    // the homography maps undistorted image points, matching CoordinateConverter
+    std::vector<cv::Point2d> undistorted_centers;
+    cv::undistortPoints(board_centers,
+                        undistorted_centers,
+                        camera_matrix,
+                        distortion_coefficients,
+                        cv::noArray(),
+                        camera_matrix);
+    board_centers = undistorted_centers;
+  }
+
+  cv::Mat inlier_mask;
+  cv::Mat homography_image_to_stage = cv::findHomography(board_centers,
+                                                         stage_points,
+                                                         cv::RANSAC,
+                                                         RANSAC_STAGE_THRESHOLD,
+                                                         inlier_mask);
+  cv::Mat homography_stage_to_image = cv::findHomography(stage_points,
+                                                         board_centers,
+                                                         cv::RANSAC,
+                                                         RANSAC_IMAGE_THRESHOLD);
+  if (homography_image_to_stage.empty() || homography_stage_to_image.empty())
+  {
+    throw std::runtime_error("Unable to fit the image to stage homography.");
+  }
+  std::cout << std::endl << "homography inliers: " << cv::countNonZero(inlier_mask);
+  std::cout << " of " << board_centers.size() << std::endl;
+
+  configuration_.writeCalibration(homography_image_to_stage,
+                                  homography_stage_to_image,
+                                  camera_matrix,
+                                  distortion_coefficients,
+                                  image_size);
+
+  views_.clear();
+
+  double duration = (cv::getTickCount() - tick_count_start)/cv::getTickFrequency();
+  std::cout << std::endl << "Recalibrated in " << duration << " seconds." << std::endl;
 }
 
 // private
+void Calibration::homeStage(StageController & stage_controller)
+{
+  if (!stage_controller.homeStage().get())
+  {
+    throw std::runtime_error("Unable to home the stage for recalibration.");
+  }
+  while (!stage_controller.stageHomed().get())
+  {
+    boost::this_thread::sleep(boost::posix_time::milliseconds(STAGE_HOMED_POLL_DURATION));
+  }
+}
+
+void Calibration::captureViews(FrameSource & frame_source,
+                               StageController & stage_controller)
+{
+  cv::Size pattern_size(PATTERN_COUNT_COL,PATTERN_COUNT_ROW);
+  long stage_step = (STAGE_POSITION_MAX - STAGE_POSITION_MIN)/(STAGE_GRID_COUNT - 1);
+  cv::Mat image;
+  std::vector<cv::Point2f> corners;
+  for (int row=0; row<STAGE_GRID_COUNT; ++row)
+  {
+    for (int i=0; i<STAGE_GRID_COUNT; ++i)
+    {
+      // serpentine so every move is a single grid step
+      int col = (row % 2) ? (STAGE_GRID_COUNT - 1 - i) : i;
+      long x = STAGE_POSITION_MIN + col*stage_step;
+      long y = STAGE_POSITION_MIN + row*stage_step;
+      // false only means the stage was already inside the deadband
+      stage_controller.moveStageTo(x,y).get();
+      for (int j=0; j<STALE_FRAME_COUNT; ++j)
+      {
+        grabImage(frame_source,image);
+      }
+
+      // the move resolves once acknowledged, not once the stage stops, so
+      // wait for two consecutive frames to show the board in one place
+      View & view = views_[row*STAGE_GRID_COUNT + i];
+      view.stage_point = cv::Point2d(x,y);
+      view.found = false;
+      bool found_prev = false;
+      for (int j=0; (j<SETTLE_FRAME_COUNT_MAX) && !view.found; ++j)
+      {
+        grabImage(frame_source,image);
+        bool found = cv::findChessboardCorners(image,
+                                               pattern_size,
+                                               corners,
+                                               cv::CALIB_CB_ADAPTIVE_THRESH + cv::CALIB_CB_NORMALIZE_IMAGE + cv::CALIB_CB_FAST_CHECK);
+        view.found = found && found_prev && cornersAgree(corners,view.corners);
+        found_prev = found;
+        // the view keeps the corners of the newest frame
+        view.corners.swap(corners);
+      }
+      image.copyTo(view.image);
+      {
+        boost::mutex::scoped_lock lock(view_mutex_);
+        ++captured_count_;
+      }
+      view_condition_.notify_one();
+    }
+  }
+}
+
+void Calibration::grabImage(FrameSource & frame_source,
+                            cv::Mat & image)
+{
+  int attempt_count = 0;
+  while (!frame_source.grabImage(image))
+  {
+    if (++attempt_count >= GRAB_ATTEMPTS_MAX)
+    {
+      throw std::runtime_error("Unable to grab chessboard image.");
+    }
+  }
+}
+
+bool Calibration::cornersAgree(const std::vector<cv::Point2f> & corners,
+                               const std::vector<cv::Point2f> & corners_prev)
+{
+  if (corners.size() != corners_prev.size())
+  {
+    return false;
+  }
+  double distance_max_squared = SETTLE_CORNER_DISTANCE_MAX*SETTLE_CORNER_DISTANCE_MAX;
+  for (size_t i=0; i<corners.size(); ++i)
+  {
+    double dx = corners[i].x - corners_prev[i].x;
+    double dy = corners[i].y - corners_prev[i].y;
+    if ((dx*dx + dy*dy) > distance_max_squared)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+void Calibration::refineCorners()
+{
+  while (true)
+  {
+    size_t view_index;
+    {
+      boost::mutex::scoped_lock lock(view_mutex_);
+      while ((next_view_index_ == captured_count_) && !capture_finished_)
+      {
+        view_condition_.wait(lock);
+      }
+      if (next_view_index_ == captured_count_)
+      {
+        return;
+      }
+      view_index = next_view_index_++;
+    }
+
+    View & view = views_[view_index];
+    if (view.found)
+    {
+      cv::cornerSubPix(view.image,
+                       view.corners,
+                       cv::Size(11, 11),
+                       cv::Size(-1, -1),
+                       cv::TermCriteria(cv::TermCriteria::EPS + cv::TermCriteria::COUNT, 30, 0.1));
+    }
+  }
+}
+
+bool Calibration::fitCameraModel(const cv::Size & image_size,
+                                 cv::Mat & camera_matrix,
+                                 cv::Mat & distortion_coefficients)
+{
+  std::vector<cv::Point3f> board_points;
+  for (int row=0; row<PATTERN_COUNT_ROW; ++row)
+  {
+    for (int col=0; col<PATTERN_COUNT_COL; ++col)
+    {
+      board_points.push_back(cv::Point3f(col,row,0));
+    }
+  }
+  std::vector<std::vector<cv::Point3f> > object_points;
+  std::vector<std::vector<cv::Point2f> > image_points;
+  for (size_t i=0; i<views_.size(); ++i)
+  {
+    if (views_[i].found)
+    {
+      object_points.push_back(board_points);
+      image_points.push_back(views_[i].corners);
+    }
+  }
+
+  // the stage only translates the board, so focal length cannot be told apart
+  // from board distance, fix it at a nominal value and fit radial distortion
+  double focal_length = image_size.width;
+  camera_matrix = cv::Mat::eye(3,3,CV_64F);
+  camera_matrix.at<double>(0,0) = focal_length;
+  camera_matrix.at<double>(1,1) = focal_length;
+  camera_matrix.at<double>(0,2) = (image_size.width - 1)/2.0;
+  camera_matrix.at<double>(1,2) = (image_size.height - 1)/2.0;
+  distortion_coefficients = cv::Mat::zeros(5,1,CV_64F);
+
+  std::vector<cv::Mat> rotation_vectors;
+  std::vector<cv::Mat> translation_vectors;
+  double rms = cv::calibrateCamera(object_points,
+                                   image_points,
+                                   image_size,
+                                   camera_matrix,
+                                   distortion_coefficients,
+                                   rotation_vectors,
+                                   translation_vectors,
+                                   cv::CALIB_USE_INTRINSIC_GUESS +
+                                   cv::CALIB_FIX_FOCAL_LENGTH +
+                                   cv::CALIB_FIX_PRINCIPAL_POINT +
+                                   cv::CALIB_ZERO_TANGENT_DIST +
+                                   cv::CALIB_FIX_K3);
+  std::cout << std::endl << "camera model reprojection error: " << rms << " pixels" << std::endl;
+  if (!(rms < CAMERA_MODEL_RMS_MAX))
+  {
+    std::cout << "camera model rejected, not correcting distortion." << std::endl;
+    camera_matrix.release();
+    distortion_coefficients.release();
+    return false;
+  }
+  return true;
+}
@@ -8,22 +8,84 @@
 #ifndef _CALIBRATION_H_
 #define _CALIBRATION_H_
 #include <iostream>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
 #include <opencv2/imgcodecs.hpp>
 #include <opencv2/imgproc.hpp>
 #include <opencv2/calib3d.hpp>
 
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+
 #include "Configuration.h"
+#include "FrameSource.h"
+#include "StageController.h"
 
 
+// Recalibration expects the chessboard mounted on the stage, centered on the
+// point the stage positions. The stage is driven through a grid and a view is
+// taken at each position once the corners found in two consecutive frames
+// agree, since a move is acknowledged before the stage stops, while worker
+// threads refine the corners of the views already captured. The views fit
+// the lens distortion and the board centers fit the image to stage
+// homography.
 class Calibration
 {
 public:
   Calibration();
 
-  void recalibrate();
+  void recalibrate(FrameSource & frame_source,
+                   StageController & stage_controller);
 
 private:
   Configuration configuration_;
+
+  static const int PATTERN_COUNT_COL = 6;
+  static const int PATTERN_COUNT_ROW = 8;
+  static const int STAGE_GRID_COUNT = 5;
+  static const long STAGE_POSITION_MIN = 15000;
+  static const long STAGE_POSITION_MAX = 85000;
+  static const long STAGE_HOMED_POLL_DURATION = 100;
+  // frames the camera may have buffered before the move
+  static const int STALE_FRAME_COUNT = 2;
+  static const int GRAB_ATTEMPTS_MAX = 10;
+  // the stage has stopped once no corner moves further than this, in
+  // pixels, between consecutive frames
+  static const double SETTLE_CORNER_DISTANCE_MAX = 1.0;
+  // frames checked at a position before giving up on its view
+  static const int SETTLE_FRAME_COUNT_MAX = 30;
+  static const size_t VIEW_COUNT_MIN = 8;
+  static const double RANSAC_STAGE_THRESHOLD = 500;
+  static const double RANSAC_IMAGE_THRESHOLD = 3;
+  static const double CAMERA_MODEL_RMS_MAX = 1.0;
+
+  struct View
+  {
+    cv::Mat image;
+    cv::Point2d stage_point;
+    std::vector<cv::Point2f> corners;
+    bool found;
+  };
+  std::vector<View> views_;
+
+  boost::mutex view_mutex_;
+  boost::condition_variable view_condition_;
+  size_t captured_count_;
+  size_t next_view_index_;
+  bool capture_finished_;
+
+  void homeStage(StageController & stage_controller);
+  void captureViews(FrameSource & frame_source,
+                    StageController & stage_controller);
+  void grabImage(FrameSource & frame_source,
+                 cv::Mat & image);
+  static bool cornersAgree(const std::vector<cv::Point2f> & corners,
+                           const std::vector<cv::Point2f> & corners_prev);
+  void refineCorners();
+  bool fitCameraModel(const cv::Size & image_size,
+                      cv::Mat & camera_matrix,
+                      cv::Mat & distortion_coefficients);
 };
 
 #endif
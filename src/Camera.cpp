@@ -33,6 +33,16 @@ Camera::Camera()
 
   gpu_enabled_ = false;
   image_data_ptr_ = NULL;
+  direct_retrieve_ = true;
+  buffer_count_ = 1;
+
+  embedded_frame_counter_ = false;
+  embedded_byte_count_ = 0;
+  frame_count_ = 0;
+  embedded_frame_counter_prev_ = 0;
+  timestamp_seconds_ = 0;
+  cycle_seconds_prev_ = 0;
+  frame_counter_started_ = false;
 }
 
 Camera::~Camera()
@@ -115,6 +125,16 @@ void Camera::enableGpu()
   gpu_enabled_ = true;
 }
 
+void Camera::setDirectRetrieve(const bool direct_retrieve)
+{
+  direct_retrieve_ = direct_retrieve;
+}
+
+void Camera::setBufferCount(const size_t buffer_count)
+{
+  buffer_count_ = buffer_count;
+}
+
 void Camera::allocateMemory()
 {
   FlyCapture2::Image image;
@@ -137,6 +157,8 @@ void Camera::allocateMemory()
   // image_data_ptr_ = (unsigned char *)malloc(image_data_size_);
   cudaMallocManaged((void**)&image_data_ptr_,image_data_size_);
   std::cout << "image_data_ptr_: " << (long)image_data_ptr_ << std::endl;
+  // user buffers are not registered for the frame pool, the driver fills
+  // them in turn whether or not a frame is still referenced
   // error_ = camera_.SetUserBuffers(image_data_ptr_,image_data_size_,buffer_count_);
   // if (error())
   // {
@@ -167,43 +189,24 @@ unsigned int Camera::getImageDataSize()
   return image_data_size_;
 }
 
-void Camera::grabImage(cv::Mat & image)
+double Camera::getFrameRate()
 {
-  // error_ = camera_.RetrieveBuffer(&unified_image_);
-  // if (error())
-  // {
-  // }
-  error_ = camera_.RetrieveBuffer(&retrieved_camera_image_);
-  if (error())
+  return config_.frame_rate;
+}
+
+bool Camera::grabImage(cv::Mat & image)
+{
+  // RetrieveBuffer can only copy straight into the caller's buffer when the
+  // buffer has exactly the camera image layout
+  if (direct_retrieve_ &&
+      image.isContinuous() &&
+      (image.size() == image_size_) &&
+      (image.type() == image_type_) &&
+      (stride_ == (unsigned int)image.step))
   {
+    return retrieveImageDirect(image);
   }
-  // is there a way to eliminate this copy??
-  retrieved_image_ = cv::Mat(image_size_,CV_8UC1,retrieved_camera_image_.GetData(),stride_);
-  retrieved_image_.copyTo(unified_image_);
-
-  image = unified_image_;
-  // error_ = unified_image_.DeepCopy(&retrieved_image_);
-  // if (error())
-  // {
-  // }
-  // error_ = unified_image_.Convert(FlyCapture2::PIXEL_FORMAT_BGR, &rgb_image_);
-  // if (error())
-  // {
-  // }
-  // size_t row_bytes = (double)rgb_image_.GetReceivedDataSize()/(double)rgb_image_.GetRows();
-  // cv::Mat rgb_cv = cv::Mat(rgb_image_.GetRows(), rgb_image_.GetCols(), CV_8UC3, rgb_image_.GetData(),row_bytes);
-  // cv::cvtColor(rgb_cv, image, CV_BGR2GRAY);
-
-  // if (pixel_format_ == FlyCapture2::PIXEL_FORMAT_RAW8)
-  // {
-    // image = cv::Mat(image_size_,CV_8UC1,unified_image_.GetData(),stride_);
-  // }
-
-  // std::cout << "image_data_ptr_: " << (long)image_data_ptr_ << std::endl;
-  // std::cout << "retrieved_image_.data: " << (long)retrieved_image_.data << std::endl;
-  // std::cout << "unified_image_.data: " << (long)unified_image_.data << std::endl;
-  // std::cout << "image.data: " << (long)image.data << std::endl;
-  // image = cv::Mat(rows_,cols_,CV_8UC1,image_data_ptr_,stride_);
+  return retrieveImageAndCopy(image);
 }
 
 void Camera::stop()
@@ -256,19 +259,26 @@ void Camera::reconfigure()
   {
   }
 
-  // buffer mode
-  // camera_config.numBuffers = buffer_count_;
-  // camera_config.grabMode = FlyCapture2::BUFFER_FRAMES;
-  // camera_config.highPerformanceRetrieveBuffer = true;
-
-  // stream mode
-  camera_config.grabMode = FlyCapture2::DROP_FRAMES;
+  if (buffer_count_ > 1)
+  {
+    // buffer mode
+    camera_config.numBuffers = buffer_count_;
+    camera_config.grabMode = FlyCapture2::BUFFER_FRAMES;
+    camera_config.highPerformanceRetrieveBuffer = true;
+  }
+  else
+  {
+    // stream mode
+    camera_config.grabMode = FlyCapture2::DROP_FRAMES;
+  }
 
   error_ = camera_.SetConfiguration(&camera_config);
   if (error())
   {
   }
 
+  enableEmbeddedImageInfo();
+
   // Set frame rate
   setProperty(FlyCapture2::FRAME_RATE, false, config_.frame_rate);
 
@@ -312,6 +322,142 @@ void Camera::printError()
   error_.PrintErrorTrace();
 }
 
+bool Camera::retrieveImageDirect(cv::Mat & image)
+{
+  // the SDK still copies the frame out of its driver buffer, but into the
+  // caller's buffer instead of an intermediate image that is copied again
+  FlyCapture2::Image retrieved_camera_image(rows_,
+                                            cols_,
+                                            stride_,
+                                            image.data,
+                                            image_data_size_,
+                                            pixel_format_);
+  error_ = camera_.RetrieveBuffer(&retrieved_camera_image);
+  if (error())
+  {
+    return false;
+  }
+  saveImageInfo(retrieved_camera_image);
+  maskEmbeddedImageInfo(image);
+  return true;
+}
+
+bool Camera::retrieveImageAndCopy(cv::Mat & image)
+{
+  error_ = camera_.RetrieveBuffer(&retrieved_camera_image_);
+  if (error())
+  {
+    return false;
+  }
+  saveImageInfo(retrieved_camera_image_);
+  retrieved_image_ = cv::Mat(image_size_,image_type_,retrieved_camera_image_.GetData(),stride_);
+  retrieved_image_.copyTo(image);
+  maskEmbeddedImageInfo(image);
+  return true;
+}
+
+void Camera::saveImageInfo(const FlyCapture2::Image & image)
+{
+  metadata_ = image.GetMetadata();
+  timestamp_ = image.GetTimeStamp();
+}
+
+void Camera::maskEmbeddedImageInfo(cv::Mat & image)
+{
+  // cover the embedded values with the pixels just below them, so they are
+  // never seen as a foreground blob or recorded as image data
+  int pixel_count = (embedded_byte_count_ + image.elemSize() - 1)/image.elemSize();
+  pixel_count = std::min(pixel_count,image.cols);
+  if ((pixel_count == 0) || (image.rows < 2))
+  {
+    return;
+  }
+  image.row(1).colRange(0,pixel_count).copyTo(image.row(0).colRange(0,pixel_count));
+}
+
+void Camera::readFrameCounter(unsigned long & frame_count, double & timestamp)
+{
+  // both the embedded counter and the cycle timer wrap, so accumulate deltas
+  double cycle_time = timestamp_.cycleCount/(double)CYCLE_COUNT_MAX +
+    timestamp_.cycleOffset/((double)CYCLE_COUNT_MAX*CYCLE_OFFSET_MAX);
+  if (!frame_counter_started_)
+  {
+    frame_count_ = 0;
+    timestamp_seconds_ = timestamp_.cycleSeconds + cycle_time;
+    frame_counter_started_ = true;
+  }
+  else
+  {
+    unsigned int cycle_seconds_delta = (timestamp_.cycleSeconds + CYCLE_SECONDS_MAX - cycle_seconds_prev_) % CYCLE_SECONDS_MAX;
+    timestamp_seconds_ = (unsigned long)timestamp_seconds_ + cycle_seconds_delta + cycle_time;
+
+    if (embedded_frame_counter_)
+    {
+      unsigned int frame_counter_delta = metadata_.embeddedFrameCounter - embedded_frame_counter_prev_;
+      frame_count_ += frame_counter_delta;
+    }
+    else
+    {
+      ++frame_count_;
+    }
+  }
+  embedded_frame_counter_prev_ = metadata_.embeddedFrameCounter;
+  cycle_seconds_prev_ = timestamp_.cycleSeconds;
+
+  frame_count = frame_count_;
+  timestamp = timestamp_seconds_;
+}
+
+void Camera::enableEmbeddedImageInfo()
+{
+  // embedded values overwrite the first pixels of each image, the camera
+  // has no other way to report its frame counter, so they are masked after
+  // every retrieve
+  frame_counter_started_ = false;
+  embedded_byte_count_ = 0;
+  FlyCapture2::EmbeddedImageInfo embedded_info;
+  error_ = camera_.GetEmbeddedImageInfo(&embedded_info);
+  if (error())
+  {
+    return;
+  }
+  embedded_frame_counter_ = embedded_info.frameCounter.available;
+  embedded_info.frameCounter.onOff = embedded_frame_counter_;
+  embedded_info.timestamp.onOff = embedded_info.timestamp.available;
+  error_ = camera_.SetEmbeddedImageInfo(&embedded_info);
+  if (error())
+  {
+    embedded_frame_counter_ = false;
+    // mask whatever the camera was already embedding
+    error_ = camera_.GetEmbeddedImageInfo(&embedded_info);
+    if (error())
+    {
+      return;
+    }
+  }
+  // every embedded value takes 4 bytes, packed from the first pixel
+  FlyCapture2::EmbeddedImageInfoProperty * properties[] =
+    {
+      &embedded_info.timestamp,
+      &embedded_info.gain,
+      &embedded_info.shutter,
+      &embedded_info.brightness,
+      &embedded_info.exposure,
+      &embedded_info.whiteBalance,
+      &embedded_info.frameCounter,
+      &embedded_info.strobePattern,
+      &embedded_info.GPIOPinState,
+      &embedded_info.ROIPosition,
+    };
+  for (size_t i=0; i<(sizeof(properties)/sizeof(properties[0])); ++i)
+  {
+    if (properties[i]->available && properties[i]->onOff)
+    {
+      embedded_byte_count_ += EMBEDDED_VALUE_SIZE;
+    }
+  }
+}
+
 void Camera::setProperty(const FlyCapture2::PropertyType &type,
                          const bool &auto_set,
                          unsigned int &value_a,
@@ -9,6 +9,7 @@
 #define _CAMERA_H_
 #include <iostream>
 #include <sstream>
+#include <algorithm>
 
 #include <opencv2/imgproc.hpp>
 
@@ -19,8 +20,10 @@
 #include <cuda.h>
 // #endif
 
+#include "FrameSource.h"
 
-class Camera
+
+class Camera : public FrameSource
 {
 public:
   Camera();
@@ -33,12 +36,15 @@ public:
   void printCameraInfo();
   void start();
   void enableGpu();
+  void setDirectRetrieve(const bool direct_retrieve);
+  void setBufferCount(const size_t buffer_count);
   void allocateMemory();
   unsigned char * getImageDataPointer();
   cv::Size getImageSize();
   int getImageType();
   unsigned int getImageDataSize();
-  void grabImage(cv::Mat & image);
+  double getFrameRate();
+  bool grabImage(cv::Mat & image);
   void stop();
   void disconnect();
   float getCameraTemperature();
@@ -53,12 +59,27 @@ private:
   FlyCapture2::PGRGuid guid_;
   FlyCapture2::Camera camera_;
   FlyCapture2::CameraInfo camera_info_;
-  static const size_t buffer_count_ = 1;
+  size_t buffer_count_;
   static const size_t usb3_packet_size_ = 1024;
+  static const unsigned int CYCLE_SECONDS_MAX = 128;
+  static const unsigned int CYCLE_COUNT_MAX = 8000;
+  static const unsigned int CYCLE_OFFSET_MAX = 3072;
   unsigned int image_buffer_size_;
   FlyCapture2::Image retrieved_camera_image_;
   cv::Mat retrieved_image_;
   cv::Mat unified_image_;
+  bool direct_retrieve_;
+
+  bool embedded_frame_counter_;
+  static const unsigned int EMBEDDED_VALUE_SIZE = 4;
+  unsigned int embedded_byte_count_;
+  FlyCapture2::ImageMetadata metadata_;
+  FlyCapture2::TimeStamp timestamp_;
+  unsigned long frame_count_;
+  unsigned int embedded_frame_counter_prev_;
+  double timestamp_seconds_;
+  unsigned int cycle_seconds_prev_;
+  bool frame_counter_started_;
 
   bool gpu_enabled_;
   unsigned int rows_;
@@ -90,6 +111,12 @@ private:
 
   bool error();
   void printError();
+  bool retrieveImageDirect(cv::Mat & image);
+  bool retrieveImageAndCopy(cv::Mat & image);
+  void saveImageInfo(const FlyCapture2::Image & image);
+  void maskEmbeddedImageInfo(cv::Mat & image);
+  void readFrameCounter(unsigned long & frame_count, double & timestamp);
+  void enableEmbeddedImageInfo();
   void setProperty(const FlyCapture2::PropertyType &type,
                    const bool &auto_set,
                    unsigned int &value_a,
@@ -0,0 +1,239 @@
+// ----------------------------------------------------------------------------
+// CompressedRecorder.cpp
+//
+//
+// Authors:
+// Peter Polidoro polidorop@janelia.hhmi.org
+// ----------------------------------------------------------------------------
+#include "CompressedRecorder.h"
+
+
+// public
+CompressedRecorder::CompressedRecorder()
+{
+  worker_count_ = 2;
+  policy_ = DROP;
+  encode_params_.push_back(cv::IMWRITE_PNG_COMPRESSION);
+  encode_params_.push_back(PNG_COMPRESSION);
+  for (size_t i=0; i<JOB_COUNT; ++i)
+  {
+    jobs_[i].state = FREE;
+  }
+  queued_count_ = 0;
+  running_ = false;
+  written_count_ = 0;
+  dropped_count_ = 0;
+  blocked_count_ = 0;
+  raw_byte_count_ = 0;
+  encoded_byte_count_ = 0;
+}
+
+CompressedRecorder::~CompressedRecorder()
+{
+  stop();
+}
+
+void CompressedRecorder::setPath(const std::string & path)
+{
+  path_ = path;
+}
+
+bool CompressedRecorder::enabled()
+{
+  return !path_.empty();
+}
+
+void CompressedRecorder::setWorkerCount(const size_t worker_count)
+{
+  worker_count_ = std::max(worker_count,(size_t)1);
+}
+
+void CompressedRecorder::setPolicy(const CompressedRecorder::Policy policy)
+{
+  policy_ = policy;
+}
+
+void CompressedRecorder::start(const cv::Size image_size,
+                               const int image_type)
+{
+  stop();
+
+  stream_.open(path_.c_str(),std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!stream_)
+  {
+    throw std::runtime_error(std::string("Unable to open compressed recording file ") + path_);
+  }
+  FileHeader file_header;
+  file_header.magic = MAGIC;
+  file_header.version = VERSION;
+  file_header.width = image_size.width;
+  file_header.height = image_size.height;
+  file_header.type = image_type;
+  file_header.reserved = 0;
+  stream_.write((const char *)&file_header,sizeof(file_header));
+
+  // a worst case PNG is a little larger than the raw image
+  size_t encoded_size_max = image_size.area()*CV_ELEM_SIZE(image_type) + image_size.height + 1024;
+  for (size_t i=0; i<JOB_COUNT; ++i)
+  {
+    jobs_[i].encoded.reserve(encoded_size_max);
+    jobs_[i].state = FREE;
+  }
+  queued_count_ = 0;
+
+  running_ = true;
+  for (size_t i=0; i<worker_count_; ++i)
+  {
+    worker_threads_.create_thread(boost::bind(&CompressedRecorder::work,this));
+  }
+  writer_thread_ = boost::thread(&CompressedRecorder::write,this);
+}
+
+void CompressedRecorder::stop()
+{
+  if (!writer_thread_.joinable())
+  {
+    return;
+  }
+  running_ = false;
+  worker_wakeup_.notify();
+  worker_threads_.join_all();
+  writer_wakeup_.notify();
+  writer_thread_.join();
+  stream_.close();
+}
+
+void CompressedRecorder::record(const FramePtr & frame_ptr,
+                                const TrackState & track_state)
+{
+  unsigned long queued_count = queued_count_.load(boost::memory_order_relaxed);
+  size_t job_index = queued_count & (JOB_COUNT - 1);
+  Job & job = jobs_[job_index];
+  if (job.state.load(boost::memory_order_acquire) != FREE)
+  {
+    if (policy_ == DROP)
+    {
+      dropped_count_.fetch_add(1,boost::memory_order_relaxed);
+      return;
+    }
+    blocked_count_.fetch_add(1,boost::memory_order_relaxed);
+    while ((job.state.load(boost::memory_order_acquire) != FREE) && running_)
+    {
+      boost::this_thread::yield();
+    }
+  }
+  job.frame_ptr = frame_ptr;
+  job.track_state = track_state;
+  job.state.store(QUEUED,boost::memory_order_release);
+  pending_.push(job_index);
+  queued_count_.store(queued_count + 1,boost::memory_order_release);
+  worker_wakeup_.notify();
+}
+
+unsigned long CompressedRecorder::getWrittenCount()
+{
+  return written_count_.load(boost::memory_order_relaxed);
+}
+
+unsigned long CompressedRecorder::getDroppedCount()
+{
+  return dropped_count_.load(boost::memory_order_relaxed);
+}
+
+unsigned long CompressedRecorder::getBlockedCount()
+{
+  return blocked_count_.load(boost::memory_order_relaxed);
+}
+
+unsigned long long CompressedRecorder::getRawByteCount()
+{
+  return raw_byte_count_.load(boost::memory_order_relaxed);
+}
+
+unsigned long long CompressedRecorder::getEncodedByteCount()
+{
+  return encoded_byte_count_.load(boost::memory_order_relaxed);
+}
+
+// private
+void CompressedRecorder::work()
+{
+  Tracer::setThreadName("encoder");
+  size_t job_index;
+  while (running_)
+  {
+    unsigned long generation = worker_wakeup_.getGeneration();
+    if (pending_.pop(job_index))
+    {
+      encode(jobs_[job_index]);
+      continue;
+    }
+    if (running_)
+    {
+      worker_wakeup_.wait(generation);
+    }
+  }
+  while (pending_.pop(job_index))
+  {
+    encode(jobs_[job_index]);
+  }
+}
+
+void CompressedRecorder::encode(Job & job)
+{
+  TraceSpan trace_span("CompressedRecorder::encode");
+  const Frame & frame = *job.frame_ptr;
+  ChunkHeader & chunk_header = job.chunk_header;
+  chunk_header.frame_id = frame.frame_id;
+  chunk_header.source_frame_count = frame.source_frame_count;
+  chunk_header.source_timestamp = frame.source_timestamp;
+  chunk_header.track_x = job.track_state.position.x;
+  chunk_header.track_y = job.track_state.position.y;
+  chunk_header.found = job.track_state.found;
+  if (!cv::imencode(".png",frame.image,job.encoded,encode_params_))
+  {
+    job.encoded.clear();
+  }
+  chunk_header.encoded_size = job.encoded.size();
+  raw_byte_count_.fetch_add(frame.image.total()*frame.image.elemSize(),boost::memory_order_relaxed);
+  // return the frame to its pool as soon as it is encoded
+  job.frame_ptr.reset();
+  job.state.store(ENCODED,boost::memory_order_release);
+  writer_wakeup_.notify();
+}
+
+void CompressedRecorder::write()
+{
+  Tracer::setThreadName("compressed writer");
+  unsigned long written_count = 0;
+  while (true)
+  {
+    unsigned long generation = writer_wakeup_.getGeneration();
+    // chunks go out in the order frames were handed over
+    Job & job = jobs_[written_count & (JOB_COUNT - 1)];
+    if (job.state.load(boost::memory_order_acquire) == ENCODED)
+    {
+      if (job.encoded.size() > 0)
+      {
+        stream_.write((const char *)&job.chunk_header,sizeof(job.chunk_header));
+        stream_.write((const char *)&job.encoded[0],job.encoded.size());
+        encoded_byte_count_.fetch_add(sizeof(job.chunk_header) + job.encoded.size(),boost::memory_order_relaxed);
+        written_count_.fetch_add(1,boost::memory_order_relaxed);
+      }
+      else
+      {
+        dropped_count_.fetch_add(1,boost::memory_order_relaxed);
+      }
+      job.state.store(FREE,boost::memory_order_release);
+      ++written_count;
+      continue;
+    }
+    // workers have drained every queued frame once they are joined
+    if (!running_ && (written_count == queued_count_.load(boost::memory_order_acquire)))
+    {
+      break;
+    }
+    writer_wakeup_.wait(generation);
+  }
+  stream_.flush();
+}
@@ -0,0 +1,146 @@
+// ----------------------------------------------------------------------------
+// CompressedRecorder.h
+//
+//
+// Authors:
+// Peter Polidoro polidorop@janelia.hhmi.org
+// ----------------------------------------------------------------------------
+#ifndef _COMPRESSED_RECORDER_H_
+#define _COMPRESSED_RECORDER_H_
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <algorithm>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <boost/lockfree/queue.hpp>
+
+#include "Frame.h"
+#include "TrackState.h"
+#include "Tracer.h"
+#include "Wakeup.h"
+
+
+// Records losslessly compressed frames for long sessions. The tracking loop
+// hands frame references to a fixed set of job slots, a pool of worker
+// threads encodes each frame as PNG and a writer thread appends the chunks
+// to the file in frame order. When every slot is busy the tracking loop
+// either drops the frame or waits, as chosen by the policy.
+//
+// file: FileHeader, then per frame a ChunkHeader and encoded_size bytes
+class CompressedRecorder
+{
+public:
+  CompressedRecorder();
+  ~CompressedRecorder();
+
+  struct FileHeader
+  {
+    boost::uint32_t magic;
+    boost::uint32_t version;
+    boost::int32_t width;
+    boost::int32_t height;
+    boost::int32_t type;
+    boost::uint32_t reserved;
+  };
+
+  struct ChunkHeader
+  {
+    boost::uint64_t frame_id;
+    boost::uint64_t source_frame_count;
+    // seconds, from the frame source clock
+    double source_timestamp;
+    double track_x;
+    double track_y;
+    boost::uint32_t found;
+    boost::uint32_t encoded_size;
+  };
+
+  static const boost::uint32_t MAGIC = 0x5a465243;
+  static const boost::uint32_t VERSION = 1;
+  // power of two, frames the recorder may hold at once, the frame pool
+  // needs this many extra frames
+  static const size_t JOB_COUNT = 16;
+
+  enum Policy
+  {
+    DROP,
+    BLOCK,
+  };
+
+  void setPath(const std::string & path);
+  bool enabled();
+  void setWorkerCount(const size_t worker_count);
+  void setPolicy(const Policy policy);
+  void start(const cv::Size image_size,
+             const int image_type);
+  // waits for every queued frame to be written
+  void stop();
+
+  // tracking thread
+  void record(const FramePtr & frame_ptr,
+              const TrackState & track_state);
+
+  unsigned long getWrittenCount();
+  unsigned long getDroppedCount();
+  unsigned long getBlockedCount();
+  unsigned long long getRawByteCount();
+  unsigned long long getEncodedByteCount();
+
+private:
+  static const int PNG_COMPRESSION = 1;
+
+  enum JobState
+  {
+    FREE,
+    QUEUED,
+    ENCODED,
+  };
+
+  struct Job
+  {
+    FramePtr frame_ptr;
+    TrackState track_state;
+    ChunkHeader chunk_header;
+    std::vector<unsigned char> encoded;
+    boost::atomic<int> state;
+  };
+
+  std::string path_;
+  size_t worker_count_;
+  Policy policy_;
+  std::vector<int> encode_params_;
+
+  Job jobs_[JOB_COUNT];
+  boost::lockfree::queue<size_t,boost::lockfree::capacity<JOB_COUNT> > pending_;
+  // frames handed over, written by the tracking thread only
+  boost::atomic<unsigned long> queued_count_;
+  boost::atomic<bool> running_;
+
+  boost::atomic<unsigned long> written_count_;
+  boost::atomic<unsigned long> dropped_count_;
+  boost::atomic<unsigned long> blocked_count_;
+  boost::atomic<unsigned long long> raw_byte_count_;
+  boost::atomic<unsigned long long> encoded_byte_count_;
+
+  std::ofstream stream_;
+
+  boost::thread_group worker_threads_;
+  boost::thread writer_thread_;
+  Wakeup worker_wakeup_;
+  Wakeup writer_wakeup_;
+
+  void work();
+  void encode(Job & job);
+  void write();
+};
+
+#endif
@@ -63,6 +63,66 @@ void Configuration::readHomographyImageToStage(cv::Mat & homography_image_to_sta
   }
 }
 
+bool Configuration::readCameraModel(cv::Mat & camera_matrix,
+                                    cv::Mat & distortion_coefficients,
+                                    cv::Size & image_size)
+{
+  if (!checkCalibrationPath())
+  {
+    return false;
+  }
+  cv::FileStorage calibration_fs(calibration_path_.string(), cv::FileStorage::READ);
+  if (calibration_fs["camera_matrix"].empty())
+  {
+    calibration_fs.release();
+    return false;
+  }
+  calibration_fs["camera_matrix"] >> camera_matrix;
+  calibration_fs["distortion_coefficients"] >> distortion_coefficients;
+  calibration_fs["image_width"] >> image_size.width;
+  calibration_fs["image_height"] >> image_size.height;
+  calibration_fs.release();
+
+  if ((camera_matrix.rows != 3) || (camera_matrix.cols != 3))
+  {
+    std::cout << "camera_matrix is not a 3x3 matrix." << std::endl;
+    return false;
+  }
+  if (distortion_coefficients.empty() || (image_size.width <= 0) || (image_size.height <= 0))
+  {
+    std::cout << "camera model is missing distortion_coefficients or image size." << std::endl;
+    return false;
+  }
+  std::cout << std::endl << "camera_matrix = " << std::endl << camera_matrix << std::endl;
+  std::cout << std::endl << "distortion_coefficients = " << std::endl << distortion_coefficients << std::endl;
+  return true;
+}
+
+void Configuration::writeCalibration(const cv::Mat & homography_image_to_stage,
+                                     const cv::Mat & homography_stage_to_image,
+                                     const cv::Mat & camera_matrix,
+                                     const cv::Mat & distortion_coefficients,
+                                     const cv::Size & image_size)
+{
+  boost::filesystem::create_directories(calibration_path_.parent_path());
+  cv::FileStorage calibration_fs(calibration_path_.string(), cv::FileStorage::WRITE);
+  if (!calibration_fs.isOpened())
+  {
+    throw std::runtime_error("Unable to write calibration file.");
+  }
+  calibration_fs << "homography_image_to_stage" << homography_image_to_stage;
+  calibration_fs << "homography_stage_to_image" << homography_stage_to_image;
+  if (!camera_matrix.empty())
+  {
+    calibration_fs << "camera_matrix" << camera_matrix;
+    calibration_fs << "distortion_coefficients" << distortion_coefficients;
+    calibration_fs << "image_width" << image_size.width;
+    calibration_fs << "image_height" << image_size.height;
+  }
+  calibration_fs.release();
+  std::cout << std::endl << "Wrote calibration: " << calibration_path_ << std::endl;
+}
+
 // private
 bool Configuration::checkConfigurationRepositoryPath(boost::filesystem::path path)
 {
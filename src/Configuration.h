@@ -8,6 +8,7 @@
 #ifndef _CONFIGURATION_H_
 #define _CONFIGURATION_H_
 #include <iostream>
+#include <stdexcept>
 #include <opencv2/core.hpp>
 #include <boost/filesystem.hpp>
 
@@ -21,6 +22,16 @@ public:
 
   bool checkCalibrationPath();
   void readHomographyImageToStage(cv::Mat & homography_image_to_stage);
+  // optional, when present the homography maps undistorted image points
+  bool readCameraModel(cv::Mat & camera_matrix,
+                       cv::Mat & distortion_coefficients,
+                       cv::Size & image_size);
+  // the camera model is left out when camera_matrix is empty
+  void writeCalibration(const cv::Mat & homography_image_to_stage,
+                        const cv::Mat & homography_stage_to_image,
+                        const cv::Mat & camera_matrix,
+                        const cv::Mat & distortion_coefficients,
+                        const cv::Size & image_size);
 
 private:
   static boost::filesystem::path configuration_repository_path_;
@@ -12,24 +12,143 @@
 CoordinateConverter::CoordinateConverter()
 {
   homography_image_to_stage_set_ = false;
+  remap_table_cols_ = 0;
+  remap_table_rows_ = 0;
+  remap_table_set_ = false;
 }
 
 void CoordinateConverter::updateHomographyImageToStage()
 {
+  homography_image_to_stage_set_ = false;
+  remap_table_set_ = false;
+
   configuration_.readHomographyImageToStage(homography_image_to_stage_);
+  if ((homography_image_to_stage_.rows != 3) || (homography_image_to_stage_.cols != 3))
+  {
+    return;
+  }
+  cv::Mat homography;
+  homography_image_to_stage_.convertTo(homography,CV_64F);
+  for (int i=0; i<9; ++i)
+  {
+    h_[i] = homography.at<double>(i/3,i%3);
+  }
   homography_image_to_stage_set_ = true;
+
+  cv::Mat camera_matrix;
+  cv::Mat distortion_coefficients;
+  cv::Size image_size;
+  if (configuration_.readCameraModel(camera_matrix,distortion_coefficients,image_size))
+  {
+    updateRemapTable(camera_matrix,distortion_coefficients,image_size);
+  }
 }
 
-void CoordinateConverter::convertImagePointToStagePoint(cv::Point & image_point, cv::Point & stage_point)
+void CoordinateConverter::convertImagePointToStagePoint(const cv::Point2d & image_point, cv::Point2d & stage_point)
 {
+  TraceSpan trace_span("CoordinateConverter::convert");
   if (homography_image_to_stage_set_)
   {
-    std::vector<cv::Point2f> image_points;
-    image_points.push_back(image_point);
-    std::vector<cv::Point2f> stage_points;
-    cv::perspectiveTransform(image_points,stage_points,homography_image_to_stage_);
-    stage_point = stage_points[0];
+    convert(image_point,stage_point);
+  }
+}
+
+void CoordinateConverter::convertImagePointsToStagePoints(const std::vector<cv::Point2d> & image_points,
+                                                          std::vector<cv::Point2d> & stage_points)
+{
+  stage_points.resize(image_points.size());
+  if (!homography_image_to_stage_set_)
+  {
+    return;
+  }
+  for (size_t i=0; i<image_points.size(); ++i)
+  {
+    convert(image_points[i],stage_points[i]);
   }
 }
 
 // private
+void CoordinateConverter::updateRemapTable(const cv::Mat & camera_matrix,
+                                           const cv::Mat & distortion_coefficients,
+                                           const cv::Size & image_size)
+{
+  // one extra node past the image edge so every pixel has four neighbors
+  remap_table_cols_ = image_size.width/REMAP_TABLE_STEP + 2;
+  remap_table_rows_ = image_size.height/REMAP_TABLE_STEP + 2;
+
+  std::vector<cv::Point2d> distorted_points;
+  distorted_points.reserve(remap_table_cols_*remap_table_rows_);
+  for (int row=0; row<remap_table_rows_; ++row)
+  {
+    for (int col=0; col<remap_table_cols_; ++col)
+    {
+      distorted_points.push_back(cv::Point2d(col*REMAP_TABLE_STEP,row*REMAP_TABLE_STEP));
+    }
+  }
+
+  // reproject with the same camera matrix so undistorted points stay in pixels
+  std::vector<cv::Point2d> undistorted_points;
+  cv::undistortPoints(distorted_points,
+                      undistorted_points,
+                      camera_matrix,
+                      distortion_coefficients,
+                      cv::noArray(),
+                      camera_matrix);
+
+  remap_table_.resize(undistorted_points.size());
+  for (size_t i=0; i<undistorted_points.size(); ++i)
+  {
+    transform(undistorted_points[i],remap_table_[i]);
+  }
+  remap_table_set_ = true;
+
+  std::cout << std::endl << "remap table: " << remap_table_cols_ << "x" << remap_table_rows_;
+  std::cout << " nodes, step " << REMAP_TABLE_STEP << " pixels" << std::endl;
+}
+
+void CoordinateConverter::convert(const cv::Point2d & image_point, cv::Point2d & stage_point)
+{
+  if (remap_table_set_)
+  {
+    lookUp(image_point,stage_point);
+  }
+  else
+  {
+    transform(image_point,stage_point);
+  }
+}
+
+void CoordinateConverter::transform(const cv::Point2d & image_point, cv::Point2d & stage_point)
+{
+  // same as perspectiveTransform, points at infinity map to the origin
+  double x = image_point.x;
+  double y = image_point.y;
+  double w = h_[6]*x + h_[7]*y + h_[8];
+  w = (fabs(w) > DBL_EPSILON) ? 1.0/w : 0.0;
+  stage_point.x = (h_[0]*x + h_[1]*y + h_[2])*w;
+  stage_point.y = (h_[3]*x + h_[4]*y + h_[5])*w;
+}
+
+void CoordinateConverter::lookUp(const cv::Point2d & image_point, cv::Point2d & stage_point)
+{
+  // points off the table extrapolate from the nearest edge cell
+  double x = image_point.x/REMAP_TABLE_STEP;
+  double y = image_point.y/REMAP_TABLE_STEP;
+  int col = std::min(std::max((int)floor(x),0),remap_table_cols_ - 2);
+  int row = std::min(std::max((int)floor(y),0),remap_table_rows_ - 2);
+  double fx = x - col;
+  double fy = y - row;
+
+  const cv::Point2d * node_ptr = &remap_table_[row*remap_table_cols_ + col];
+  const cv::Point2d & p00 = node_ptr[0];
+  const cv::Point2d & p01 = node_ptr[1];
+  const cv::Point2d & p10 = node_ptr[remap_table_cols_];
+  const cv::Point2d & p11 = node_ptr[remap_table_cols_ + 1];
+
+  double top_x = p00.x + fx*(p01.x - p00.x);
+  double top_y = p00.y + fx*(p01.y - p00.y);
+  double bottom_x = p10.x + fx*(p11.x - p10.x);
+  double bottom_y = p10.y + fx*(p11.y - p10.y);
+  stage_point.x = top_x + fy*(bottom_x - top_x);
+  stage_point.y = top_y + fy*(bottom_y - top_y);
+}
@@ -8,9 +8,15 @@
 #ifndef _COORDINATE_CONVERTER_H_
 #define _COORDINATE_CONVERTER_H_
 #include <iostream>
+#include <vector>
+#include <cfloat>
+#include <cmath>
+#include <algorithm>
 #include <opencv2/core.hpp>
+#include <opencv2/calib3d.hpp>
 
 #include "Configuration.h"
+#include "Tracer.h"
 
 
 class CoordinateConverter
@@ -19,12 +25,32 @@ public:
   CoordinateConverter();
 
   void updateHomographyImageToStage();
-  void convertImagePointToStagePoint(cv::Point & image_point, cv::Point & stage_point);
+  void convertImagePointToStagePoint(const cv::Point2d & image_point, cv::Point2d & stage_point);
+  // for offline reprocessing, stage_points is resized to match
+  void convertImagePointsToStagePoints(const std::vector<cv::Point2d> & image_points,
+                                       std::vector<cv::Point2d> & stage_points);
 
 private:
   Configuration configuration_;
   cv::Mat homography_image_to_stage_;
   bool homography_image_to_stage_set_;
+  // row major homography, cached so a conversion is a few multiply adds
+  double h_[9];
+
+  // stage points for a grid of distorted image points, so undistorting and
+  // projecting the tracked point is one bilinear lookup
+  static const int REMAP_TABLE_STEP = 8;
+  std::vector<cv::Point2d> remap_table_;
+  int remap_table_cols_;
+  int remap_table_rows_;
+  bool remap_table_set_;
+
+  void updateRemapTable(const cv::Mat & camera_matrix,
+                        const cv::Mat & distortion_coefficients,
+                        const cv::Size & image_size);
+  void convert(const cv::Point2d & image_point, cv::Point2d & stage_point);
+  void transform(const cv::Point2d & image_point, cv::Point2d & stage_point);
+  void lookUp(const cv::Point2d & image_point, cv::Point2d & stage_point);
 };
 
 #endif
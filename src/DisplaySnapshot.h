@@ -0,0 +1,28 @@
+// ----------------------------------------------------------------------------
+// DisplaySnapshot.h
+//
+//
+// Authors:
+// Peter Polidoro polidorop@janelia.hhmi.org
+// ----------------------------------------------------------------------------
+#ifndef _DISPLAY_SNAPSHOT_H_
+#define _DISPLAY_SNAPSHOT_H_
+#include <opencv2/core.hpp>
+
+#include "TrackState.h"
+
+
+// What the tracking thread last saw, copied only when the display asks
+struct DisplaySnapshot
+{
+  cv::Mat image;
+  cv::Mat background;
+  // images the tracker had processed when the snapshot was taken
+  unsigned long image_count;
+  TrackState track_state;
+  // empty when searching the full frame
+  cv::Rect tracking_window;
+  double frame_rate;
+};
+
+#endif
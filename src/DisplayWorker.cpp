@@ -0,0 +1,268 @@
+// ----------------------------------------------------------------------------
+// DisplayWorker.cpp
+//
+//
+// Authors:
+// Peter Polidoro polidorop@janelia.hhmi.org
+// ----------------------------------------------------------------------------
+#include "DisplayWorker.h"
+
+
+// public
+DisplayWorker::DisplayWorker()
+{
+  blob_ = true;
+  windows_ = true;
+  threshold_value_max_ = 0;
+  trackbar_value_ = 0;
+  threshold_value_ = 0;
+  snapshot_wanted_ = false;
+  running_ = false;
+
+  blue_ = cv::Scalar(255,0,0);
+  yellow_ = cv::Scalar(0,255,255);
+  green_ = cv::Scalar(0,255,0);
+  red_ = cv::Scalar(0,0,255);
+
+  frame_rate_display_position_ = cv::Point(50,50);
+}
+
+DisplayWorker::~DisplayWorker()
+{
+  stop();
+}
+
+void DisplayWorker::setWindows(const bool windows)
+{
+  windows_ = windows;
+}
+
+void DisplayWorker::setPreviewName(const std::string & preview_name)
+{
+  preview_publisher_.setName(preview_name);
+}
+
+void DisplayWorker::start(const bool blob,
+                          const int threshold_value,
+                          const int threshold_value_max)
+{
+  stop();
+
+  blob_ = blob;
+  threshold_value_max_ = threshold_value_max;
+  trackbar_value_ = threshold_value;
+  threshold_value_ = threshold_value;
+
+  snapshot_wanted_ = true;
+  running_ = true;
+  thread_ = boost::thread(&DisplayWorker::work,this);
+  lowerPriority();
+}
+
+void DisplayWorker::stop()
+{
+  if (!thread_.joinable())
+  {
+    return;
+  }
+  running_ = false;
+  thread_.join();
+}
+
+bool DisplayWorker::snapshotWanted()
+{
+  return snapshot_wanted_.load(boost::memory_order_relaxed);
+}
+
+DisplaySnapshot & DisplayWorker::getSnapshotBuffer()
+{
+  return snapshot_mailbox_.getWriteBuffer();
+}
+
+void DisplayWorker::publishSnapshot()
+{
+  snapshot_wanted_ = false;
+  snapshot_mailbox_.publish();
+}
+
+bool DisplayWorker::getClickedPoint(cv::Point2d & clicked_point)
+{
+  if (!click_mailbox_.update())
+  {
+    return false;
+  }
+  clicked_point = click_mailbox_.getReadBuffer();
+  return true;
+}
+
+int DisplayWorker::getThresholdValue()
+{
+  return threshold_value_.load(boost::memory_order_relaxed);
+}
+
+// private
+void DisplayWorker::work()
+{
+  Tracer::setThreadName("display");
+  // HighGUI calls all stay on this thread
+  if (windows_)
+  {
+    createWindows();
+  }
+  while (running_)
+  {
+    if (snapshot_mailbox_.update())
+    {
+      const DisplaySnapshot & snapshot = snapshot_mailbox_.getReadBuffer();
+      updateThreshold(snapshot);
+      if (windows_)
+      {
+        render(snapshot);
+      }
+      preview_publisher_.publish(snapshot,threshold_);
+      snapshot_wanted_ = true;
+    }
+    if (windows_)
+    {
+      // handles window events and paces the UI
+      cv::waitKey(UI_PERIOD);
+    }
+    else
+    {
+      boost::this_thread::sleep(boost::posix_time::milliseconds(UI_PERIOD));
+    }
+  }
+  if (windows_)
+  {
+    cv::destroyAllWindows();
+  }
+  preview_publisher_.close();
+}
+
+void DisplayWorker::lowerPriority()
+{
+  // only runs when a core would otherwise be idle
+  sched_param param;
+  param.sched_priority = 0;
+  if (pthread_setschedparam(thread_.native_handle(),SCHED_IDLE,&param) != 0)
+  {
+    std::cerr << "Unable to lower display thread priority." << std::endl;
+  }
+}
+
+void DisplayWorker::createWindows()
+{
+  cv::namedWindow("Image",cv::WINDOW_NORMAL);
+
+  if (blob_)
+  {
+    cv::namedWindow("Background",cv::WINDOW_NORMAL);
+    cv::namedWindow("Foreground",cv::WINDOW_NORMAL);
+    cv::namedWindow("Threshold",cv::WINDOW_NORMAL);
+    cv::createTrackbar("threshold_value",
+                       "Threshold",
+                       &trackbar_value_,
+                       threshold_value_max_,
+                       trackbarThresholdHandler,
+                       this);
+  }
+  else
+  {
+    cv::setMouseCallback("Image",mouseClickHandler,this);
+  }
+}
+
+void DisplayWorker::updateThreshold(const DisplaySnapshot & snapshot)
+{
+  // the tracking thread never makes these, so they cost nothing there
+  if (!blob_ || snapshot.background.empty())
+  {
+    return;
+  }
+  cv::subtract(snapshot.background,snapshot.image,foreground_);
+  cv::threshold(foreground_,threshold_,getThresholdValue(),threshold_value_max_,cv::THRESH_BINARY);
+}
+
+void DisplayWorker::render(const DisplaySnapshot & snapshot)
+{
+  TraceSpan trace_span("DisplayWorker::render");
+  if (snapshot.image.empty())
+  {
+    return;
+  }
+  cv::cvtColor(snapshot.image,display_image_,cv::COLOR_GRAY2BGR);
+
+  if (snapshot.tracking_window.area() > 0)
+  {
+    cv::rectangle(display_image_,
+                  snapshot.tracking_window,
+                  green_,
+                  DISPLAY_MARKER_THICKNESS);
+  }
+
+  const TrackState & track_state = snapshot.track_state;
+  cv::Point tracked_image_point(cvRound(track_state.position.x),cvRound(track_state.position.y));
+  cv::circle(display_image_,
+             tracked_image_point,
+             DISPLAY_MARKER_RADIUS,
+             red_,
+             DISPLAY_MARKER_THICKNESS);
+  if (blob_ && track_state.found)
+  {
+    cv::Point orientation_offset(cvRound(DISPLAY_ORIENTATION_LENGTH*cos(track_state.orientation)),
+                                 cvRound(DISPLAY_ORIENTATION_LENGTH*sin(track_state.orientation)));
+    cv::line(display_image_,
+             tracked_image_point - orientation_offset,
+             tracked_image_point + orientation_offset,
+             yellow_,
+             DISPLAY_MARKER_THICKNESS);
+  }
+
+  std::stringstream frame_rate_ss;
+  frame_rate_ss << snapshot.frame_rate;
+  std::string frame_rate_string = std::string("Frame rate: ") + std::string(frame_rate_ss.str());
+  cv::putText(display_image_,
+              frame_rate_string,
+              frame_rate_display_position_,
+              cv::FONT_HERSHEY_SIMPLEX,
+              1,
+              yellow_,
+              4);
+
+  showImageInWindow("Image",display_image_);
+
+  if (!blob_)
+  {
+    return;
+  }
+  showImageInWindow("Background",snapshot.background);
+  showImageInWindow("Foreground",foreground_);
+  showImageInWindow("Threshold",threshold_);
+}
+
+void DisplayWorker::showImageInWindow(const cv::String & winname, const cv::Mat & mat)
+{
+  if ((mat.cols != 0) && (mat.rows != 0))
+  {
+    cv::imshow(winname,mat);
+  }
+}
+
+void DisplayWorker::trackbarThresholdHandler(int value, void * userdata)
+{
+  DisplayWorker * display_worker_ptr = (DisplayWorker *)userdata;
+  display_worker_ptr->threshold_value_.store(value,boost::memory_order_relaxed);
+}
+
+void DisplayWorker::mouseClickHandler(int event, int x, int y, int flags, void * userdata)
+{
+  if(event != cv::EVENT_LBUTTONDOWN)
+  {
+    return;
+  }
+  DisplayWorker * display_worker_ptr = (DisplayWorker *)userdata;
+  display_worker_ptr->click_mailbox_.getWriteBuffer() = cv::Point2d(x,y);
+  display_worker_ptr->click_mailbox_.publish();
+
+  std::cout << "Clicked point x: " << x << ", y: " << y << std::endl;
+}
@@ -0,0 +1,101 @@
+// ----------------------------------------------------------------------------
+// DisplayWorker.h
+//
+//
+// Authors:
+// Peter Polidoro polidorop@janelia.hhmi.org
+// ----------------------------------------------------------------------------
+#ifndef _DISPLAY_WORKER_H_
+#define _DISPLAY_WORKER_H_
+#include <iostream>
+#include <sstream>
+#include <cmath>
+#include <pthread.h>
+#include <sched.h>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/highgui.hpp>
+
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+
+#include "Mailbox.h"
+#include "TrackState.h"
+#include "DisplaySnapshot.h"
+#include "PreviewPublisher.h"
+#include "Tracer.h"
+
+
+// Runs the HighGUI windows and the shared memory preview on their own low
+// priority thread at a fixed UI rate. The tracking thread hands over
+// snapshots, and picks up clicks and threshold changes, through mailboxes
+// and atomics, so rendering never delays tracking.
+class DisplayWorker
+{
+public:
+  DisplayWorker();
+  ~DisplayWorker();
+
+  void setWindows(const bool windows);
+  // empty for no preview
+  void setPreviewName(const std::string & preview_name);
+
+  // blob shows the background, foreground and threshold windows, otherwise
+  // clicks on the image window are tracked
+  void start(const bool blob,
+             const int threshold_value,
+             const int threshold_value_max);
+  void stop();
+
+  // tracking thread
+  bool snapshotWanted();
+  DisplaySnapshot & getSnapshotBuffer();
+  void publishSnapshot();
+  bool getClickedPoint(cv::Point2d & clicked_point);
+  int getThresholdValue();
+
+private:
+  static const int UI_PERIOD = 33;
+  static const int DISPLAY_MARKER_RADIUS = 10;
+  static const int DISPLAY_MARKER_THICKNESS = 2;
+  static const int DISPLAY_ORIENTATION_LENGTH = 30;
+
+  bool blob_;
+  bool windows_;
+  int threshold_value_max_;
+  // written by HighGUI, only touched on the display thread
+  int trackbar_value_;
+  boost::atomic<int> threshold_value_;
+
+  Mailbox<DisplaySnapshot> snapshot_mailbox_;
+  Mailbox<cv::Point2d> click_mailbox_;
+  boost::atomic<bool> snapshot_wanted_;
+  boost::atomic<bool> running_;
+
+  boost::thread thread_;
+
+  PreviewPublisher preview_publisher_;
+
+  cv::Scalar blue_;
+  cv::Scalar yellow_;
+  cv::Scalar green_;
+  cv::Scalar red_;
+
+  cv::Point frame_rate_display_position_;
+
+  cv::Mat display_image_;
+  cv::Mat foreground_;
+  cv::Mat threshold_;
+
+  void work();
+  void lowerPriority();
+  void createWindows();
+  void updateThreshold(const DisplaySnapshot & snapshot);
+  void render(const DisplaySnapshot & snapshot);
+  void showImageInWindow(const cv::String & winname, const cv::Mat & mat);
+  static void trackbarThresholdHandler(int value, void * userdata);
+  static void mouseClickHandler(int event, int x, int y, int flags, void * userdata);
+};
+
+#endif
@@ -0,0 +1,24 @@
+// ----------------------------------------------------------------------------
+// Frame.cpp
+//
+//
+// Authors:
+// Peter Polidoro polidorop@janelia.hhmi.org
+// ----------------------------------------------------------------------------
+#include "Frame.h"
+#include "FramePool.h"
+
+
+void intrusive_ptr_add_ref(Frame * frame_ptr)
+{
+  frame_ptr->reference_count.fetch_add(1,boost::memory_order_relaxed);
+}
+
+void intrusive_ptr_release(Frame * frame_ptr)
+{
+  if (frame_ptr->reference_count.fetch_sub(1,boost::memory_order_release) == 1)
+  {
+    boost::atomic_thread_fence(boost::memory_order_acquire);
+    frame_ptr->pool_ptr->release(frame_ptr);
+  }
+}
@@ -0,0 +1,46 @@
+// ----------------------------------------------------------------------------
+// Frame.h
+//
+//
+// Authors:
+// Peter Polidoro polidorop@janelia.hhmi.org
+// ----------------------------------------------------------------------------
+#ifndef _FRAME_H_
+#define _FRAME_H_
+#include <opencv2/core.hpp>
+
+#include <boost/atomic.hpp>
+#include <boost/intrusive_ptr.hpp>
+#include <boost/noncopyable.hpp>
+
+
+class FramePool;
+
+// Frames are preallocated by a FramePool and reference counted in place, so
+// handing one between threads never allocates. The last reference returns
+// the frame to its pool.
+struct Frame : private boost::noncopyable
+{
+  // camera frames have the first pixels, where the camera embeds its frame
+  // counter and timestamp, replaced by the pixels just below them
+  cv::Mat image;
+  // sequential id assigned by the capture thread
+  unsigned long frame_id;
+  // host tick count when the frame was retrieved
+  int64 tick_count;
+  // frame counter and timestamp, in seconds, reported by the frame source
+  unsigned long source_frame_count;
+  double source_timestamp;
+  // frames the source produced but never delivered before this one
+  unsigned long skipped_frame_count;
+
+  boost::atomic<int> reference_count;
+  FramePool * pool_ptr;
+};
+
+typedef boost::intrusive_ptr<Frame> FramePtr;
+
+void intrusive_ptr_add_ref(Frame * frame_ptr);
+void intrusive_ptr_release(Frame * frame_ptr);
+
+#endif
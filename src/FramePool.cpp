@@ -0,0 +1,78 @@
+// ----------------------------------------------------------------------------
+// FramePool.cpp
+//
+//
+// Authors:
+// Peter Polidoro polidorop@janelia.hhmi.org
+// ----------------------------------------------------------------------------
+#include "FramePool.h"
+
+
+// public
+FramePool::FramePool()
+{
+  frame_count_ = 0;
+  exhausted_count_ = 0;
+  exhausted_ = false;
+}
+
+void FramePool::allocateMemory(const cv::Size image_size,
+                               const int image_type,
+                               const size_t frame_count)
+{
+  if ((frame_count == 0) || (frame_count > FRAME_COUNT_MAX))
+  {
+    throw std::runtime_error("Frame pool frame count out of range.");
+  }
+  Frame * frame_ptr;
+  while (free_frames_.pop(frame_ptr))
+  {
+  }
+  frame_count_ = frame_count;
+  frames_.reset(new Frame[frame_count_]);
+  for (size_t i=0; i<frame_count_; ++i)
+  {
+    Frame & frame = frames_[i];
+    frame.image = cv::Mat(image_size,image_type);
+    frame.frame_id = 0;
+    frame.tick_count = 0;
+    frame.source_frame_count = 0;
+    frame.source_timestamp = 0;
+    frame.skipped_frame_count = 0;
+    frame.reference_count = 0;
+    frame.pool_ptr = this;
+    free_frames_.bounded_push(&frame);
+  }
+}
+
+FramePtr FramePool::acquire()
+{
+  Frame * frame_ptr;
+  if (!free_frames_.pop(frame_ptr))
+  {
+    // callers retry in a loop, count each stretch once
+    if (!exhausted_.exchange(true,boost::memory_order_relaxed))
+    {
+      exhausted_count_.fetch_add(1,boost::memory_order_relaxed);
+    }
+    return FramePtr();
+  }
+  exhausted_.store(false,boost::memory_order_relaxed);
+  return FramePtr(frame_ptr);
+}
+
+size_t FramePool::getFrameCount()
+{
+  return frame_count_;
+}
+
+unsigned long FramePool::getExhaustedCount()
+{
+  return exhausted_count_.load(boost::memory_order_relaxed);
+}
+
+// private
+void FramePool::release(Frame * frame_ptr)
+{
+  free_frames_.bounded_push(frame_ptr);
+}
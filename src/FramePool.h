@@ -0,0 +1,54 @@
+// ----------------------------------------------------------------------------
+// FramePool.h
+//
+//
+// Authors:
+// Peter Polidoro polidorop@janelia.hhmi.org
+// ----------------------------------------------------------------------------
+#ifndef _FRAME_POOL_H_
+#define _FRAME_POOL_H_
+#include <iostream>
+#include <stdexcept>
+
+#include <opencv2/core.hpp>
+
+#include <boost/atomic.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/lockfree/queue.hpp>
+
+#include "Frame.h"
+
+
+// Fixed set of preallocated frame buffers. Frames may be released from any
+// thread; the free list is lock-free and never allocates.
+class FramePool
+{
+public:
+  FramePool();
+
+  void allocateMemory(const cv::Size image_size,
+                      const int image_type,
+                      const size_t frame_count);
+
+  // returns an empty pointer when every frame is in use
+  FramePtr acquire();
+
+  size_t getFrameCount();
+  // stretches without a free frame, however often acquire is retried
+  unsigned long getExhaustedCount();
+
+private:
+  static const size_t FRAME_COUNT_MAX = 256;
+
+  boost::scoped_array<Frame> frames_;
+  size_t frame_count_;
+  boost::lockfree::queue<Frame *,boost::lockfree::capacity<FRAME_COUNT_MAX> > free_frames_;
+  boost::atomic<unsigned long> exhausted_count_;
+  boost::atomic<bool> exhausted_;
+
+  void release(Frame * frame_ptr);
+
+  friend void intrusive_ptr_release(Frame * frame_ptr);
+};
+
+#endif
@@ -0,0 +1,362 @@
+// ----------------------------------------------------------------------------
+// FrameRecorder.cpp
+//
+//
+// Authors:
+// Peter Polidoro polidorop@janelia.hhmi.org
+// ----------------------------------------------------------------------------
+#include "FrameRecorder.h"
+
+
+// public
+FrameRecorder::FrameRecorder()
+{
+  fd_ = -1;
+  data_ptr_ = NULL;
+  size_ = 0;
+  file_header_ptr_ = NULL;
+  image_type_ = 0;
+  image_data_size_ = 0;
+  slot_count_ = 0;
+  slot_size_ = 0;
+  trigger_requested_ = false;
+  running_ = false;
+  saving_ = false;
+  save_running_ = false;
+  save_progress_ = 0;
+  recorded_count_ = 0;
+  dropped_count_ = 0;
+  saved_count_ = 0;
+  frame_count_ = 0;
+  flushed_frame_count_ = 0;
+  memset(&save_header_,0,sizeof(save_header_));
+  save_first_frame_ = 0;
+  save_frame_count_ = 0;
+}
+
+FrameRecorder::~FrameRecorder()
+{
+  stop();
+  unmap();
+}
+
+void FrameRecorder::setPath(const std::string & path)
+{
+  path_ = path;
+}
+
+bool FrameRecorder::enabled()
+{
+  return !path_.empty();
+}
+
+void FrameRecorder::allocateMemory(const cv::Size image_size,
+                                   const int image_type,
+                                   const size_t slot_count)
+{
+  unmap();
+
+  image_size_ = image_size;
+  image_type_ = image_type;
+  image_data_size_ = image_size.area()*CV_ELEM_SIZE(image_type);
+  slot_count_ = std::max(slot_count,(size_t)1);
+  slot_size_ = align(sizeof(FrameHeader) + image_data_size_);
+  size_ = PAGE_SIZE + slot_count_*slot_size_;
+
+  fd_ = open(path_.c_str(),O_RDWR | O_CREAT | O_TRUNC,0644);
+  if (fd_ < 0)
+  {
+    throw std::runtime_error(std::string("Unable to open recording file ") + path_);
+  }
+  // reserve the blocks now so no write fault has to allocate them
+  if (posix_fallocate(fd_,0,size_) != 0)
+  {
+    unmap();
+    throw std::runtime_error(std::string("Unable to allocate recording file ") + path_);
+  }
+  void * data_ptr = mmap(NULL,size_,PROT_READ | PROT_WRITE,MAP_SHARED | MAP_POPULATE,fd_,0);
+  if (data_ptr == MAP_FAILED)
+  {
+    unmap();
+    throw std::runtime_error(std::string("Unable to map recording file ") + path_);
+  }
+  data_ptr_ = (unsigned char *)data_ptr;
+  madvise(data_ptr_,size_,MADV_SEQUENTIAL);
+
+  file_header_ptr_ = (FileHeader *)data_ptr_;
+  file_header_ptr_->magic = MAGIC;
+  file_header_ptr_->version = VERSION;
+  file_header_ptr_->width = image_size_.width;
+  file_header_ptr_->height = image_size_.height;
+  file_header_ptr_->type = image_type_;
+  file_header_ptr_->slot_count = slot_count_;
+  file_header_ptr_->slot_size = slot_size_;
+  file_header_ptr_->frame_count = 0;
+  frame_count_ = 0;
+  flushed_frame_count_ = 0;
+
+  std::cout << std::endl << "Recording ring: " << path_ << " frames: " << slot_count_;
+  std::cout << " MB: " << (size_ >> 20) << std::endl;
+}
+
+void FrameRecorder::start()
+{
+  stop();
+  if (!data_ptr_)
+  {
+    return;
+  }
+  running_ = true;
+  save_running_ = true;
+  thread_ = boost::thread(&FrameRecorder::work,this);
+  save_thread_ = boost::thread(&FrameRecorder::saveWork,this);
+}
+
+void FrameRecorder::stop()
+{
+  if (!thread_.joinable())
+  {
+    return;
+  }
+  running_ = false;
+  wakeup_.notify();
+  thread_.join();
+  // a save begun before the recorder stopped is still finished
+  save_running_ = false;
+  save_wakeup_.notify();
+  save_thread_.join();
+}
+
+void FrameRecorder::record(const FramePtr & frame_ptr,
+                           const TrackState & track_state)
+{
+  Entry entry;
+  entry.frame_ptr = frame_ptr;
+  entry.track_state = track_state;
+  if (!queue_.push(entry))
+  {
+    dropped_count_.fetch_add(1,boost::memory_order_relaxed);
+    return;
+  }
+  wakeup_.notify();
+}
+
+void FrameRecorder::trigger()
+{
+  trigger_requested_ = true;
+  wakeup_.notify();
+}
+
+unsigned long FrameRecorder::getRecordedCount()
+{
+  return recorded_count_.load(boost::memory_order_relaxed);
+}
+
+unsigned long FrameRecorder::getDroppedCount()
+{
+  return dropped_count_.load(boost::memory_order_relaxed);
+}
+
+unsigned long FrameRecorder::getSavedCount()
+{
+  return saved_count_.load(boost::memory_order_relaxed);
+}
+
+// private
+void FrameRecorder::work()
+{
+  Tracer::setThreadName("recorder");
+  Entry entry;
+  bool pending = false;
+  while (true)
+  {
+    unsigned long generation = wakeup_.getGeneration();
+    if (!pending)
+    {
+      pending = queue_.pop(entry);
+    }
+    if (pending)
+    {
+      // otherwise the saver wakes this thread once it has copied the slot
+      if (isSlotFree())
+      {
+        write(entry);
+        // return the frame to its pool right away
+        entry.frame_ptr.reset();
+        pending = false;
+        continue;
+      }
+    }
+    else if (!saving_.load(boost::memory_order_acquire) && trigger_requested_.exchange(false))
+    {
+      beginSave();
+      continue;
+    }
+    else if (!running_)
+    {
+      break;
+    }
+    wakeup_.wait(generation);
+  }
+  flush(true);
+}
+
+bool FrameRecorder::isSlotFree()
+{
+  // the next slot holds frame frame_count_ - slot_count_, which a save in
+  // progress may not have copied yet
+  if (!saving_.load(boost::memory_order_acquire) || (frame_count_ < slot_count_))
+  {
+    return true;
+  }
+  boost::uint64_t saved_frame = save_first_frame_ + save_progress_.load(boost::memory_order_acquire);
+  return (frame_count_ - slot_count_) < saved_frame;
+}
+
+void FrameRecorder::write(const Entry & entry)
+{
+  TraceSpan trace_span("FrameRecorder::write");
+  const Frame & frame = *entry.frame_ptr;
+  if ((frame.image.size() != image_size_) || (frame.image.type() != image_type_))
+  {
+    dropped_count_.fetch_add(1,boost::memory_order_relaxed);
+    return;
+  }
+  unsigned char * slot_ptr = getSlotPointer(frame_count_ % slot_count_);
+  FrameHeader * frame_header_ptr = (FrameHeader *)slot_ptr;
+  frame_header_ptr->frame_id = frame.frame_id;
+  frame_header_ptr->source_frame_count = frame.source_frame_count;
+  frame_header_ptr->source_timestamp = frame.source_timestamp;
+  frame_header_ptr->track_x = entry.track_state.position.x;
+  frame_header_ptr->track_y = entry.track_state.position.y;
+  frame_header_ptr->found = entry.track_state.found;
+  frame_header_ptr->reserved = 0;
+  cv::Mat image(image_size_,image_type_,slot_ptr + sizeof(FrameHeader));
+  frame.image.copyTo(image);
+
+  file_header_ptr_->frame_count = ++frame_count_;
+  recorded_count_.fetch_add(1,boost::memory_order_relaxed);
+  if ((frame_count_ - flushed_frame_count_) >= FLUSH_FRAME_COUNT)
+  {
+    flush(false);
+  }
+}
+
+void FrameRecorder::flush(const bool synchronous)
+{
+  if (frame_count_ == flushed_frame_count_)
+  {
+    return;
+  }
+  int flags = synchronous ? MS_SYNC : MS_ASYNC;
+  // only the slots written since the last flush, which may wrap around
+  size_t first_slot = flushed_frame_count_ % slot_count_;
+  size_t slot_count = std::min((size_t)(frame_count_ - flushed_frame_count_),slot_count_);
+  size_t end_slot = std::min(first_slot + slot_count,slot_count_);
+  msync(getSlotPointer(first_slot),(end_slot - first_slot)*slot_size_,flags);
+  if ((first_slot + slot_count) > slot_count_)
+  {
+    msync(getSlotPointer(0),(first_slot + slot_count - slot_count_)*slot_size_,flags);
+  }
+  msync(data_ptr_,PAGE_SIZE,flags);
+  flushed_frame_count_ = frame_count_;
+}
+
+void FrameRecorder::beginSave()
+{
+  save_header_ = *file_header_ptr_;
+  save_frame_count_ = std::min((size_t)frame_count_,slot_count_);
+  save_first_frame_ = frame_count_ - save_frame_count_;
+  save_progress_.store(0,boost::memory_order_relaxed);
+  saving_.store(true,boost::memory_order_release);
+  save_wakeup_.notify();
+}
+
+void FrameRecorder::saveWork()
+{
+  Tracer::setThreadName("saver");
+  while (true)
+  {
+    unsigned long generation = save_wakeup_.getGeneration();
+    if (saving_.load(boost::memory_order_acquire))
+    {
+      save();
+      saving_.store(false,boost::memory_order_release);
+      // a held back frame or a trigger may be waiting on the save
+      wakeup_.notify();
+      continue;
+    }
+    if (!save_running_)
+    {
+      break;
+    }
+    save_wakeup_.wait(generation);
+  }
+}
+
+void FrameRecorder::save()
+{
+  // copies oldest frame first, so the recorder can reuse each slot as soon
+  // as it is saved
+  TraceSpan trace_span("FrameRecorder::save");
+  size_t saved_count = saved_count_.load(boost::memory_order_relaxed);
+  std::stringstream path_ss;
+  path_ss << path_ << "." << saved_count;
+  std::string path = path_ss.str();
+
+  size_t frame_count = save_frame_count_;
+
+  int fd = open(path.c_str(),O_WRONLY | O_CREAT | O_TRUNC,0644);
+  if (fd < 0)
+  {
+    std::cerr << "Unable to open saved recording " << path << std::endl;
+    return;
+  }
+  unsigned char header_page[PAGE_SIZE];
+  memset(header_page,0,PAGE_SIZE);
+  FileHeader & file_header = *(FileHeader *)header_page;
+  file_header = save_header_;
+  file_header.slot_count = frame_count;
+  file_header.frame_count = frame_count;
+  bool written = (::write(fd,header_page,PAGE_SIZE) == (ssize_t)PAGE_SIZE);
+  for (size_t i=0; (i<frame_count) && written; ++i)
+  {
+    const unsigned char * slot_ptr = getSlotPointer((save_first_frame_ + i) % slot_count_);
+    written = (::write(fd,slot_ptr,slot_size_) == (ssize_t)slot_size_);
+    save_progress_.store(i + 1,boost::memory_order_release);
+    wakeup_.notify();
+  }
+  close(fd);
+  if (!written)
+  {
+    std::cerr << "Unable to write saved recording " << path << std::endl;
+    return;
+  }
+  saved_count_.fetch_add(1,boost::memory_order_relaxed);
+  std::cout << std::endl << "Recording saved: " << path << " frames: " << frame_count << std::endl;
+}
+
+unsigned char * FrameRecorder::getSlotPointer(const size_t slot_index)
+{
+  return data_ptr_ + PAGE_SIZE + slot_index*slot_size_;
+}
+
+void FrameRecorder::unmap()
+{
+  if (data_ptr_)
+  {
+    munmap(data_ptr_,size_);
+    data_ptr_ = NULL;
+    file_header_ptr_ = NULL;
+  }
+  if (fd_ >= 0)
+  {
+    close(fd_);
+    fd_ = -1;
+  }
+}
+
+size_t FrameRecorder::align(const size_t size)
+{
+  return ((size + PAGE_SIZE - 1)/PAGE_SIZE)*PAGE_SIZE;
+}
@@ -0,0 +1,166 @@
+// ----------------------------------------------------------------------------
+// FrameRecorder.h
+//
+//
+// Authors:
+// Peter Polidoro polidorop@janelia.hhmi.org
+// ----------------------------------------------------------------------------
+#ifndef _FRAME_RECORDER_H_
+#define _FRAME_RECORDER_H_
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <opencv2/core.hpp>
+
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/thread.hpp>
+#include <boost/lockfree/spsc_queue.hpp>
+
+#include "Frame.h"
+#include "TrackState.h"
+#include "Tracer.h"
+#include "Wakeup.h"
+
+
+// Records raw frames into a preallocated memory mapped ring file that always
+// holds the last few seconds. The tracking loop hands over frame references
+// with their track state through a lock-free queue and the recorder thread
+// copies them into the ring and paces writeback, so tracking never waits on
+// the disk. A trigger saves the ring, oldest frame first, to a numbered
+// file next to it, capturing the seconds before an event. The saver thread
+// copies a snapshot of the ring while recording goes on, the recorder only
+// holds a frame back when it would overwrite one not saved yet.
+//
+// file: FileHeader, then slot_count slots of FrameHeader and image bytes,
+// each PAGE_SIZE aligned
+class FrameRecorder
+{
+public:
+  FrameRecorder();
+  ~FrameRecorder();
+
+  struct FileHeader
+  {
+    boost::uint32_t magic;
+    boost::uint32_t version;
+    boost::int32_t width;
+    boost::int32_t height;
+    boost::int32_t type;
+    boost::uint32_t slot_count;
+    boost::uint64_t slot_size;
+    // frames ever written, once the ring is full the oldest is in slot
+    // frame_count % slot_count
+    boost::uint64_t frame_count;
+  };
+
+  struct FrameHeader
+  {
+    boost::uint64_t frame_id;
+    boost::uint64_t source_frame_count;
+    // seconds, from the frame source clock
+    double source_timestamp;
+    double track_x;
+    double track_y;
+    boost::uint32_t found;
+    boost::uint32_t reserved;
+  };
+
+  static const boost::uint32_t MAGIC = 0x5a465252;
+  static const boost::uint32_t VERSION = 1;
+  static const size_t QUEUE_SIZE = 8;
+  // frames the recorder may hold at once, the queue plus the frame waiting
+  // to be written, the frame pool needs this many extra frames
+  static const size_t HELD_FRAME_COUNT = QUEUE_SIZE + 1;
+
+  void setPath(const std::string & path);
+  bool enabled();
+  // creates and maps the whole ring file up front
+  void allocateMemory(const cv::Size image_size,
+                      const int image_type,
+                      const size_t slot_count);
+  void start();
+  void stop();
+
+  // tracking thread, drops the frame instead of waiting when the recorder
+  // falls behind
+  void record(const FramePtr & frame_ptr,
+              const TrackState & track_state);
+  // any thread, the ring is saved once the queued frames are written, a
+  // trigger during a save is taken once it finishes
+  void trigger();
+
+  unsigned long getRecordedCount();
+  unsigned long getDroppedCount();
+  unsigned long getSavedCount();
+
+private:
+  static const size_t PAGE_SIZE = 4096;
+  // writeback is started after this many frames, so dirty pages never pile
+  // up into one long stall
+  static const size_t FLUSH_FRAME_COUNT = 16;
+
+  struct Entry
+  {
+    FramePtr frame_ptr;
+    TrackState track_state;
+  };
+
+  std::string path_;
+  int fd_;
+  unsigned char * data_ptr_;
+  size_t size_;
+  FileHeader * file_header_ptr_;
+  cv::Size image_size_;
+  int image_type_;
+  size_t image_data_size_;
+  size_t slot_count_;
+  size_t slot_size_;
+
+  boost::lockfree::spsc_queue<Entry,boost::lockfree::capacity<QUEUE_SIZE> > queue_;
+  boost::atomic<bool> trigger_requested_;
+  boost::atomic<bool> running_;
+  boost::atomic<bool> saving_;
+  boost::atomic<bool> save_running_;
+  // snapshot frames copied so far by the saver
+  boost::atomic<unsigned long> save_progress_;
+  boost::atomic<unsigned long> recorded_count_;
+  boost::atomic<unsigned long> dropped_count_;
+  boost::atomic<unsigned long> saved_count_;
+
+  // recorder thread only
+  boost::uint64_t frame_count_;
+  boost::uint64_t flushed_frame_count_;
+
+  // snapshot, set by the recorder thread before saving_ and read by the
+  // saver thread until it clears saving_
+  FileHeader save_header_;
+  boost::uint64_t save_first_frame_;
+  size_t save_frame_count_;
+
+  boost::thread thread_;
+  Wakeup wakeup_;
+  boost::thread save_thread_;
+  Wakeup save_wakeup_;
+
+  void work();
+  bool isSlotFree();
+  void write(const Entry & entry);
+  void flush(const bool synchronous);
+  void beginSave();
+  void saveWork();
+  void save();
+  unsigned char * getSlotPointer(const size_t slot_index);
+  void unmap();
+  static size_t align(const size_t size);
+};
+
+#endif
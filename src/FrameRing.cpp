@@ -0,0 +1,128 @@
+// ----------------------------------------------------------------------------
+// FrameRing.cpp
+//
+//
+// Authors:
+// Peter Polidoro polidorop@janelia.hhmi.org
+// ----------------------------------------------------------------------------
+#include "FrameRing.h"
+
+
+// public
+FrameRing::FrameRing()
+{
+  slot_count_ = 0;
+  published_ = 0;
+  reading_ = SLOT_NONE;
+  write_slot_ = 0;
+  write_sequence_ = 0;
+  read_sequence_ = 0;
+  produced_count_ = 0;
+  consumed_count_ = 0;
+  overwritten_count_ = 0;
+}
+
+void FrameRing::allocateMemory(const size_t slot_count)
+{
+  if ((slot_count < SLOT_COUNT_MIN) || (slot_count > SLOT_COUNT_MAX))
+  {
+    throw std::runtime_error("Frame ring slot count out of range.");
+  }
+  slot_count_ = slot_count;
+  slots_.reset(new Slot[slot_count_]);
+  for (size_t slot=0; slot<slot_count_; ++slot)
+  {
+    slots_[slot].sequence = 0;
+  }
+  published_ = 0;
+  reading_ = SLOT_NONE;
+  write_slot_ = slot_count_ - 1;
+  write_sequence_ = 0;
+  read_sequence_ = 0;
+}
+
+void FrameRing::publish(const FramePtr & frame_ptr)
+{
+  while (true)
+  {
+    write_slot_ = (write_slot_ + 1) % slot_count_;
+    Slot & slot = slots_[write_slot_];
+    boost::uint64_t sequence = slot.sequence.load(boost::memory_order_relaxed);
+
+    // mark the slot before checking the reader so that either we see the
+    // reader in it or the reader sees it being overwritten
+    slot.sequence.store(SEQUENCE_WRITING,boost::memory_order_seq_cst);
+    if (reading_.load(boost::memory_order_seq_cst) != (int)write_slot_)
+    {
+      break;
+    }
+    slot.sequence.store(sequence,boost::memory_order_release);
+  }
+
+  // replacing the reference returns an unread frame to its pool
+  slots_[write_slot_].frame_ptr = frame_ptr;
+
+  ++write_sequence_;
+  slots_[write_slot_].sequence.store(write_sequence_,boost::memory_order_release);
+  published_.store(pack(write_sequence_,write_slot_),boost::memory_order_release);
+  produced_count_.store(write_sequence_,boost::memory_order_relaxed);
+}
+
+FramePtr FrameRing::acquireNewest()
+{
+  FramePtr frame_ptr;
+  while (true)
+  {
+    boost::uint64_t published = published_.load(boost::memory_order_acquire);
+    boost::uint64_t sequence = unpackSequence(published);
+    if (sequence == read_sequence_)
+    {
+      return frame_ptr;
+    }
+    size_t slot = unpackSlot(published);
+    reading_.store(slot,boost::memory_order_seq_cst);
+    if (slots_[slot].sequence.load(boost::memory_order_seq_cst) == sequence)
+    {
+      // the slot only needs protecting while the reference is copied
+      frame_ptr = slots_[slot].frame_ptr;
+      reading_.store(SLOT_NONE,boost::memory_order_release);
+      overwritten_count_.fetch_add(sequence - read_sequence_ - 1,boost::memory_order_relaxed);
+      consumed_count_.fetch_add(1,boost::memory_order_relaxed);
+      read_sequence_ = sequence;
+      return frame_ptr;
+    }
+    // the producer started overwriting the slot before we claimed it
+    reading_.store(SLOT_NONE,boost::memory_order_release);
+  }
+}
+
+unsigned long FrameRing::getProducedCount()
+{
+  return produced_count_.load(boost::memory_order_relaxed);
+}
+
+unsigned long FrameRing::getConsumedCount()
+{
+  return consumed_count_.load(boost::memory_order_relaxed);
+}
+
+unsigned long FrameRing::getOverwrittenCount()
+{
+  return overwritten_count_.load(boost::memory_order_relaxed);
+}
+
+// private
+boost::uint64_t FrameRing::pack(const boost::uint64_t sequence, const size_t slot)
+{
+  return (sequence*SLOT_COUNT_MAX) + slot;
+}
+
+boost::uint64_t FrameRing::unpackSequence(const boost::uint64_t published)
+{
+  return published/SLOT_COUNT_MAX;
+}
+
+size_t FrameRing::unpackSlot(const boost::uint64_t published)
+{
+  return published % SLOT_COUNT_MAX;
+}
@@ -0,0 +1,77 @@
+// ----------------------------------------------------------------------------
+// FrameRing.h
+//
+//
+// Authors:
+// Peter Polidoro polidorop@janelia.hhmi.org
+// ----------------------------------------------------------------------------
+#ifndef _FRAME_RING_H_
+#define _FRAME_RING_H_
+#include <iostream>
+#include <stdexcept>
+
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/scoped_array.hpp>
+
+#include "Frame.h"
+
+
+// Fixed-size single-producer/single-consumer ring of frame references.
+// The producer never blocks: it publishes into the oldest slot the consumer
+// is not reading, overwriting unread frames when the consumer falls behind.
+// The consumer always takes the newest published frame.
+class FrameRing
+{
+public:
+  FrameRing();
+
+  void allocateMemory(const size_t slot_count);
+
+  // producer
+  void publish(const FramePtr & frame_ptr);
+
+  // consumer, returns an empty pointer when no frame newer than the last one
+  // is ready
+  FramePtr acquireNewest();
+
+  unsigned long getProducedCount();
+  unsigned long getConsumedCount();
+  unsigned long getOverwrittenCount();
+
+private:
+  static const size_t SLOT_COUNT_MIN = 3;
+  static const size_t SLOT_COUNT_MAX = 256;
+  static const boost::uint64_t SEQUENCE_WRITING = ~(boost::uint64_t)0;
+  static const int SLOT_NONE = -1;
+
+  struct Slot
+  {
+    FramePtr frame_ptr;
+    boost::atomic<boost::uint64_t> sequence;
+  };
+
+  boost::scoped_array<Slot> slots_;
+  size_t slot_count_;
+
+  // sequence of the newest published frame and the slot holding it
+  boost::atomic<boost::uint64_t> published_;
+  boost::atomic<int> reading_;
+
+  // producer only
+  size_t write_slot_;
+  boost::uint64_t write_sequence_;
+
+  // consumer only
+  boost::uint64_t read_sequence_;
+
+  boost::atomic<unsigned long> produced_count_;
+  boost::atomic<unsigned long> consumed_count_;
+  boost::atomic<unsigned long> overwritten_count_;
+
+  static boost::uint64_t pack(const boost::uint64_t sequence, const size_t slot);
+  static boost::uint64_t unpackSequence(const boost::uint64_t published);
+  static size_t unpackSlot(const boost::uint64_t published);
+};
+
+#endif
@@ -0,0 +1,98 @@
+// ----------------------------------------------------------------------------
+// FrameSource.cpp
+//
+//
+// Authors:
+// Peter Polidoro polidorop@janelia.hhmi.org
+// ----------------------------------------------------------------------------
+#include "FrameSource.h"
+
+
+// public
+FrameSource::FrameSource()
+{
+  pacing_ = REAL_TIME;
+  resetPacing();
+
+  grab_count_ = 0;
+  frame_count_prev_ = 0;
+  skipped_frame_count_ = 0;
+}
+
+FrameSource::~FrameSource()
+{
+}
+
+void FrameSource::setPacing(FrameSource::Pacing pacing)
+{
+  pacing_ = pacing;
+}
+
+bool FrameSource::grabFrame(Frame & frame)
+{
+  {
+    TraceSpan trace_span("grabImage");
+    if (!grabImage(frame.image))
+    {
+      return false;
+    }
+  }
+  frame.tick_count = cv::getTickCount();
+  readFrameCounter(frame.source_frame_count,frame.source_timestamp);
+
+  frame.skipped_frame_count = 0;
+  if ((grab_count_ > 0) && (frame.source_frame_count > (frame_count_prev_ + 1)))
+  {
+    frame.skipped_frame_count = frame.source_frame_count - frame_count_prev_ - 1;
+    skipped_frame_count_.fetch_add(frame.skipped_frame_count,boost::memory_order_relaxed);
+  }
+  frame_count_prev_ = frame.source_frame_count;
+  ++grab_count_;
+  return true;
+}
+
+unsigned long FrameSource::getSkippedFrameCount()
+{
+  return skipped_frame_count_.load(boost::memory_order_relaxed);
+}
+
+bool FrameSource::endOfStream()
+{
+  return false;
+}
+
+// protected
+void FrameSource::resetPacing()
+{
+  pacing_tick_count_start_ = 0;
+  pacing_frame_count_ = 0;
+}
+
+void FrameSource::waitForNextFrame(const double frame_rate)
+{
+  if ((pacing_ == AS_FAST_AS_POSSIBLE) || (frame_rate <= 0))
+  {
+    return;
+  }
+
+  int64 tick_count = cv::getTickCount();
+  if (pacing_frame_count_ == 0)
+  {
+    pacing_tick_count_start_ = tick_count;
+  }
+  double tick_frequency = cv::getTickFrequency();
+  int64 tick_count_target = pacing_tick_count_start_ + (int64)((tick_frequency*pacing_frame_count_)/frame_rate);
+  ++pacing_frame_count_;
+
+  if (tick_count_target > tick_count)
+  {
+    long microseconds = (long)((1000000.0*(tick_count_target - tick_count))/tick_frequency);
+    boost::this_thread::sleep(boost::posix_time::microseconds(microseconds));
+  }
+}
+
+void FrameSource::readFrameCounter(unsigned long & frame_count, double & timestamp)
+{
+  frame_count = grab_count_;
+  timestamp = cv::getTickCount()/cv::getTickFrequency();
+}
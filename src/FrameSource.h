@@ -0,0 +1,78 @@
+// ----------------------------------------------------------------------------
+// FrameSource.h
+//
+//
+// Authors:
+// Peter Polidoro polidorop@janelia.hhmi.org
+// ----------------------------------------------------------------------------
+#ifndef _FRAME_SOURCE_H_
+#define _FRAME_SOURCE_H_
+#include <opencv2/core.hpp>
+
+#include <boost/thread.hpp>
+#include <boost/atomic.hpp>
+
+#include "Frame.h"
+#include "Tracer.h"
+
+
+// Anything that produces grayscale frames for the tracking loop: the camera,
+// recorded footage or a synthetic generator.
+class FrameSource
+{
+public:
+  FrameSource();
+  virtual ~FrameSource();
+
+  enum Pacing
+  {
+    REAL_TIME,
+    AS_FAST_AS_POSSIBLE,
+  };
+  void setPacing(Pacing pacing);
+
+  virtual void connect() = 0;
+  virtual void start() = 0;
+  virtual void allocateMemory() = 0;
+  virtual unsigned char * getImageDataPointer() = 0;
+  virtual cv::Size getImageSize() = 0;
+  virtual int getImageType() = 0;
+  virtual unsigned int getImageDataSize() = 0;
+  // nominal frames per second
+  virtual double getFrameRate() = 0;
+
+  // Writes the next frame into image, which is only reallocated when its size
+  // or type does not match. Returns false when no new frame could be grabbed.
+  virtual bool grabImage(cv::Mat & image) = 0;
+
+  // Grabs the next image into frame and fills in its timing and counters,
+  // counting frames the source skipped since the previous grab.
+  bool grabFrame(Frame & frame);
+  unsigned long getSkippedFrameCount();
+
+  // True once a finite source has delivered its last frame.
+  virtual bool endOfStream();
+
+  virtual void stop() = 0;
+  virtual void disconnect() = 0;
+
+protected:
+  Pacing pacing_;
+
+  void resetPacing();
+  void waitForNextFrame(const double frame_rate);
+
+  // Sources with their own frame counter and clock override this, by default
+  // frames are counted as they are grabbed and stamped with the host clock.
+  virtual void readFrameCounter(unsigned long & frame_count, double & timestamp);
+
+private:
+  int64 pacing_tick_count_start_;
+  unsigned long pacing_frame_count_;
+
+  unsigned long grab_count_;
+  unsigned long frame_count_prev_;
+  boost::atomic<unsigned long> skipped_frame_count_;
+};
+
+#endif
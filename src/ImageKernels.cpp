@@ -0,0 +1,328 @@
+// ----------------------------------------------------------------------------
+// ImageKernels.cpp
+//
+//
+// Authors:
+// Peter Polidoro polidorop@janelia.hhmi.org
+// ----------------------------------------------------------------------------
+#include "ImageKernels.h"
+
+
+// public
+const char * ImageKernels::getInstructionSet()
+{
+#if defined(IMAGE_KERNELS_AVX2)
+  return "AVX2";
+#elif defined(IMAGE_KERNELS_SSE2)
+  return "SSE2";
+#elif defined(IMAGE_KERNELS_NEON)
+  return "NEON";
+#else
+  return "scalar";
+#endif
+}
+
+void ImageKernels::thresholdMoments(const cv::Mat & background,
+                                    const cv::Mat & image,
+                                    const unsigned char threshold,
+                                    const cv::Point origin,
+                                    BlobMoments & moments)
+{
+  moments.count = 0;
+  moments.sum_x = 0;
+  moments.sum_y = 0;
+  for (int row=0; row<image.rows; ++row)
+  {
+    boost::uint64_t row_count = 0;
+    boost::uint64_t row_sum_x = 0;
+    thresholdMomentsRow(background.ptr<unsigned char>(row),
+                        image.ptr<unsigned char>(row),
+                        image.cols,
+                        threshold,
+                        row_count,
+                        row_sum_x);
+    moments.count += row_count;
+    moments.sum_x += row_sum_x + row_count*origin.x;
+    moments.sum_y += row_count*(row + origin.y);
+  }
+}
+
+void ImageKernels::thresholdRow(const unsigned char * background_ptr,
+                                const unsigned char * image_ptr,
+                                const int cols,
+                                const unsigned char threshold,
+                                unsigned char * mask_ptr)
+{
+  int col = 0;
+#if defined(IMAGE_KERNELS_AVX2)
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i threshold_vector = _mm256_set1_epi8(threshold);
+  for (; col + 32 <= cols; col += 32)
+  {
+    __m256i background_vector = _mm256_loadu_si256((const __m256i *)(background_ptr + col));
+    __m256i image_vector = _mm256_loadu_si256((const __m256i *)(image_ptr + col));
+    __m256i foreground = _mm256_subs_epu8(background_vector,image_vector);
+    __m256i below = _mm256_cmpeq_epi8(_mm256_subs_epu8(foreground,threshold_vector),zero);
+    _mm256_storeu_si256((__m256i *)(mask_ptr + col),_mm256_xor_si256(below,_mm256_cmpeq_epi8(zero,zero)));
+  }
+#elif defined(IMAGE_KERNELS_SSE2)
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i threshold_vector = _mm_set1_epi8(threshold);
+  for (; col + 16 <= cols; col += 16)
+  {
+    __m128i background_vector = _mm_loadu_si128((const __m128i *)(background_ptr + col));
+    __m128i image_vector = _mm_loadu_si128((const __m128i *)(image_ptr + col));
+    __m128i foreground = _mm_subs_epu8(background_vector,image_vector);
+    __m128i below = _mm_cmpeq_epi8(_mm_subs_epu8(foreground,threshold_vector),zero);
+    _mm_storeu_si128((__m128i *)(mask_ptr + col),_mm_xor_si128(below,_mm_cmpeq_epi8(zero,zero)));
+  }
+#elif defined(IMAGE_KERNELS_NEON)
+  const uint8x16_t threshold_vector = vdupq_n_u8(threshold);
+  for (; col + 16 <= cols; col += 16)
+  {
+    uint8x16_t background_vector = vld1q_u8(background_ptr + col);
+    uint8x16_t image_vector = vld1q_u8(image_ptr + col);
+    vst1q_u8(mask_ptr + col,vcgtq_u8(vqsubq_u8(background_vector,image_vector),threshold_vector));
+  }
+#endif
+  for (; col<cols; ++col)
+  {
+    int foreground = (int)background_ptr[col] - (int)image_ptr[col];
+    mask_ptr[col] = (foreground > threshold) ? UCHAR_MAX : 0;
+  }
+}
+
+void ImageKernels::initializeRunningAverage(const cv::Mat & image,
+                                            cv::Mat & accumulator,
+                                            cv::Mat & background)
+{
+  image.convertTo(accumulator,CV_16UC1,1 << FIXED_POINT_SHIFT);
+  image.copyTo(background);
+}
+
+void ImageKernels::updateRunningAverage(const cv::Mat & image,
+                                        const int shift,
+                                        const bool masked,
+                                        const unsigned char threshold,
+                                        cv::Mat & accumulator,
+                                        cv::Mat & background)
+{
+  // an unmasked update is a masked one whose threshold can never be exceeded
+  unsigned short mask_threshold = masked ? threshold : USHRT_MAX;
+  for (int row=0; row<image.rows; ++row)
+  {
+    updateRunningAverageRow(image.ptr<unsigned char>(row),
+                            image.cols,
+                            shift,
+                            mask_threshold,
+                            accumulator.ptr<unsigned short>(row),
+                            background.ptr<unsigned char>(row));
+  }
+}
+
+// private
+void ImageKernels::updateRunningAverageRow(const unsigned char * image_ptr,
+                                           const int cols,
+                                           const int shift,
+                                           const unsigned short mask_threshold,
+                                           unsigned short * accumulator_ptr,
+                                           unsigned char * background_ptr)
+{
+  // work in 16 bit lanes throughout: background = (accumulator + 128) >> 8,
+  // accumulator' = accumulator - (accumulator >> shift) + (image << (8 - shift))
+  int col = 0;
+#if defined(IMAGE_KERNELS_AVX2)
+  const __m128i shift_count = _mm_cvtsi32_si128(shift);
+  const __m128i image_shift_count = _mm_cvtsi32_si128(FIXED_POINT_SHIFT - shift);
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i half = _mm256_set1_epi16(FIXED_POINT_HALF);
+  const __m256i threshold_vector = _mm256_set1_epi16((short)mask_threshold);
+  for (; col + 16 <= cols; col += 16)
+  {
+    __m256i image_vector = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(image_ptr + col)));
+    __m256i accumulator = _mm256_loadu_si256((const __m256i *)(accumulator_ptr + col));
+    __m256i background = _mm256_srli_epi16(_mm256_add_epi16(accumulator,half),FIXED_POINT_SHIFT);
+    __m256i foreground = _mm256_subs_epu16(background,image_vector);
+    __m256i update = _mm256_cmpeq_epi16(_mm256_subs_epu16(foreground,threshold_vector),zero);
+    __m256i accumulator_updated = _mm256_add_epi16(_mm256_sub_epi16(accumulator,_mm256_srl_epi16(accumulator,shift_count)),
+                                                   _mm256_sll_epi16(image_vector,image_shift_count));
+    accumulator = _mm256_or_si256(_mm256_and_si256(update,accumulator_updated),_mm256_andnot_si256(update,accumulator));
+    _mm256_storeu_si256((__m256i *)(accumulator_ptr + col),accumulator);
+    background = _mm256_srli_epi16(_mm256_add_epi16(accumulator,half),FIXED_POINT_SHIFT);
+    background = _mm256_permute4x64_epi64(_mm256_packus_epi16(background,background),0xD8);
+    _mm_storeu_si128((__m128i *)(background_ptr + col),_mm256_castsi256_si128(background));
+  }
+#elif defined(IMAGE_KERNELS_SSE2)
+  const __m128i shift_count = _mm_cvtsi32_si128(shift);
+  const __m128i image_shift_count = _mm_cvtsi32_si128(FIXED_POINT_SHIFT - shift);
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i half = _mm_set1_epi16(FIXED_POINT_HALF);
+  const __m128i threshold_vector = _mm_set1_epi16((short)mask_threshold);
+  for (; col + 8 <= cols; col += 8)
+  {
+    __m128i image_vector = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(image_ptr + col)),zero);
+    __m128i accumulator = _mm_loadu_si128((const __m128i *)(accumulator_ptr + col));
+    __m128i background = _mm_srli_epi16(_mm_add_epi16(accumulator,half),FIXED_POINT_SHIFT);
+    __m128i foreground = _mm_subs_epu16(background,image_vector);
+    __m128i update = _mm_cmpeq_epi16(_mm_subs_epu16(foreground,threshold_vector),zero);
+    __m128i accumulator_updated = _mm_add_epi16(_mm_sub_epi16(accumulator,_mm_srl_epi16(accumulator,shift_count)),
+                                                _mm_sll_epi16(image_vector,image_shift_count));
+    accumulator = _mm_or_si128(_mm_and_si128(update,accumulator_updated),_mm_andnot_si128(update,accumulator));
+    _mm_storeu_si128((__m128i *)(accumulator_ptr + col),accumulator);
+    background = _mm_srli_epi16(_mm_add_epi16(accumulator,half),FIXED_POINT_SHIFT);
+    _mm_storel_epi64((__m128i *)(background_ptr + col),_mm_packus_epi16(background,background));
+  }
+#elif defined(IMAGE_KERNELS_NEON)
+  const int16x8_t shift_right = vdupq_n_s16(-shift);
+  const int16x8_t image_shift_left = vdupq_n_s16(FIXED_POINT_SHIFT - shift);
+  const uint16x8_t threshold_vector = vdupq_n_u16(mask_threshold);
+  for (; col + 8 <= cols; col += 8)
+  {
+    uint16x8_t image_vector = vmovl_u8(vld1_u8(image_ptr + col));
+    uint16x8_t accumulator = vld1q_u16(accumulator_ptr + col);
+    uint16x8_t background = vrshrq_n_u16(accumulator,FIXED_POINT_SHIFT);
+    uint16x8_t foreground = vqsubq_u16(background,image_vector);
+    uint16x8_t update = vcleq_u16(foreground,threshold_vector);
+    uint16x8_t accumulator_updated = vaddq_u16(vsubq_u16(accumulator,vshlq_u16(accumulator,shift_right)),
+                                               vshlq_u16(image_vector,image_shift_left));
+    accumulator = vbslq_u16(update,accumulator_updated,accumulator);
+    vst1q_u16(accumulator_ptr + col,accumulator);
+    vst1_u8(background_ptr + col,vmovn_u16(vrshrq_n_u16(accumulator,FIXED_POINT_SHIFT)));
+  }
+#endif
+  for (; col<cols; ++col)
+  {
+    unsigned short accumulator = accumulator_ptr[col];
+    int background = (accumulator + FIXED_POINT_HALF) >> FIXED_POINT_SHIFT;
+    int foreground = background - (int)image_ptr[col];
+    if (foreground <= (int)mask_threshold)
+    {
+      accumulator = accumulator - (accumulator >> shift) + (image_ptr[col] << (FIXED_POINT_SHIFT - shift));
+      accumulator_ptr[col] = accumulator;
+    }
+    background_ptr[col] = (accumulator + FIXED_POINT_HALF) >> FIXED_POINT_SHIFT;
+  }
+}
+
+void ImageKernels::thresholdMomentsRow(const unsigned char * background_ptr,
+                                       const unsigned char * image_ptr,
+                                       const int cols,
+                                       const unsigned char threshold,
+                                       boost::uint64_t & count,
+                                       boost::uint64_t & sum_x)
+{
+  // per lane x sums are 32 bit, which holds a full row for any sensor width
+  // below 32768 pixels
+  int col = 0;
+#if defined(IMAGE_KERNELS_AVX2)
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i ones = _mm256_set1_epi8(1);
+  const __m256i ones_16 = _mm256_set1_epi16(1);
+  const __m256i threshold_vector = _mm256_set1_epi8(threshold);
+  const __m256i x_step = _mm256_set1_epi16(32);
+  // unpack works within 128 bit lanes, so the x vectors follow that order
+  __m256i x_lo = _mm256_setr_epi16(0,1,2,3,4,5,6,7,16,17,18,19,20,21,22,23);
+  __m256i x_hi = _mm256_setr_epi16(8,9,10,11,12,13,14,15,24,25,26,27,28,29,30,31);
+  __m256i count_acc = zero;
+  __m256i sum_x_acc = zero;
+  for (; col + 32 <= cols; col += 32)
+  {
+    __m256i background_vector = _mm256_loadu_si256((const __m256i *)(background_ptr + col));
+    __m256i image_vector = _mm256_loadu_si256((const __m256i *)(image_ptr + col));
+    __m256i foreground = _mm256_subs_epu8(background_vector,image_vector);
+    __m256i below = _mm256_cmpeq_epi8(_mm256_subs_epu8(foreground,threshold_vector),zero);
+    count_acc = _mm256_add_epi64(count_acc,_mm256_sad_epu8(_mm256_andnot_si256(below,ones),zero));
+    __m256i below_lo = _mm256_unpacklo_epi8(below,below);
+    __m256i below_hi = _mm256_unpackhi_epi8(below,below);
+    sum_x_acc = _mm256_add_epi32(sum_x_acc,_mm256_madd_epi16(_mm256_andnot_si256(below_lo,x_lo),ones_16));
+    sum_x_acc = _mm256_add_epi32(sum_x_acc,_mm256_madd_epi16(_mm256_andnot_si256(below_hi,x_hi),ones_16));
+    x_lo = _mm256_add_epi16(x_lo,x_step);
+    x_hi = _mm256_add_epi16(x_hi,x_step);
+  }
+  boost::uint64_t count_lanes[4];
+  boost::uint32_t sum_x_lanes[8];
+  _mm256_storeu_si256((__m256i *)count_lanes,count_acc);
+  _mm256_storeu_si256((__m256i *)sum_x_lanes,sum_x_acc);
+  for (int lane=0; lane<4; ++lane)
+  {
+    count += count_lanes[lane];
+  }
+  for (int lane=0; lane<8; ++lane)
+  {
+    sum_x += sum_x_lanes[lane];
+  }
+#elif defined(IMAGE_KERNELS_SSE2)
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i ones = _mm_set1_epi8(1);
+  const __m128i ones_16 = _mm_set1_epi16(1);
+  const __m128i threshold_vector = _mm_set1_epi8(threshold);
+  const __m128i x_step = _mm_set1_epi16(16);
+  __m128i x_lo = _mm_setr_epi16(0,1,2,3,4,5,6,7);
+  __m128i x_hi = _mm_setr_epi16(8,9,10,11,12,13,14,15);
+  __m128i count_acc = zero;
+  __m128i sum_x_acc = zero;
+  for (; col + 16 <= cols; col += 16)
+  {
+    __m128i background_vector = _mm_loadu_si128((const __m128i *)(background_ptr + col));
+    __m128i image_vector = _mm_loadu_si128((const __m128i *)(image_ptr + col));
+    __m128i foreground = _mm_subs_epu8(background_vector,image_vector);
+    __m128i below = _mm_cmpeq_epi8(_mm_subs_epu8(foreground,threshold_vector),zero);
+    count_acc = _mm_add_epi64(count_acc,_mm_sad_epu8(_mm_andnot_si128(below,ones),zero));
+    __m128i below_lo = _mm_unpacklo_epi8(below,below);
+    __m128i below_hi = _mm_unpackhi_epi8(below,below);
+    sum_x_acc = _mm_add_epi32(sum_x_acc,_mm_madd_epi16(_mm_andnot_si128(below_lo,x_lo),ones_16));
+    sum_x_acc = _mm_add_epi32(sum_x_acc,_mm_madd_epi16(_mm_andnot_si128(below_hi,x_hi),ones_16));
+    x_lo = _mm_add_epi16(x_lo,x_step);
+    x_hi = _mm_add_epi16(x_hi,x_step);
+  }
+  boost::uint64_t count_lanes[2];
+  boost::uint32_t sum_x_lanes[4];
+  _mm_storeu_si128((__m128i *)count_lanes,count_acc);
+  _mm_storeu_si128((__m128i *)sum_x_lanes,sum_x_acc);
+  count += count_lanes[0] + count_lanes[1];
+  sum_x += (boost::uint64_t)sum_x_lanes[0] + sum_x_lanes[1] + sum_x_lanes[2] + sum_x_lanes[3];
+#elif defined(IMAGE_KERNELS_NEON)
+  const uint8x16_t threshold_vector = vdupq_n_u8(threshold);
+  const uint16x8_t x_step = vdupq_n_u16(16);
+  const uint16_t x_init[16] = {0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15};
+  uint16x8_t x_lo = vld1q_u16(x_init);
+  uint16x8_t x_hi = vld1q_u16(x_init + 8);
+  uint16x8_t count_acc = vdupq_n_u16(0);
+  uint32x4_t sum_x_acc = vdupq_n_u32(0);
+  for (; col + 16 <= cols; col += 16)
+  {
+    uint8x16_t background_vector = vld1q_u8(background_ptr + col);
+    uint8x16_t image_vector = vld1q_u8(image_ptr + col);
+    uint8x16_t above = vcgtq_u8(vqsubq_u8(background_vector,image_vector),threshold_vector);
+    count_acc = vpadalq_u8(count_acc,vshrq_n_u8(above,7));
+    int8x16_t above_signed = vreinterpretq_s8_u8(above);
+    uint16x8_t above_lo = vreinterpretq_u16_s16(vmovl_s8(vget_low_s8(above_signed)));
+    uint16x8_t above_hi = vreinterpretq_u16_s16(vmovl_s8(vget_high_s8(above_signed)));
+    sum_x_acc = vpadalq_u16(sum_x_acc,vandq_u16(above_lo,x_lo));
+    sum_x_acc = vpadalq_u16(sum_x_acc,vandq_u16(above_hi,x_hi));
+    x_lo = vaddq_u16(x_lo,x_step);
+    x_hi = vaddq_u16(x_hi,x_step);
+  }
+  uint16_t count_lanes[8];
+  uint32_t sum_x_lanes[4];
+  vst1q_u16(count_lanes,count_acc);
+  vst1q_u32(sum_x_lanes,sum_x_acc);
+  for (int lane=0; lane<8; ++lane)
+  {
+    count += count_lanes[lane];
+  }
+  for (int lane=0; lane<4; ++lane)
+  {
+    sum_x += sum_x_lanes[lane];
+  }
+#endif
+  for (; col<cols; ++col)
+  {
+    int foreground = (int)background_ptr[col] - (int)image_ptr[col];
+    if (foreground > threshold)
+    {
+      ++count;
+      sum_x += col;
+    }
+  }
+}
@@ -0,0 +1,93 @@
+// ----------------------------------------------------------------------------
+// ImageKernels.h
+//
+//
+// Authors:
+// Peter Polidoro polidorop@janelia.hhmi.org
+// ----------------------------------------------------------------------------
+#ifndef _IMAGE_KERNELS_H_
+#define _IMAGE_KERNELS_H_
+#include <climits>
+
+#include <opencv2/core.hpp>
+
+#include <boost/cstdint.hpp>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define IMAGE_KERNELS_AVX2
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define IMAGE_KERNELS_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define IMAGE_KERNELS_NEON
+#endif
+
+
+struct BlobMoments
+{
+  boost::uint64_t count;
+  boost::uint64_t sum_x;
+  boost::uint64_t sum_y;
+};
+
+// Hot path image kernels, vectorized for the instruction set the tracker is
+// compiled for with a scalar fallback. All take 8 bit single channel images
+// and never allocate.
+class ImageKernels
+{
+public:
+  static const char * getInstructionSet();
+
+  // Single pass equivalent of subtract(background,image), threshold and
+  // findNonZero: counts pixels where background - image > threshold and sums
+  // their coordinates, offset by origin.
+  static void thresholdMoments(const cv::Mat & background,
+                               const cv::Mat & image,
+                               const unsigned char threshold,
+                               const cv::Point origin,
+                               BlobMoments & moments);
+
+  // Writes 255 where background - image > threshold and 0 elsewhere, for
+  // one row of cols pixels.
+  static void thresholdRow(const unsigned char * background_ptr,
+                           const unsigned char * image_ptr,
+                           const int cols,
+                           const unsigned char threshold,
+                           unsigned char * mask_ptr);
+
+  // Exponentially weighted running average background in 8.8 fixed point,
+  // accumulator += (image - accumulator)/2^shift with shift at most 8.
+  // When masked, pixels where background - image > threshold are treated as
+  // foreground and left out of the update. Background receives the rounded
+  // 8 bit average. The first call should use initializeRunningAverage.
+  static void initializeRunningAverage(const cv::Mat & image,
+                                       cv::Mat & accumulator,
+                                       cv::Mat & background);
+  static void updateRunningAverage(const cv::Mat & image,
+                                   const int shift,
+                                   const bool masked,
+                                   const unsigned char threshold,
+                                   cv::Mat & accumulator,
+                                   cv::Mat & background);
+
+private:
+  static const int FIXED_POINT_SHIFT = 8;
+  static const int FIXED_POINT_HALF = 128;
+
+  static void updateRunningAverageRow(const unsigned char * image_ptr,
+                                      const int cols,
+                                      const int shift,
+                                      const unsigned short mask_threshold,
+                                      unsigned short * accumulator_ptr,
+                                      unsigned char * background_ptr);
+  static void thresholdMomentsRow(const unsigned char * background_ptr,
+                                  const unsigned char * image_ptr,
+                                  const int cols,
+                                  const unsigned char threshold,
+                                  boost::uint64_t & count,
+                                  boost::uint64_t & sum_x);
+};
+
+#endif
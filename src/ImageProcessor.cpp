@@ -8,31 +8,36 @@
 #include "ImageProcessor.h"
 
 
-cv::Point ImageProcessor::tracked_image_point_;
+TrackState ImageProcessor::track_state_;
 int ImageProcessor::threshold_value_;
 
 // public
 ImageProcessor::ImageProcessor()
 {
   image_count_ = 0;
+  background_sample_image_count_ = 0;
   mode_ = BLOB;
+  background_mode_ = MOG2;
+  background_masked_ = true;
+  blob_selection_ = LARGEST;
+  tracking_window_half_size_ = 0;
+  search_prior_set_ = false;
+  full_frame_search_count_ = 0;
+  background_tick_count_ = 0;
+  blob_tick_count_ = 0;
   show_ = true;
-  windows_ = false;
+  preview_ = false;
 
-  tracked_image_point_ = cv::Point(0,0);
+  track_state_.position = cv::Point2d(0,0);
+  track_state_.orientation = 0;
+  track_state_.elongation = 1;
+  track_state_.found = false;
 
   threshold_value_ = THRESHOLD_VALUE_DEFAULT;
 
   frame_rate_ = 0;
   frame_tick_count_prev_ = 0;
 
-  blue_ = cv::Scalar(255,0,0);
-  yellow_ = cv::Scalar(0,255,255);
-  green_ = cv::Scalar(0,255,0);
-  red_ = cv::Scalar(0,0,255);
-
-  frame_rate_display_position_ = cv::Point(50,50);
-
   gpu_enabled_ = false;
 }
 
@@ -41,6 +46,39 @@ void ImageProcessor::setMode(ImageProcessor::Mode mode)
   mode_ = mode;
 }
 
+void ImageProcessor::setBackgroundMode(ImageProcessor::BackgroundMode background_mode)
+{
+  background_mode_ = background_mode;
+}
+
+void ImageProcessor::setBackgroundMasked(const bool background_masked)
+{
+  background_masked_ = background_masked;
+}
+
+void ImageProcessor::setBlobSelection(ImageProcessor::BlobSelection blob_selection)
+{
+  blob_selection_ = blob_selection;
+}
+
+void ImageProcessor::setTrackingWindow(const int max_velocity)
+{
+  if (max_velocity > 0)
+  {
+    tracking_window_half_size_ = max_velocity + TRACKING_WINDOW_MARGIN;
+  }
+  else
+  {
+    tracking_window_half_size_ = 0;
+  }
+}
+
+void ImageProcessor::setSearchPrior(const cv::Point2d & search_prior)
+{
+  search_prior_ = search_prior;
+  search_prior_set_ = true;
+}
+
 void ImageProcessor::show()
 {
   show_ = true;
@@ -51,6 +89,12 @@ void ImageProcessor::hide()
   show_ = false;
 }
 
+void ImageProcessor::setPreviewName(const std::string & preview_name)
+{
+  preview_ = !preview_name.empty();
+  display_worker_.setPreviewName(preview_name);
+}
+
 void ImageProcessor::enableGpu()
 {
   gpu_enabled_ = true;
@@ -66,11 +110,18 @@ void ImageProcessor::allocateMemory(unsigned char * const image_data_ptr,
   image_type_ = image_type;
   image_data_size_ = image_data_size;
 
-  bg_sub_ptr_ = cv::createBackgroundSubtractorMOG2();
-  bg_sub_ptr_->setHistory(BACKGROUND_HISTORY);
-  bg_sub_ptr_->setVarThreshold(BACKGROUND_VAR_THRESHOLD);
-  bg_sub_ptr_->setDetectShadows(BACKGROUND_DETECT_SHADOWS);
+  blob_labeler_.allocateMemory(image_size_);
 
+  if ((mode_ == BLOB) && (background_mode_ == MOG2) && !gpu_enabled_)
+  {
+    background_worker_.start(image_size_,image_type_);
+  }
+
+  if (show_ || preview_)
+  {
+    display_worker_.setWindows(show_);
+    display_worker_.start((mode_ == BLOB),threshold_value_,MAX_PIXEL_VALUE);
+  }
 
   if (gpu_enabled_)
   {
@@ -84,97 +135,65 @@ void ImageProcessor::allocateMemory(unsigned char * const image_data_ptr,
     // cudaMallocManaged((void**)&background_data_ptr_,image_data_size_);
     // background_ = cv::Mat(image_size_,image_type_,background_data_ptr_);
     // background_g_ = cv::cuda::GpuMat(image_size_,image_type_,background_data_ptr_);
-
-    // cudaMallocManaged((void**)&foreground_data_ptr_,image_data_size_);
-    // foreground_ = cv::Mat(image_size_,image_type_,foreground_data_ptr_);
-    // foreground_g_ = cv::cuda::GpuMat(image_size_,image_type_,foreground_data_ptr_);
-
-    // cudaMallocManaged((void**)&foreground_mask_data_ptr_,image_data_size_);
-    // foreground_mask_ = cv::Mat(image_size_,image_type_,foreground_mask_data_ptr_);
-    // foreground_mask_g_ = cv::cuda::GpuMat(image_size_,image_type_,foreground_mask_data_ptr_);
-
-    // cudaMallocManaged((void**)&threshold_data_ptr_,image_data_size_);
-    // threshold_ = cv::Mat(image_size_,image_type_,threshold_data_ptr_);
-    // threshold_g_ = cv::cuda::GpuMat(image_size_,image_type_,threshold_data_ptr_);
-
   }
 }
 
 void ImageProcessor::update(cv::Mat image)
 {
-  if (show_ && !windows_)
+  TraceSpan trace_span("ImageProcessor::update");
+  if (show_)
   {
-    createWindows();
+    threshold_value_ = display_worker_.getThresholdValue();
   }
   updateFrameRateMeasurement();
-  cv::Point tracked_point = cv::Point(0,0);
+  // keep the previous point when nothing new is found or clicked
+  TrackState track_state = track_state_;
   switch (mode_)
   {
     case BLOB:
     {
       updateBackground(image);
+      background_tick_count_ = cv::getTickCount();
 
-      findBlobLocation(image,tracked_point);
+      findBlobLocation(image,track_state);
+      blob_tick_count_ = cv::getTickCount();
       break;
     }
     case MOUSE:
     {
-      findClickedLocation(image,tracked_point);
+      background_tick_count_ = cv::getTickCount();
+      findClickedLocation(image,track_state);
+      blob_tick_count_ = cv::getTickCount();
       break;
     }
   }
 
-  tracked_image_point_ = tracked_point;
+  track_state_ = track_state;
 
-  displayImage(image);
+  publishDisplaySnapshot(image);
 
   ++image_count_;
 }
 
-void ImageProcessor::getTrackedImagePoint(cv::Point & tracked_image_point)
+void ImageProcessor::getTrackState(TrackState & track_state)
 {
-  tracked_image_point = tracked_image_point_;
+  track_state = track_state_;
 }
 
-// private
-
-void ImageProcessor::createWindows()
+void ImageProcessor::getStageTickCounts(int64 & background_tick_count,
+                                        int64 & blob_tick_count)
 {
-  destroyWindows();
-
-  cv::namedWindow("Image",cv::WINDOW_NORMAL);
-
-  switch (mode_)
-  {
-    case BLOB:
-    {
-      cv::namedWindow("Background",cv::WINDOW_NORMAL);
-      cv::namedWindow("Foreground",cv::WINDOW_NORMAL);
-      cv::namedWindow("Threshold",cv::WINDOW_NORMAL);
-      char TrackbarName[50];
-      sprintf(TrackbarName, "threshold_value");
-      cv::createTrackbar(TrackbarName,
-                         "Threshold",
-                         &threshold_value_,
-                         MAX_PIXEL_VALUE,
-                         trackbarThresholdHandler);
-      break;
-    }
-    case MOUSE:
-    {
-      cv::setMouseCallback("Image",mouseClickHandler);
-      break;
-    }
-  }
-  windows_ = true;
+  background_tick_count = background_tick_count_;
+  blob_tick_count = blob_tick_count_;
 }
 
-void ImageProcessor::destroyWindows()
+unsigned long ImageProcessor::getFullFrameSearchCount()
 {
-  cv::destroyAllWindows();
-  windows_ = false;
+  return full_frame_search_count_;
 }
 
+// private
+
 void ImageProcessor::updateFrameRateMeasurement()
 {
   if ((image_count_ % FRAME_RATE_FRAME_COUNT) == 0)
@@ -192,34 +211,69 @@ void ImageProcessor::updateFrameRateMeasurement()
 
 void ImageProcessor::updateBackground(cv::Mat image)
 {
-  if ((image_count_ % BACKGROUND_DIVISOR) == 0)
+  TraceSpan trace_span("updateBackground");
+  switch (background_mode_)
   {
-    if (gpu_enabled_)
+    case MOG2:
     {
-      // bg_sub_ptr_g_->apply(image_g_,foreground_mask_g_,BACKGROUND_LEARNING_RATE);
-      // bg_sub_ptr_g_->getBackgroundImage(background_g_);
+      updateBackgroundMog2(image);
+      break;
     }
-    else
+    case RUNNING_AVERAGE:
     {
-      bg_sub_ptr_->apply(image,foreground_mask_,BACKGROUND_LEARNING_RATE);
-      bg_sub_ptr_->getBackgroundImage(background_);
+      updateBackgroundRunningAverage(image);
+      break;
     }
-    // std::cout << "image.data: " << (long)image.data << std::endl;
-    // std::cout << "image_g_.data: " << (long)image_g_.data << std::endl;
   }
 }
 
+void ImageProcessor::updateBackgroundMog2(cv::Mat image)
+{
+  if (gpu_enabled_)
+  {
+    // bg_sub_ptr_g_->apply(image_g_,foreground_mask_g_,BACKGROUND_LEARNING_RATE);
+    // bg_sub_ptr_g_->getBackgroundImage(background_g_);
+    return;
+  }
+
+  // the model is updated on the worker thread, a sample is only handed over
+  // once the worker has finished the previous one, so a slow update delays
+  // the next sample instead of stalling tracking
+  if ((image_count_ >= background_sample_image_count_) && background_worker_.sampleWanted())
+  {
+    background_worker_.sample(image);
+    background_sample_image_count_ = image_count_ + BACKGROUND_DIVISOR;
+  }
+  background_worker_.updateBackground(background_);
+}
+
+void ImageProcessor::updateBackgroundRunningAverage(cv::Mat image)
+{
+  // small update every frame instead of a large one every BACKGROUND_DIVISOR
+  if (background_accumulator_.empty())
+  {
+    ImageKernels::initializeRunningAverage(image,background_accumulator_,background_);
+    return;
+  }
+  ImageKernels::updateRunningAverage(image,
+                                     BACKGROUND_AVERAGE_SHIFT,
+                                     background_masked_,
+                                     threshold_value_,
+                                     background_accumulator_,
+                                     background_);
+}
+
 double ImageProcessor::getFrameRate()
 {
   return frame_rate_;
 }
 
-void ImageProcessor::findBlobLocation(cv::Mat image, cv::Point & location)
+void ImageProcessor::findBlobLocation(cv::Mat image, TrackState & track_state)
 {
+  TraceSpan trace_span("findBlobLocation");
   if (gpu_enabled_)
   {
     // cv::cuda::subtract(background_g_,image_g_,foreground_g_);
-    // cv::threshold(foreground_,threshold_,threshold_value_,MAX_PIXEL_VALUE,cv::THRESH_BINARY);
     // cv::cuda::threshold(foreground_g_,threshold_g_,threshold_value_,MAX_PIXEL_VALUE,cv::THRESH_BINARY);
 
     // std::vector<cv::Point> locations;
@@ -227,100 +281,171 @@ void ImageProcessor::findBlobLocation(cv::Mat image, cv::Point & location)
   }
   else
   {
-    cv::subtract(background_,image,foreground_);
-    cv::threshold(foreground_,threshold_,threshold_value_,MAX_PIXEL_VALUE,cv::THRESH_BINARY);
-
-    std::vector<cv::Point> locations;
-    cv::findNonZero(threshold_,locations);
-
-    // Choose one
-    // if (locations.size() > 0)
-    // {
-    //   cv::Point2f sum(0,0);
-    //   for (size_t i=0; i<locations.size(); ++i)
-    //   {
-    //     sum = sum + cv::Point2f(locations[i]);
-    //   }
-    //   cv::Point2f mean;
-    //   mean.x = sum.x/locations.size();
-    //   mean.y = sum.y/locations.size();
-    //   location = mean;
-    // }
+    if (background_.empty())
+    {
+      return;
+    }
+
+    // search the window around the last or predicted blob first and only
+    // fall back to the full frame when the blob was lost
+    search_center_ = search_prior_set_ ? search_prior_ : track_state.position;
+    search_prior_set_ = false;
+    cv::Rect full_frame(cv::Point(0,0),image.size());
+    updateTrackingWindow(track_state);
+    bool found = false;
+    if (tracking_window_.area() > 0)
+    {
+      found = findBlob(image,tracking_window_,track_state);
+    }
+    if (!found && (tracking_window_ != full_frame))
+    {
+      ++full_frame_search_count_;
+      found = findBlob(image,full_frame,track_state);
+    }
+    track_state.found = found;
   }
 }
 
-void ImageProcessor::findClickedLocation(cv::Mat image, cv::Point & location)
+void ImageProcessor::updateTrackingWindow(const TrackState & track_state)
 {
+  cv::Rect full_frame(cv::Point(0,0),image_size_);
+  if ((tracking_window_half_size_ == 0) || !track_state.found)
+  {
+    tracking_window_ = full_frame;
+    return;
+  }
+  cv::Point half_size(tracking_window_half_size_,tracking_window_half_size_);
+  cv::Point location(cvRound(search_center_.x),cvRound(search_center_.y));
+  tracking_window_ = cv::Rect(location - half_size,location + half_size) & full_frame;
 }
 
-void ImageProcessor::displayImage(cv::Mat image)
+bool ImageProcessor::findBlob(cv::Mat image,
+                              const cv::Rect & window,
+                              TrackState & track_state)
 {
-  if (!show_ || !windows_)
+  if (blob_selection_ == ALL_PIXELS)
   {
-    return;
+    // subtract, threshold and centroid in one pass, the foreground and
+    // threshold images are only made when they are displayed
+    ImageKernels::thresholdMoments(background_(window),
+                                   image(window),
+                                   threshold_value_,
+                                   window.tl(),
+                                   blob_moments_);
+    if (blob_moments_.count == 0)
+    {
+      return false;
+    }
+    track_state.position.x = (double)blob_moments_.sum_x/blob_moments_.count;
+    track_state.position.y = (double)blob_moments_.sum_y/blob_moments_.count;
+    track_state.orientation = 0;
+    track_state.elongation = 1;
+    return true;
   }
-  // Update display
-  if ((image_count_ % DISPLAY_DIVISOR) == 0)
+
+  // pick one connected blob so noise and debris do not pull the centroid
+  blob_labeler_.label(background_(window),
+                      image(window),
+                      threshold_value_,
+                      window.tl());
+  int blob_index = -1;
+  switch (blob_selection_)
   {
-    cv::cvtColor(image,display_image_,CV_GRAY2BGR);
-
-    cv::circle(display_image_,
-               tracked_image_point_,
-               DISPLAY_MARKER_RADIUS,
-               red_,
-               DISPLAY_MARKER_THICKNESS);
-
-    std::stringstream frame_rate_ss;
-    frame_rate_ss << getFrameRate();
-    std::string frame_rate_string = std::string("Frame rate: ") + std::string(frame_rate_ss.str());
-    cv::putText(display_image_,
-                frame_rate_string,
-                frame_rate_display_position_,
-                cv::FONT_HERSHEY_SIMPLEX,
-                1,
-                yellow_,
-                4);
-
-    showImageInWindow("Image",display_image_);
-
-    switch (mode_)
+    case LARGEST:
     {
-      case BLOB:
-      {
-        showImageInWindow("Background",background_);
-        showImageInWindow("Foreground",foreground_);
-        showImageInWindow("Threshold",threshold_);
-        break;
-      }
-      case MOUSE:
-      {
-        break;
-      }
+      blob_index = blob_labeler_.findLargestBlob(BLOB_AREA_MIN);
+      break;
+    }
+    case CLOSEST:
+    {
+      blob_index = blob_labeler_.findClosestBlob(search_center_,BLOB_AREA_MIN);
+      break;
     }
-    cv::waitKey(1);
+    case ALL_PIXELS:
+    {
+      break;
+    }
+  }
+  if (blob_index < 0)
+  {
+    return false;
   }
+
+  // weight pixels by contrast so the centroid moves smoothly between pixels
+  IntensityMoments moments;
+  blob_labeler_.computeIntensityMoments(background_(window),
+                                        image(window),
+                                        window.tl(),
+                                        blob_index,
+                                        moments);
+  computeTrackState(moments.weight,
+                    moments.sum_x,
+                    moments.sum_y,
+                    moments.sum_xx,
+                    moments.sum_yy,
+                    moments.sum_xy,
+                    track_state);
+  return true;
 }
 
-void ImageProcessor::showImageInWindow(const cv::String & winname, cv::Mat mat)
+void ImageProcessor::computeTrackState(const double weight,
+                                       const double sum_x,
+                                       const double sum_y,
+                                       const double sum_xx,
+                                       const double sum_yy,
+                                       const double sum_xy,
+                                       TrackState & track_state)
 {
-  if ((mat.cols != 0) && (mat.rows != 0))
+  double x = sum_x/weight;
+  double y = sum_y/weight;
+  track_state.position = cv::Point2d(x,y);
+
+  // orientation and axis ratio from the eigenvalues of the covariance
+  double mu20 = sum_xx/weight - x*x;
+  double mu02 = sum_yy/weight - y*y;
+  double mu11 = sum_xy/weight - x*y;
+  track_state.orientation = 0.5*atan2(2*mu11,mu20 - mu02);
+  double mean = (mu20 + mu02)/2;
+  double spread = sqrt(((mu20 - mu02)*(mu20 - mu02))/4 + mu11*mu11);
+  if ((mean - spread) > 0)
+  {
+    track_state.elongation = sqrt((mean + spread)/(mean - spread));
+  }
+  else
   {
-    cv::imshow(winname,mat);
+    track_state.elongation = 1;
   }
 }
 
-void ImageProcessor::trackbarThresholdHandler(int value, void * userdata)
+void ImageProcessor::findClickedLocation(cv::Mat image, TrackState & track_state)
 {
+  // clicks arrive from the display thread
+  cv::Point2d clicked_point;
+  if (display_worker_.getClickedPoint(clicked_point))
+  {
+    track_state.position = clicked_point;
+    track_state.found = true;
+  }
 }
 
-void ImageProcessor::mouseClickHandler(int event, int x, int y, int flags, void * userdata)
+void ImageProcessor::publishDisplaySnapshot(cv::Mat image)
 {
-  if(event != cv::EVENT_LBUTTONDOWN)
+  // copied only when the display thread has finished the last snapshot
+  if ((!show_ && !preview_) || !display_worker_.snapshotWanted())
   {
     return;
   }
-  tracked_image_point_.x = x;
-  tracked_image_point_.y = y;
-
-  std::cout << "Clicked point x: " << x << ", y: " << y << std::endl;
+  TraceSpan trace_span("publishDisplaySnapshot");
+  DisplaySnapshot & snapshot = display_worker_.getSnapshotBuffer();
+  image.copyTo(snapshot.image);
+  background_.copyTo(snapshot.background);
+  snapshot.image_count = image_count_;
+  snapshot.track_state = track_state_;
+  snapshot.tracking_window = cv::Rect();
+  if ((mode_ == BLOB) && (tracking_window_half_size_ > 0))
+  {
+    snapshot.tracking_window = tracking_window_;
+  }
+  snapshot.frame_rate = getFrameRate();
+  display_worker_.publishSnapshot();
 }
@@ -23,6 +23,14 @@
 
 #include <iostream>
 #include <sstream>
+#include <cmath>
+
+#include "ImageKernels.h"
+#include "BackgroundWorker.h"
+#include "DisplayWorker.h"
+#include "BlobLabeler.h"
+#include "TrackState.h"
+#include "Tracer.h"
 
 
 class ImageProcessor
@@ -36,8 +44,31 @@ public:
     MOUSE,
   };
   void setMode(Mode mode);
+
+  enum BackgroundMode
+  {
+    MOG2,
+    RUNNING_AVERAGE,
+  };
+  void setBackgroundMode(BackgroundMode background_mode);
+  void setBackgroundMasked(const bool background_masked);
+  enum BlobSelection
+  {
+    ALL_PIXELS,
+    LARGEST,
+    CLOSEST,
+  };
+  void setBlobSelection(BlobSelection blob_selection);
+  // search only a window around the last blob location, sized so a blob
+  // moving at max_velocity pixels per frame stays inside, 0 searches the
+  // full frame
+  void setTrackingWindow(const int max_velocity);
+  // where to center the next frame's search instead of the last position
+  void setSearchPrior(const cv::Point2d & search_prior);
   void show();
   void hide();
+  // POSIX shared memory name to publish a downscaled preview to
+  void setPreviewName(const std::string & preview_name);
 
   void enableGpu();
   void allocateMemory(unsigned char * const image_data_ptr,
@@ -46,41 +77,54 @@ public:
                       const unsigned int image_data_size);
 
   void update(cv::Mat image);
-  void getTrackedImagePoint(cv::Point & tracked_image_point);
+  void getTrackState(TrackState & track_state);
+  // when the last update finished the background and found the blob
+  void getStageTickCounts(int64 & background_tick_count,
+                          int64 & blob_tick_count);
+  unsigned long getFullFrameSearchCount();
 
 private:
   unsigned long image_count_;
   Mode mode_;
+  BackgroundMode background_mode_;
+  bool background_masked_;
   bool show_;
-  bool windows_;
+  bool preview_;
 
-  static cv::Point tracked_image_point_;
+  static TrackState track_state_;
+  int64 background_tick_count_;
+  int64 blob_tick_count_;
 
-  cv::Ptr<cv::BackgroundSubtractorMOG2> bg_sub_ptr_;
+  BackgroundWorker background_worker_;
+  unsigned long background_sample_image_count_;
   // cv::Ptr<cv::cuda::BackgroundSubtractorMOG2> bg_sub_ptr_g_;
-  static const size_t BACKGROUND_HISTORY = 200;
-  static const size_t BACKGROUND_VAR_THRESHOLD = 16;
-  static const bool BACKGROUND_DETECT_SHADOWS = false;
-  static const double BACKGROUND_LEARNING_RATE = 0.15;
   static const size_t BACKGROUND_DIVISOR = 400;
+  static const int BACKGROUND_AVERAGE_SHIFT = 7;
   static const double MAX_PIXEL_VALUE = 255;
 
+  BlobSelection blob_selection_;
+  BlobLabeler blob_labeler_;
+  static const int BLOB_AREA_MIN = 8;
+
+  static const int TRACKING_WINDOW_MARGIN = 32;
+  int tracking_window_half_size_;
+  cv::Rect tracking_window_;
+  cv::Point2d search_prior_;
+  bool search_prior_set_;
+  cv::Point2d search_center_;
+  unsigned long full_frame_search_count_;
+
   unsigned char * image_data_ptr_;
   cv::Size image_size_;
   int image_type_;
   unsigned int image_data_size_;
 
   cv::Mat background_;
-  cv::Mat foreground_mask_;
-  cv::Mat foreground_;
-  cv::Mat threshold_;
+  cv::Mat background_accumulator_;
 
   bool gpu_enabled_;
 
   unsigned char * background_data_ptr_;
-  unsigned char * foreground_data_ptr_;
-  unsigned char * foreground_mask_data_ptr_;
-  unsigned char * threshold_data_ptr_;
 
   cv::cuda::GpuMat image_g_;
   cv::cuda::GpuMat background_g_;
@@ -96,30 +140,29 @@ private:
   double frame_rate_;
   int64 frame_tick_count_prev_;
 
-  static const size_t DISPLAY_DIVISOR = 15;
-  static const int DISPLAY_MARKER_RADIUS = 10;
-  static const int DISPLAY_MARKER_THICKNESS = 2;
-
-  cv::Scalar blue_;
-  cv::Scalar yellow_;
-  cv::Scalar green_;
-  cv::Scalar red_;
-
-  cv::Point frame_rate_display_position_;
+  DisplayWorker display_worker_;
 
-  cv::Mat display_image_;
+  BlobMoments blob_moments_;
 
-  void createWindows();
-  void destroyWindows();
   void updateFrameRateMeasurement();
   void updateBackground(cv::Mat image);
+  void updateBackgroundMog2(cv::Mat image);
+  void updateBackgroundRunningAverage(cv::Mat image);
   double getFrameRate();
-  void findBlobLocation(cv::Mat image, cv::Point & location);
-  void findClickedLocation(cv::Mat image, cv::Point & location);
-  void displayImage(cv::Mat image);
-  void showImageInWindow(const cv::String & winname, cv::Mat mat);
-  static void trackbarThresholdHandler(int value, void * userdata);
-  static void mouseClickHandler(int event, int x, int y, int flags, void * userdata);
+  void findBlobLocation(cv::Mat image, TrackState & track_state);
+  void updateTrackingWindow(const TrackState & track_state);
+  bool findBlob(cv::Mat image,
+                const cv::Rect & window,
+                TrackState & track_state);
+  static void computeTrackState(const double weight,
+                                const double sum_x,
+                                const double sum_y,
+                                const double sum_xx,
+                                const double sum_yy,
+                                const double sum_xy,
+                                TrackState & track_state);
+  void findClickedLocation(cv::Mat image, TrackState & track_state);
+  void publishDisplaySnapshot(cv::Mat image);
 };
 
 #endif
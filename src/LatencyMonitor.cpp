@@ -0,0 +1,281 @@
+// ----------------------------------------------------------------------------
+// LatencyMonitor.cpp
+//
+//
+// Authors:
+// Peter Polidoro polidorop@janelia.hhmi.org
+// ----------------------------------------------------------------------------
+#include "LatencyMonitor.h"
+
+
+const char * LatencyMonitor::BOUNDARY_NAMES[BOUNDARY_COUNT] =
+{
+  "exposure",
+  "retrieve",
+  "background",
+  "blob",
+  "convert",
+  "write",
+  "ack",
+};
+
+// public
+LatencyMonitor::LatencyMonitor()
+{
+  for (unsigned long i=0; i<RING_SIZE; ++i)
+  {
+    for (int boundary=0; boundary<BOUNDARY_COUNT; ++boundary)
+    {
+      ring_[i].tick_counts[boundary] = 0;
+    }
+    ring_[i].state = 0;
+  }
+  next_record_id_ = 0;
+  drain_record_id_ = 0;
+  dropped_count_ = 0;
+
+  for (int stage=0; stage<STAGE_COUNT; ++stage)
+  {
+    histograms_[stage].bins.resize(HISTOGRAM_BIN_COUNT);
+  }
+  clearHistograms();
+
+  exposure_delay_floor_ = DBL_MAX;
+  exposure_delay_window_min_ = DBL_MAX;
+}
+
+unsigned long LatencyMonitor::begin(const double exposure_timestamp,
+                                    const int64 retrieve_tick_count)
+{
+  // give up on the oldest record rather than overwrite it while unfinished
+  if ((next_record_id_ - drain_record_id_) >= RING_SIZE)
+  {
+    if (drop_callback_)
+    {
+      drop_callback_(drain_record_id_);
+    }
+    ++drain_record_id_;
+    ++dropped_count_;
+  }
+
+  unsigned long record_id = next_record_id_++;
+  Record & record = ring_[record_id & (RING_SIZE - 1)];
+  // a late stamp for the dropped record may be writing, wait it out
+  unsigned long state = record.state.load(boost::memory_order_relaxed);
+  while ((state & STATE_BUSY) ||
+         !record.state.compare_exchange_weak(state,getState(record_id) | STATE_BUSY,boost::memory_order_acquire))
+  {
+    if (state & STATE_BUSY)
+    {
+      boost::this_thread::yield();
+      state = record.state.load(boost::memory_order_relaxed);
+    }
+  }
+  double tick_frequency = cv::getTickFrequency();
+  double exposure_delay = retrieve_tick_count/tick_frequency - exposure_timestamp;
+  record.tick_counts[EXPOSURE].store(retrieve_tick_count - (int64)(exposure_delay*tick_frequency),boost::memory_order_relaxed);
+  record.tick_counts[RETRIEVE].store(retrieve_tick_count,boost::memory_order_relaxed);
+  for (int boundary=BACKGROUND; boundary<BOUNDARY_COUNT; ++boundary)
+  {
+    record.tick_counts[boundary].store(0,boost::memory_order_relaxed);
+  }
+  record.state.store(getState(record_id),boost::memory_order_release);
+  return record_id;
+}
+
+void LatencyMonitor::stamp(const unsigned long record_id,
+                           const Boundary boundary,
+                           const int64 tick_count)
+{
+  Record & record = ring_[record_id & (RING_SIZE - 1)];
+  unsigned long state = getState(record_id);
+  if (!record.state.compare_exchange_strong(state,state | STATE_BUSY,boost::memory_order_acquire))
+  {
+    return;
+  }
+  record.tick_counts[boundary].store(tick_count,boost::memory_order_relaxed);
+  record.state.store(state,boost::memory_order_release);
+}
+
+int64 LatencyMonitor::getTickCount(const unsigned long record_id,
+                                   const Boundary boundary)
+{
+  const Record & record = ring_[record_id & (RING_SIZE - 1)];
+  int64 tick_count = record.tick_counts[boundary].load(boost::memory_order_relaxed);
+  if ((record.state.load(boost::memory_order_acquire) & ~STATE_FINISHED) != getState(record_id))
+  {
+    return 0;
+  }
+  return tick_count;
+}
+
+void LatencyMonitor::finish(const unsigned long record_id)
+{
+  Record & record = ring_[record_id & (RING_SIZE - 1)];
+  unsigned long state = getState(record_id);
+  record.state.compare_exchange_strong(state,state | STATE_FINISHED,boost::memory_order_release);
+}
+
+void LatencyMonitor::setDrainCallback(const DrainCallback & drain_callback)
+{
+  drain_callback_ = drain_callback;
+}
+
+void LatencyMonitor::setDropCallback(const DropCallback & drop_callback)
+{
+  drop_callback_ = drop_callback;
+}
+
+void LatencyMonitor::update()
+{
+  while (drain_record_id_ < next_record_id_)
+  {
+    const Record & record = ring_[drain_record_id_ & (RING_SIZE - 1)];
+    if (record.state.load(boost::memory_order_acquire) != (getState(drain_record_id_) | STATE_FINISHED))
+    {
+      break;
+    }
+    drain(drain_record_id_,record);
+    ++drain_record_id_;
+    if (++window_record_count_ >= REPORT_RECORD_COUNT)
+    {
+      report();
+    }
+  }
+}
+
+void LatencyMonitor::report()
+{
+  if (window_record_count_ == 0)
+  {
+    return;
+  }
+  std::cout << std::endl << "latency (ms) over " << window_record_count_ << " frames, ";
+  std::cout << histograms_[TOTAL_STAGE].count << " stage moves" << std::endl;
+  std::cout << std::setw(24) << std::left << "stage";
+  std::cout << std::setw(10) << std::right << "p50";
+  std::cout << std::setw(10) << "p99";
+  std::cout << std::setw(10) << "max" << std::endl;
+  std::ios::fmtflags flags = std::cout.flags();
+  std::cout << std::fixed << std::setprecision(3);
+  for (int stage=0; stage<STAGE_COUNT; ++stage)
+  {
+    const Histogram & histogram = histograms_[stage];
+    std::string name;
+    if (stage == TOTAL_STAGE)
+    {
+      name = std::string(BOUNDARY_NAMES[EXPOSURE]) + ">" + BOUNDARY_NAMES[SERIAL_ACK];
+    }
+    else
+    {
+      name = std::string(BOUNDARY_NAMES[stage]) + ">" + BOUNDARY_NAMES[stage + 1];
+    }
+    std::cout << std::setw(24) << std::left << name << std::right;
+    if (histogram.count == 0)
+    {
+      std::cout << std::setw(10) << "-" << std::setw(10) << "-" << std::setw(10) << "-" << std::endl;
+      continue;
+    }
+    std::cout << std::setw(10) << 1000*getPercentile(histogram,0.5);
+    std::cout << std::setw(10) << 1000*getPercentile(histogram,0.99);
+    std::cout << std::setw(10) << 1000*histogram.max << std::endl;
+  }
+  std::cout.flags(flags);
+  if (dropped_count_ > 0)
+  {
+    std::cout << "latency records dropped: " << dropped_count_ << std::endl;
+  }
+
+  clearHistograms();
+  if (exposure_delay_window_min_ < DBL_MAX)
+  {
+    exposure_delay_floor_ = exposure_delay_window_min_;
+  }
+  exposure_delay_window_min_ = DBL_MAX;
+}
+
+unsigned long LatencyMonitor::getDroppedCount()
+{
+  return dropped_count_;
+}
+
+// private
+void LatencyMonitor::drain(const unsigned long record_id,
+                           const Record & record)
+{
+  double tick_frequency = cv::getTickFrequency();
+  int64 tick_counts[BOUNDARY_COUNT];
+  for (int boundary=0; boundary<BOUNDARY_COUNT; ++boundary)
+  {
+    tick_counts[boundary] = record.tick_counts[boundary].load(boost::memory_order_relaxed);
+  }
+  if (drain_callback_)
+  {
+    drain_callback_(record_id,tick_counts);
+  }
+
+  double exposure_delay = (tick_counts[RETRIEVE] - tick_counts[EXPOSURE])/tick_frequency;
+  exposure_delay_window_min_ = std::min(exposure_delay_window_min_,exposure_delay);
+  exposure_delay_floor_ = std::min(exposure_delay_floor_,exposure_delay);
+  exposure_delay -= exposure_delay_floor_;
+  addSample(histograms_[EXPOSURE],exposure_delay);
+
+  // boundaries left at zero were never reached, moves the stage controller
+  // dropped have no write or acknowledge
+  for (int boundary=RETRIEVE; boundary<(BOUNDARY_COUNT - 1); ++boundary)
+  {
+    if ((tick_counts[boundary] == 0) || (tick_counts[boundary + 1] == 0))
+    {
+      continue;
+    }
+    addSample(histograms_[boundary],(tick_counts[boundary + 1] - tick_counts[boundary])/tick_frequency);
+  }
+  if (tick_counts[SERIAL_ACK] != 0)
+  {
+    addSample(histograms_[TOTAL_STAGE],exposure_delay + (tick_counts[SERIAL_ACK] - tick_counts[RETRIEVE])/tick_frequency);
+  }
+}
+
+unsigned long LatencyMonitor::getState(const unsigned long record_id)
+{
+  return record_id << STATE_ID_SHIFT;
+}
+
+void LatencyMonitor::clearHistograms()
+{
+  for (int stage=0; stage<STAGE_COUNT; ++stage)
+  {
+    Histogram & histogram = histograms_[stage];
+    std::fill(histogram.bins.begin(),histogram.bins.end(),0);
+    histogram.count = 0;
+    histogram.max = 0;
+  }
+  window_record_count_ = 0;
+}
+
+void LatencyMonitor::addSample(Histogram & histogram,
+                               const double duration)
+{
+  double bin = std::max(duration,0.0)/HISTOGRAM_BIN_DURATION;
+  size_t bin_index = (bin < HISTOGRAM_BIN_COUNT) ? (size_t)bin : (HISTOGRAM_BIN_COUNT - 1);
+  ++histogram.bins[bin_index];
+  ++histogram.count;
+  histogram.max = std::max(histogram.max,duration);
+}
+
+double LatencyMonitor::getPercentile(const Histogram & histogram,
+                                     const double fraction)
+{
+  // upper edge of the bin holding the sample at that rank
+  unsigned long rank = (unsigned long)ceil(fraction*histogram.count);
+  unsigned long cumulative_count = 0;
+  for (size_t i=0; i<histogram.bins.size(); ++i)
+  {
+    cumulative_count += histogram.bins[i];
+    if (cumulative_count >= rank)
+    {
+      return std::min((i + 1)*HISTOGRAM_BIN_DURATION,histogram.max);
+    }
+  }
+  return histogram.max;
+}
@@ -0,0 +1,130 @@
+// ----------------------------------------------------------------------------
+// LatencyMonitor.h
+//
+//
+// Authors:
+// Peter Polidoro polidorop@janelia.hhmi.org
+// ----------------------------------------------------------------------------
+#ifndef _LATENCY_MONITOR_H_
+#define _LATENCY_MONITOR_H_
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#include <opencv2/core.hpp>
+
+#include <boost/atomic.hpp>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+
+
+// Timestamps every processed frame at each boundary from exposure to the
+// stage acknowledging its move. The tracking loop begins a record and the
+// stage I/O thread finishes it, so records live in a ring indexed by record
+// id and are drained in order by the tracking loop into per stage latency
+// histograms that are reported and cleared every window.
+class LatencyMonitor
+{
+public:
+  LatencyMonitor();
+
+  enum Boundary
+  {
+    EXPOSURE,
+    RETRIEVE,
+    BACKGROUND,
+    BLOB,
+    CONVERT,
+    SERIAL_WRITE,
+    SERIAL_ACK,
+    BOUNDARY_COUNT,
+  };
+
+  // tracking thread, exposure_timestamp is in frame source seconds
+  unsigned long begin(const double exposure_timestamp,
+                      const int64 retrieve_tick_count);
+  // any thread, until the record is finished, ignored once the record was
+  // dropped and its slot reused
+  void stamp(const unsigned long record_id,
+             const Boundary boundary,
+             const int64 tick_count);
+  int64 getTickCount(const unsigned long record_id,
+                     const Boundary boundary);
+  void finish(const unsigned long record_id);
+
+  // power of two, a record unfinished after this many newer ones is dropped
+  static const unsigned long RING_SIZE = 256;
+
+  // called on the tracking thread for every finished record, in record
+  // order, with its tick counts indexed by Boundary
+  typedef boost::function<void (const unsigned long, const int64 *)> DrainCallback;
+  void setDrainCallback(const DrainCallback & drain_callback);
+  // called on the tracking thread with the id of every dropped record,
+  // which is never drained
+  typedef boost::function<void (const unsigned long)> DropCallback;
+  void setDropCallback(const DropCallback & drop_callback);
+
+  // tracking thread, drains finished records and reports every window
+  void update();
+  void report();
+  unsigned long getDroppedCount();
+
+private:
+  static const double HISTOGRAM_BIN_DURATION = 0.00001;
+  // the last bin also counts anything slower
+  static const size_t HISTOGRAM_BIN_COUNT = 10000;
+  static const unsigned long REPORT_RECORD_COUNT = 1000;
+  // each boundary to the next plus exposure to acknowledge
+  static const int STAGE_COUNT = BOUNDARY_COUNT;
+  static const int TOTAL_STAGE = BOUNDARY_COUNT - 1;
+  static const char * BOUNDARY_NAMES[BOUNDARY_COUNT];
+
+  // record id shifted left past the flags, so a late stamp or finish for a
+  // dropped record can tell its slot now belongs to a newer one
+  static const unsigned long STATE_FINISHED = 1;
+  // a stamp is writing, the slot may not be reused until it is done
+  static const unsigned long STATE_BUSY = 2;
+  static const int STATE_ID_SHIFT = 2;
+
+  struct Record
+  {
+    boost::atomic<int64> tick_counts[BOUNDARY_COUNT];
+    boost::atomic<unsigned long> state;
+  };
+  Record ring_[RING_SIZE];
+  unsigned long next_record_id_;
+  unsigned long drain_record_id_;
+  unsigned long dropped_count_;
+  DrainCallback drain_callback_;
+  DropCallback drop_callback_;
+
+  struct Histogram
+  {
+    std::vector<unsigned long> bins;
+    unsigned long count;
+    double max;
+  };
+  Histogram histograms_[STAGE_COUNT];
+  unsigned long window_record_count_;
+
+  // camera and host clocks are not synchronized, so exposure to retrieve is
+  // measured above the smallest delay seen, restarted every window to follow
+  // clock drift
+  double exposure_delay_floor_;
+  double exposure_delay_window_min_;
+
+  void drain(const unsigned long record_id,
+             const Record & record);
+  static unsigned long getState(const unsigned long record_id);
+  void clearHistograms();
+  static void addSample(Histogram & histogram,
+                        const double duration);
+  static double getPercentile(const Histogram & histogram,
+                              const double fraction);
+};
+
+#endif
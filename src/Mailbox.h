@@ -0,0 +1,76 @@
+// ----------------------------------------------------------------------------
+// Mailbox.h
+//
+//
+// Authors:
+// Peter Polidoro polidorop@janelia.hhmi.org
+// ----------------------------------------------------------------------------
+#ifndef _MAILBOX_H_
+#define _MAILBOX_H_
+#include <boost/atomic.hpp>
+#include <boost/noncopyable.hpp>
+
+
+// Lock-free latest value mailbox for one writer thread and one reader thread,
+// implemented as a triple buffer. The writer fills its buffer and publishes
+// it with an atomic swap, the reader swaps in the newest published buffer.
+// Neither side ever waits and each owns its buffer until its next swap.
+template <typename T>
+class Mailbox : private boost::noncopyable
+{
+public:
+  Mailbox()
+  {
+    write_index_ = 0;
+    middle_ = 1;
+    read_index_ = 2;
+  }
+
+  // writer
+  T & getWriteBuffer()
+  {
+    return buffers_[write_index_];
+  }
+
+  void publish()
+  {
+    int middle = middle_.exchange(write_index_ | FRESH,boost::memory_order_acq_rel);
+    write_index_ = middle & INDEX_MASK;
+  }
+
+  // reader, returns true when a value newer than the read buffer was swapped in
+  bool update()
+  {
+    if ((middle_.load(boost::memory_order_relaxed) & FRESH) == 0)
+    {
+      return false;
+    }
+    int middle = middle_.exchange(read_index_,boost::memory_order_acq_rel);
+    read_index_ = middle & INDEX_MASK;
+    return true;
+  }
+
+  T & getReadBuffer()
+  {
+    return buffers_[read_index_];
+  }
+
+  // only safe before the writer and reader threads start
+  T & getBuffer(const int index)
+  {
+    return buffers_[index];
+  }
+
+  static const int BUFFER_COUNT = 3;
+
+private:
+  static const int INDEX_MASK = 0x3;
+  static const int FRESH = 0x4;
+
+  T buffers_[BUFFER_COUNT];
+  int write_index_;
+  boost::atomic<int> middle_;
+  int read_index_;
+};
+
+#endif
@@ -8,6 +8,7 @@
 #include <iostream>
 
 #include "ZebrafishTracker.h"
+#include "Tracer.h"
 
 
 int main(int argc, char * argv[])
@@ -25,6 +26,21 @@ int main(int argc, char * argv[])
     return EXIT_FAILURE;
   }
 
+  if (zebrafish_tracker.benchmarking())
+  {
+    try
+    {
+      zebrafish_tracker.benchmark();
+    }
+    catch (const std::exception & e)
+    {
+      std::cerr << e.what() << std::endl;
+      std::cerr << std::endl << "Exception occurred while benchmarking." << std::endl << std::endl;
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+  }
+
   try
   {
     zebrafish_tracker.connectHardware();
@@ -38,34 +54,35 @@ int main(int argc, char * argv[])
 
   try
   {
-    zebrafish_tracker.findCalibration();
+    zebrafish_tracker.enableGpu();
   }
   catch (const std::exception & e)
   {
     std::cerr << e.what() << std::endl;
-    std::cerr << std::endl << "Unable to find calibration." << std::endl << std::endl;
+    std::cerr << std::endl << "Unable to enable GPU." << std::endl << std::endl;
     return EXIT_FAILURE;
   }
 
   try
   {
-    zebrafish_tracker.enableGpu();
+    zebrafish_tracker.allocateMemory();
   }
   catch (const std::exception & e)
   {
     std::cerr << e.what() << std::endl;
-    std::cerr << std::endl << "Unable to enable GPU." << std::endl << std::endl;
+    std::cerr << std::endl << "Unable to allocate memory." << std::endl << std::endl;
     return EXIT_FAILURE;
   }
 
+  // recalibration grabs frames, so the frame source needs its memory
   try
   {
-    zebrafish_tracker.allocateMemory();
+    zebrafish_tracker.findCalibration();
   }
   catch (const std::exception & e)
   {
     std::cerr << e.what() << std::endl;
-    std::cerr << std::endl << "Unable to allocate memory." << std::endl << std::endl;
+    std::cerr << std::endl << "Unable to find calibration." << std::endl << std::endl;
     return EXIT_FAILURE;
   }
 
@@ -78,6 +95,8 @@ int main(int argc, char * argv[])
   {
     std::cerr << e.what() << std::endl;
     std::cerr << std::endl << "Exception occurred while running." << std::endl << std::endl;
+    // the trace leading up to the exception is the one worth keeping
+    Tracer::dump();
     return EXIT_FAILURE;
   }
 
@@ -0,0 +1,129 @@
+// ----------------------------------------------------------------------------
+// MotionPredictor.cpp
+//
+//
+// Authors:
+// Peter Polidoro polidorop@janelia.hhmi.org
+// ----------------------------------------------------------------------------
+#include "MotionPredictor.h"
+
+
+// public
+MotionPredictor::MotionPredictor()
+{
+  reset();
+}
+
+void MotionPredictor::reset()
+{
+  initialized_ = false;
+  time_ = 0;
+  found_time_ = 0;
+  frame_period_ = 0;
+}
+
+void MotionPredictor::update(const TrackState & track_state,
+                             const double time)
+{
+  if (!initialized_)
+  {
+    if (track_state.found)
+    {
+      initializeAxis(x_,track_state.position.x);
+      initializeAxis(y_,track_state.position.y);
+      time_ = time;
+      found_time_ = time;
+      initialized_ = true;
+    }
+    return;
+  }
+
+  double dt = time - time_;
+  if (dt <= 0)
+  {
+    return;
+  }
+  if (frame_period_ > 0)
+  {
+    frame_period_ += FRAME_PERIOD_ALPHA*(dt - frame_period_);
+  }
+  else
+  {
+    frame_period_ = dt;
+  }
+  time_ = time;
+
+  predictAxis(x_,dt);
+  predictAxis(y_,dt);
+  if (track_state.found)
+  {
+    correctAxis(x_,track_state.position.x);
+    correctAxis(y_,track_state.position.y);
+    found_time_ = time;
+  }
+  else if ((time - found_time_) > LOST_DURATION_MAX)
+  {
+    // do not let a lost fish fly off along its last velocity
+    reset();
+  }
+}
+
+bool MotionPredictor::initialized()
+{
+  return initialized_;
+}
+
+cv::Point2d MotionPredictor::predictPosition(const double time)
+{
+  double lead = std::min(std::max(time - time_,0.0),LEAD_MAX);
+  return cv::Point2d(x_.position + x_.velocity*lead,
+                     y_.position + y_.velocity*lead);
+}
+
+cv::Point2d MotionPredictor::getVelocity()
+{
+  return cv::Point2d(x_.velocity,y_.velocity);
+}
+
+double MotionPredictor::getFramePeriod()
+{
+  return frame_period_;
+}
+
+// private
+void MotionPredictor::initializeAxis(AxisState & axis_state,
+                                     const double position)
+{
+  axis_state.position = position;
+  axis_state.velocity = 0;
+  axis_state.p00 = MEASUREMENT_NOISE*MEASUREMENT_NOISE;
+  axis_state.p01 = 0;
+  axis_state.p11 = VELOCITY_VARIANCE_INITIAL;
+}
+
+void MotionPredictor::predictAxis(AxisState & axis_state,
+                                  const double dt)
+{
+  // P = F P F' + Q with F = [1 dt; 0 1] and discrete white noise
+  // acceleration Q = q [dt^4/4 dt^3/2; dt^3/2 dt^2]
+  double q = ACCELERATION_NOISE*ACCELERATION_NOISE;
+  double dt2 = dt*dt;
+  axis_state.position += axis_state.velocity*dt;
+  axis_state.p00 += 2*dt*axis_state.p01 + dt2*axis_state.p11 + q*dt2*dt2/4;
+  axis_state.p01 += dt*axis_state.p11 + q*dt2*dt/2;
+  axis_state.p11 += q*dt2;
+}
+
+void MotionPredictor::correctAxis(AxisState & axis_state,
+                                  const double measurement)
+{
+  double s = axis_state.p00 + MEASUREMENT_NOISE*MEASUREMENT_NOISE;
+  double k0 = axis_state.p00/s;
+  double k1 = axis_state.p01/s;
+  double innovation = measurement - axis_state.position;
+  axis_state.position += k0*innovation;
+  axis_state.velocity += k1*innovation;
+  axis_state.p11 -= k1*axis_state.p01;
+  axis_state.p00 *= (1 - k0);
+  axis_state.p01 *= (1 - k0);
+}
@@ -0,0 +1,72 @@
+// ----------------------------------------------------------------------------
+// MotionPredictor.h
+//
+//
+// Authors:
+// Peter Polidoro polidorop@janelia.hhmi.org
+// ----------------------------------------------------------------------------
+#ifndef _MOTION_PREDICTOR_H_
+#define _MOTION_PREDICTOR_H_
+#include <algorithm>
+
+#include <opencv2/core.hpp>
+
+#include "TrackState.h"
+
+
+// Constant velocity Kalman filter over the tracked image position, one
+// independent position and velocity filter per axis. Frames may arrive at
+// irregular intervals, so every step uses the real time between them.
+class MotionPredictor
+{
+public:
+  MotionPredictor();
+
+  void reset();
+  // time in seconds, lost frames only advance the prediction
+  void update(const TrackState & track_state,
+              const double time);
+  bool initialized();
+
+  // extrapolated at most LEAD_MAX past the last update
+  cv::Point2d predictPosition(const double time);
+  cv::Point2d getVelocity();
+  // smoothed time between updates
+  double getFramePeriod();
+
+private:
+  // white noise acceleration, pixels per second squared
+  static const double ACCELERATION_NOISE = 2000;
+  // centroid noise, pixels
+  static const double MEASUREMENT_NOISE = 0.5;
+  // velocity is unknown when the first position is measured
+  static const double VELOCITY_VARIANCE_INITIAL = 1000000;
+  static const double LEAD_MAX = 0.1;
+  static const double LOST_DURATION_MAX = 0.5;
+  static const double FRAME_PERIOD_ALPHA = 0.05;
+
+  struct AxisState
+  {
+    double position;
+    double velocity;
+    double p00;
+    double p01;
+    double p11;
+  };
+
+  AxisState x_;
+  AxisState y_;
+  double time_;
+  double found_time_;
+  double frame_period_;
+  bool initialized_;
+
+  static void initializeAxis(AxisState & axis_state,
+                             const double position);
+  static void predictAxis(AxisState & axis_state,
+                          const double dt);
+  static void correctAxis(AxisState & axis_state,
+                          const double measurement);
+};
+
+#endif
@@ -0,0 +1,51 @@
+// ----------------------------------------------------------------------------
+// PreviewLayout.cpp
+//
+//
+// Authors:
+// Peter Polidoro polidorop@janelia.hhmi.org
+// ----------------------------------------------------------------------------
+#include "PreviewLayout.h"
+
+
+// public
+size_t PreviewLayout::getHeaderSize()
+{
+  return align(sizeof(Header));
+}
+
+size_t PreviewLayout::getSlotSize(const size_t width,
+                                  const size_t height)
+{
+  return getThresholdOffset(width,height) + align(width*height);
+}
+
+size_t PreviewLayout::getSize(const size_t width,
+                              const size_t height)
+{
+  return getHeaderSize() + SLOT_COUNT*getSlotSize(width,height);
+}
+
+size_t PreviewLayout::getSlotOffset(const size_t width,
+                                    const size_t height,
+                                    const size_t slot_index)
+{
+  return getHeaderSize() + slot_index*getSlotSize(width,height);
+}
+
+size_t PreviewLayout::getImageOffset()
+{
+  return align(sizeof(SlotHeader));
+}
+
+size_t PreviewLayout::getThresholdOffset(const size_t width,
+                                         const size_t height)
+{
+  return getImageOffset() + align(width*height);
+}
+
+// private
+size_t PreviewLayout::align(const size_t size)
+{
+  return ((size + ALIGNMENT - 1)/ALIGNMENT)*ALIGNMENT;
+}
@@ -0,0 +1,79 @@
+// ----------------------------------------------------------------------------
+// PreviewLayout.h
+//
+//
+// Authors:
+// Peter Polidoro polidorop@janelia.hhmi.org
+// ----------------------------------------------------------------------------
+#ifndef _PREVIEW_LAYOUT_H_
+#define _PREVIEW_LAYOUT_H_
+#include <cstddef>
+
+#include <boost/cstdint.hpp>
+#include <boost/atomic.hpp>
+
+
+// Shared memory layout written by PreviewPublisher and read by
+// ZebrafishPreview: a header followed by a ring of slots, each a slot header,
+// the downscaled image and the downscaled threshold mask.
+//
+// Every slot is guarded by a seqlock. The writer makes the sequence odd
+// while it writes the slot and even again when done. A reader copies the
+// slot and keeps the copy only if the sequence was even and unchanged, so
+// readers never block the writer and can attach and detach at any time.
+class PreviewLayout
+{
+public:
+  static const boost::uint32_t MAGIC = 0x5a465056;
+  static const boost::uint32_t VERSION = 1;
+  static const boost::uint32_t SLOT_COUNT = 4;
+  static const size_t ALIGNMENT = 64;
+
+  struct Header
+  {
+    boost::uint32_t magic;
+    boost::uint32_t version;
+    boost::uint32_t width;
+    boost::uint32_t height;
+    // full resolution pixels per preview pixel
+    boost::uint32_t scale;
+    boost::uint32_t slot_count;
+    boost::uint32_t slot_size;
+    // slots ever published, the newest is (publish_count - 1) % slot_count
+    boost::atomic<boost::uint32_t> publish_count;
+  };
+
+  // track coordinates are in preview pixels
+  struct SlotHeader
+  {
+    boost::atomic<boost::uint32_t> sequence;
+    boost::uint32_t found;
+    boost::uint64_t image_count;
+    double track_x;
+    double track_y;
+    double orientation;
+    double frame_rate;
+    boost::int32_t window_x;
+    boost::int32_t window_y;
+    boost::int32_t window_width;
+    boost::int32_t window_height;
+  };
+
+  static size_t getHeaderSize();
+  static size_t getSlotSize(const size_t width,
+                            const size_t height);
+  static size_t getSize(const size_t width,
+                        const size_t height);
+  static size_t getSlotOffset(const size_t width,
+                              const size_t height,
+                              const size_t slot_index);
+  // from the start of a slot
+  static size_t getImageOffset();
+  static size_t getThresholdOffset(const size_t width,
+                                   const size_t height);
+
+private:
+  static size_t align(const size_t size);
+};
+
+#endif
@@ -0,0 +1,152 @@
+// ----------------------------------------------------------------------------
+// PreviewPublisher.cpp
+//
+//
+// Authors:
+// Peter Polidoro polidorop@janelia.hhmi.org
+// ----------------------------------------------------------------------------
+#include "PreviewPublisher.h"
+
+
+// public
+PreviewPublisher::PreviewPublisher()
+{
+  fd_ = -1;
+  data_ptr_ = NULL;
+  size_ = 0;
+  header_ptr_ = NULL;
+  scale_ = 1;
+  publish_count_ = 0;
+}
+
+PreviewPublisher::~PreviewPublisher()
+{
+  close();
+}
+
+void PreviewPublisher::setName(const std::string & name)
+{
+  name_ = name;
+}
+
+bool PreviewPublisher::enabled()
+{
+  return !name_.empty();
+}
+
+void PreviewPublisher::publish(const DisplaySnapshot & snapshot,
+                               const cv::Mat & threshold)
+{
+  if (!enabled() || snapshot.image.empty())
+  {
+    return;
+  }
+  if (!data_ptr_ || (snapshot.image.size() != image_size_))
+  {
+    open(snapshot.image.size());
+    if (!data_ptr_)
+    {
+      return;
+    }
+  }
+
+  size_t width = preview_size_.width;
+  size_t height = preview_size_.height;
+  size_t slot_index = publish_count_ % PreviewLayout::SLOT_COUNT;
+  unsigned char * slot_ptr = data_ptr_ + PreviewLayout::getSlotOffset(width,height,slot_index);
+  PreviewLayout::SlotHeader * slot_header_ptr = (PreviewLayout::SlotHeader *)slot_ptr;
+
+  boost::uint32_t sequence = slot_header_ptr->sequence.load(boost::memory_order_relaxed);
+  slot_header_ptr->sequence.store(sequence + 1,boost::memory_order_relaxed);
+  boost::atomic_thread_fence(boost::memory_order_release);
+
+  const TrackState & track_state = snapshot.track_state;
+  slot_header_ptr->found = track_state.found;
+  slot_header_ptr->image_count = snapshot.image_count;
+  slot_header_ptr->track_x = track_state.position.x/scale_;
+  slot_header_ptr->track_y = track_state.position.y/scale_;
+  slot_header_ptr->orientation = track_state.orientation;
+  slot_header_ptr->frame_rate = snapshot.frame_rate;
+  slot_header_ptr->window_x = snapshot.tracking_window.x/scale_;
+  slot_header_ptr->window_y = snapshot.tracking_window.y/scale_;
+  slot_header_ptr->window_width = snapshot.tracking_window.width/scale_;
+  slot_header_ptr->window_height = snapshot.tracking_window.height/scale_;
+
+  // downscale straight into the shared slot
+  cv::Mat image(preview_size_,CV_8UC1,slot_ptr + PreviewLayout::getImageOffset());
+  cv::resize(snapshot.image,image,preview_size_,0,0,cv::INTER_AREA);
+  cv::Mat threshold_image(preview_size_,CV_8UC1,slot_ptr + PreviewLayout::getThresholdOffset(width,height));
+  if (threshold.empty())
+  {
+    threshold_image.setTo(0);
+  }
+  else
+  {
+    // nearest keeps the mask binary
+    cv::resize(threshold,threshold_image,preview_size_,0,0,cv::INTER_NEAREST);
+  }
+
+  slot_header_ptr->sequence.store(sequence + 2,boost::memory_order_release);
+  header_ptr_->publish_count.store(++publish_count_,boost::memory_order_release);
+}
+
+void PreviewPublisher::close()
+{
+  if (data_ptr_)
+  {
+    munmap(data_ptr_,size_);
+    data_ptr_ = NULL;
+    header_ptr_ = NULL;
+  }
+  if (fd_ >= 0)
+  {
+    ::close(fd_);
+    fd_ = -1;
+    shm_unlink(name_.c_str());
+  }
+}
+
+// private
+void PreviewPublisher::open(const cv::Size & image_size)
+{
+  close();
+
+  image_size_ = image_size;
+  scale_ = (image_size.width + WIDTH_MAX - 1)/WIDTH_MAX;
+  preview_size_ = cv::Size(image_size.width/scale_,image_size.height/scale_);
+  size_ = PreviewLayout::getSize(preview_size_.width,preview_size_.height);
+
+  fd_ = shm_open(name_.c_str(),O_CREAT | O_RDWR,0644);
+  if ((fd_ < 0) || (ftruncate(fd_,size_) != 0))
+  {
+    std::cerr << "Unable to create preview shared memory " << name_ << ", preview disabled." << std::endl;
+    close();
+    name_.clear();
+    return;
+  }
+  void * data_ptr = mmap(NULL,size_,PROT_READ | PROT_WRITE,MAP_SHARED,fd_,0);
+  if (data_ptr == MAP_FAILED)
+  {
+    std::cerr << "Unable to map preview shared memory " << name_ << ", preview disabled." << std::endl;
+    close();
+    name_.clear();
+    return;
+  }
+  data_ptr_ = (unsigned char *)data_ptr;
+  memset(data_ptr_,0,size_);
+
+  header_ptr_ = (PreviewLayout::Header *)data_ptr_;
+  header_ptr_->width = preview_size_.width;
+  header_ptr_->height = preview_size_.height;
+  header_ptr_->scale = scale_;
+  header_ptr_->slot_count = PreviewLayout::SLOT_COUNT;
+  header_ptr_->slot_size = PreviewLayout::getSlotSize(preview_size_.width,preview_size_.height);
+  header_ptr_->version = PreviewLayout::VERSION;
+  publish_count_ = 0;
+  header_ptr_->publish_count.store(0,boost::memory_order_relaxed);
+  // readers check the magic last
+  boost::atomic_thread_fence(boost::memory_order_release);
+  header_ptr_->magic = PreviewLayout::MAGIC;
+
+  std::cout << std::endl << "Preview published to " << name_ << " " << preview_size_.width << "x" << preview_size_.height << std::endl;
+}
@@ -0,0 +1,63 @@
+// ----------------------------------------------------------------------------
+// PreviewPublisher.h
+//
+//
+// Authors:
+// Peter Polidoro polidorop@janelia.hhmi.org
+// ----------------------------------------------------------------------------
+#ifndef _PREVIEW_PUBLISHER_H_
+#define _PREVIEW_PUBLISHER_H_
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <boost/atomic.hpp>
+
+#include "DisplaySnapshot.h"
+#include "PreviewLayout.h"
+
+
+// Publishes downscaled snapshots and threshold masks into a POSIX shared
+// memory ring for ZebrafishPreview, so headless rigs can still be watched.
+// Runs on the display thread and never waits on a viewer.
+class PreviewPublisher
+{
+public:
+  PreviewPublisher();
+  ~PreviewPublisher();
+
+  // POSIX shared memory name, like /zebrafish_preview
+  void setName(const std::string & name);
+  bool enabled();
+
+  // display thread, maps the ring on the first snapshot, threshold may be
+  // empty before there is a background
+  void publish(const DisplaySnapshot & snapshot,
+               const cv::Mat & threshold);
+  // unlinks the name, viewers keep their mapping until they detach
+  void close();
+
+private:
+  static const int WIDTH_MAX = 640;
+
+  std::string name_;
+  int fd_;
+  unsigned char * data_ptr_;
+  size_t size_;
+  PreviewLayout::Header * header_ptr_;
+  cv::Size image_size_;
+  int scale_;
+  cv::Size preview_size_;
+  boost::uint32_t publish_count_;
+
+  void open(const cv::Size & image_size);
+};
+
+#endif
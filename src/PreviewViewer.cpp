@@ -0,0 +1,221 @@
+// ----------------------------------------------------------------------------
+// PreviewViewer.cpp
+//
+//
+// Authors:
+// Peter Polidoro polidorop@janelia.hhmi.org
+// ----------------------------------------------------------------------------
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/highgui.hpp>
+
+#include <boost/atomic.hpp>
+
+#include "PreviewLayout.h"
+
+
+// Watches the preview a headless ZebrafishTracker publishes with --preview.
+// Attaching and detaching never affects the tracker.
+static const int UI_PERIOD = 33;
+// reattach when nothing new arrives, the tracker may have restarted
+static const int STALE_PERIOD_COUNT = 60;
+static const int READ_ATTEMPTS_MAX = 4;
+static const int DISPLAY_MARKER_RADIUS = 5;
+static const int DISPLAY_MARKER_THICKNESS = 1;
+static const int DISPLAY_ORIENTATION_LENGTH = 15;
+
+struct Preview
+{
+  int fd;
+  unsigned char * data_ptr;
+  size_t size;
+  const PreviewLayout::Header * header_ptr;
+};
+
+static bool attach(const std::string & name, Preview & preview)
+{
+  preview.fd = shm_open(name.c_str(),O_RDONLY,0);
+  if (preview.fd < 0)
+  {
+    return false;
+  }
+  struct stat status;
+  if ((fstat(preview.fd,&status) != 0) || ((size_t)status.st_size < PreviewLayout::getHeaderSize()))
+  {
+    close(preview.fd);
+    return false;
+  }
+  preview.size = status.st_size;
+  void * data_ptr = mmap(NULL,preview.size,PROT_READ,MAP_SHARED,preview.fd,0);
+  if (data_ptr == MAP_FAILED)
+  {
+    close(preview.fd);
+    return false;
+  }
+  preview.data_ptr = (unsigned char *)data_ptr;
+  preview.header_ptr = (const PreviewLayout::Header *)data_ptr;
+  // slot_count is used as a modulus and slot_size to find the slots, so the
+  // header is checked against this build's layout and the mapped size
+  const PreviewLayout::Header & header = *preview.header_ptr;
+  if ((header.magic != PreviewLayout::MAGIC) ||
+      (header.version != PreviewLayout::VERSION) ||
+      (header.slot_count == 0) ||
+      (header.slot_count != PreviewLayout::SLOT_COUNT) ||
+      (header.slot_size != PreviewLayout::getSlotSize(header.width,header.height)) ||
+      (PreviewLayout::getSize(header.width,header.height) > preview.size))
+  {
+    munmap(preview.data_ptr,preview.size);
+    close(preview.fd);
+    return false;
+  }
+  return true;
+}
+
+static void detach(Preview & preview)
+{
+  munmap(preview.data_ptr,preview.size);
+  close(preview.fd);
+}
+
+// copies the slot out, false if the tracker was writing it meanwhile
+static bool readSlot(const Preview & preview,
+                     const size_t slot_index,
+                     PreviewLayout::SlotHeader & slot_header,
+                     cv::Mat & image,
+                     cv::Mat & threshold)
+{
+  const PreviewLayout::Header & header = *preview.header_ptr;
+  const unsigned char * slot_ptr = preview.data_ptr + PreviewLayout::getSlotOffset(header.width,header.height,slot_index);
+  PreviewLayout::SlotHeader * shared_slot_header_ptr = (PreviewLayout::SlotHeader *)slot_ptr;
+
+  boost::uint32_t sequence = shared_slot_header_ptr->sequence.load(boost::memory_order_acquire);
+  if (sequence & 1)
+  {
+    return false;
+  }
+  memcpy((unsigned char *)&slot_header + sizeof(slot_header.sequence),
+         slot_ptr + sizeof(slot_header.sequence),
+         sizeof(slot_header) - sizeof(slot_header.sequence));
+  cv::Size size(header.width,header.height);
+  cv::Mat(size,CV_8UC1,(void *)(slot_ptr + PreviewLayout::getImageOffset())).copyTo(image);
+  cv::Mat(size,CV_8UC1,(void *)(slot_ptr + PreviewLayout::getThresholdOffset(header.width,header.height))).copyTo(threshold);
+  boost::atomic_thread_fence(boost::memory_order_acquire);
+  return (shared_slot_header_ptr->sequence.load(boost::memory_order_relaxed) == sequence);
+}
+
+static void drawOverlay(const PreviewLayout::SlotHeader & slot_header,
+                        const cv::Mat & image,
+                        cv::Mat & display_image)
+{
+  cv::Scalar yellow(0,255,255);
+  cv::Scalar green(0,255,0);
+  cv::Scalar red(0,0,255);
+  cv::cvtColor(image,display_image,cv::COLOR_GRAY2BGR);
+  cv::Rect window(slot_header.window_x,slot_header.window_y,slot_header.window_width,slot_header.window_height);
+  if (window.area() > 0)
+  {
+    cv::rectangle(display_image,window,green,DISPLAY_MARKER_THICKNESS);
+  }
+  cv::Point track_point(cvRound(slot_header.track_x),cvRound(slot_header.track_y));
+  cv::circle(display_image,track_point,DISPLAY_MARKER_RADIUS,red,DISPLAY_MARKER_THICKNESS);
+  if (slot_header.found)
+  {
+    cv::Point orientation_offset(cvRound(DISPLAY_ORIENTATION_LENGTH*cos(slot_header.orientation)),
+                                 cvRound(DISPLAY_ORIENTATION_LENGTH*sin(slot_header.orientation)));
+    cv::line(display_image,track_point - orientation_offset,track_point + orientation_offset,yellow,DISPLAY_MARKER_THICKNESS);
+  }
+  std::stringstream status_ss;
+  status_ss << "Frame: " << slot_header.image_count << " Frame rate: " << slot_header.frame_rate;
+  cv::putText(display_image,status_ss.str(),cv::Point(10,20),cv::FONT_HERSHEY_SIMPLEX,0.5,yellow,1);
+}
+
+int main(int argc, char * argv[])
+{
+  const cv::String keys =
+    "{help h usage ?  |                                   | Print usage and exit.                              }"
+    "{@name           | /zebrafish_preview                | Shared memory name the tracker publishes to.       }"
+    ;
+  cv::CommandLineParser parser(argc,argv,keys);
+  if (parser.has("help"))
+  {
+    parser.printMessage();
+    return EXIT_SUCCESS;
+  }
+  std::string name = parser.get<cv::String>("@name");
+
+  cv::namedWindow("Preview",cv::WINDOW_NORMAL);
+  cv::namedWindow("Threshold",cv::WINDOW_NORMAL);
+
+  Preview preview;
+  bool attached = false;
+  boost::uint32_t publish_count_prev = 0;
+  int stale_period_count = 0;
+  PreviewLayout::SlotHeader slot_header;
+  cv::Mat image;
+  cv::Mat threshold;
+  cv::Mat display_image;
+  while (true)
+  {
+    int key = cv::waitKey(UI_PERIOD);
+    if ((key == 'q') || (key == 27))
+    {
+      break;
+    }
+    if (!attached)
+    {
+      attached = attach(name,preview);
+      if (!attached)
+      {
+        continue;
+      }
+      std::cout << "Attached to " << name << " " << preview.header_ptr->width << "x" << preview.header_ptr->height << std::endl;
+      publish_count_prev = 0;
+      stale_period_count = 0;
+    }
+
+    boost::uint32_t publish_count = preview.header_ptr->publish_count.load(boost::memory_order_acquire);
+    if (publish_count == publish_count_prev)
+    {
+      if (++stale_period_count >= STALE_PERIOD_COUNT)
+      {
+        detach(preview);
+        attached = false;
+      }
+      continue;
+    }
+    stale_period_count = 0;
+    publish_count_prev = publish_count;
+
+    // the newest slot, falling back to older ones while it is rewritten
+    bool read = false;
+    for (int attempt=0; (attempt<READ_ATTEMPTS_MAX) && ((boost::uint32_t)attempt<publish_count) && !read; ++attempt)
+    {
+      size_t slot_index = (publish_count - 1 - attempt) % preview.header_ptr->slot_count;
+      read = readSlot(preview,slot_index,slot_header,image,threshold);
+    }
+    if (!read)
+    {
+      continue;
+    }
+    drawOverlay(slot_header,image,display_image);
+    cv::imshow("Preview",display_image);
+    cv::imshow("Threshold",threshold);
+  }
+
+  if (attached)
+  {
+    detach(preview);
+  }
+  return EXIT_SUCCESS;
+}
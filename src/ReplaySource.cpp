@@ -0,0 +1,239 @@
+// ----------------------------------------------------------------------------
+// ReplaySource.cpp
+//
+//
+// Authors:
+// Peter Polidoro polidorop@janelia.hhmi.org
+// ----------------------------------------------------------------------------
+#include "ReplaySource.h"
+
+
+// public
+ReplaySource::ReplaySource()
+{
+  frame_rate_ = FRAME_RATE_DEFAULT;
+  loop_ = false;
+  preload_ = false;
+  end_of_stream_ = false;
+  frame_index_ = 0;
+  image_type_ = CV_8UC1;
+  image_data_size_ = 0;
+}
+
+void ReplaySource::setPath(const cv::String & path)
+{
+  path_ = boost::filesystem::path(path);
+}
+
+void ReplaySource::setFrameRate(const double frame_rate)
+{
+  frame_rate_ = frame_rate;
+}
+
+void ReplaySource::setLoop(const bool loop)
+{
+  loop_ = loop;
+}
+
+void ReplaySource::setPreload(const bool preload)
+{
+  preload_ = preload;
+}
+
+void ReplaySource::connect()
+{
+  image_paths_.clear();
+  if (boost::filesystem::is_directory(path_))
+  {
+    boost::filesystem::directory_iterator end;
+    for (boost::filesystem::directory_iterator it(path_); it != end; ++it)
+    {
+      if (boost::filesystem::is_regular_file(it->status()) &&
+          (it->path().extension() == ".png"))
+      {
+        image_paths_.push_back(it->path());
+      }
+    }
+    std::sort(image_paths_.begin(),image_paths_.end());
+    if (image_paths_.size() == 0)
+    {
+      std::cerr << std::endl << "No png images found in " << path_ << "!" << std::endl;
+      throw std::runtime_error("Replay directory contains no images.");
+    }
+    std::cout << std::endl << "Replaying " << image_paths_.size() << " images from " << path_ << std::endl;
+  }
+  else
+  {
+    if (!video_capture_.open(path_.string()))
+    {
+      std::cerr << std::endl << "Unable to open " << path_ << "!" << std::endl;
+      throw std::runtime_error("Replay video could not be opened.");
+    }
+    double video_frame_rate = video_capture_.get(cv::CAP_PROP_FPS);
+    if (video_frame_rate > 0)
+    {
+      frame_rate_ = video_frame_rate;
+    }
+    std::cout << std::endl << "Replaying video " << path_ << std::endl;
+  }
+  std::cout << "Replay frame rate: " << frame_rate_ << std::endl;
+}
+
+void ReplaySource::start()
+{
+  rewind();
+}
+
+void ReplaySource::allocateMemory()
+{
+  cv::Mat image;
+  if (!readImage(image))
+  {
+    throw std::runtime_error("Unable to read first replay image.");
+  }
+  image_size_ = image.size();
+  image_data_size_ = image_size_.area();
+  image_ = cv::Mat(image_size_,image_type_);
+
+  if (preload_)
+  {
+    preloaded_images_.clear();
+    rewind();
+    while (readImage(image))
+    {
+      preloaded_images_.push_back(image.clone());
+    }
+    std::cout << std::endl << "Preloaded " << preloaded_images_.size() << " replay images." << std::endl;
+  }
+  rewind();
+}
+
+unsigned char * ReplaySource::getImageDataPointer()
+{
+  return image_.data;
+}
+
+cv::Size ReplaySource::getImageSize()
+{
+  return image_size_;
+}
+
+int ReplaySource::getImageType()
+{
+  return image_type_;
+}
+
+unsigned int ReplaySource::getImageDataSize()
+{
+  return image_data_size_;
+}
+
+double ReplaySource::getFrameRate()
+{
+  return frame_rate_;
+}
+
+bool ReplaySource::grabImage(cv::Mat & image)
+{
+  if (end_of_stream_)
+  {
+    return false;
+  }
+  if (!readNextImage(image))
+  {
+    if (!loop_)
+    {
+      end_of_stream_ = true;
+      return false;
+    }
+    rewind();
+    if (!readNextImage(image))
+    {
+      end_of_stream_ = true;
+      return false;
+    }
+  }
+  waitForNextFrame(frame_rate_);
+  return true;
+}
+
+bool ReplaySource::endOfStream()
+{
+  return end_of_stream_;
+}
+
+void ReplaySource::stop()
+{
+}
+
+void ReplaySource::disconnect()
+{
+  video_capture_.release();
+  preloaded_images_.clear();
+}
+
+// private
+bool ReplaySource::readImage(cv::Mat & image)
+{
+  if (image_paths_.size() > 0)
+  {
+    if (frame_index_ >= image_paths_.size())
+    {
+      return false;
+    }
+    image = cv::imread(image_paths_[frame_index_].string(),cv::IMREAD_GRAYSCALE);
+  }
+  else
+  {
+    if (!video_capture_.read(read_image_))
+    {
+      return false;
+    }
+    if (read_image_.channels() == 1)
+    {
+      read_image_.copyTo(image);
+    }
+    else
+    {
+      cv::cvtColor(read_image_,image,cv::COLOR_BGR2GRAY);
+    }
+  }
+  ++frame_index_;
+  return !image.empty();
+}
+
+bool ReplaySource::readNextImage(cv::Mat & image)
+{
+  if (preload_)
+  {
+    if (frame_index_ >= preloaded_images_.size())
+    {
+      return false;
+    }
+    preloaded_images_[frame_index_++].copyTo(image);
+    return true;
+  }
+
+  if (!readImage(image_))
+  {
+    return false;
+  }
+  if (image_.size() != image_size_)
+  {
+    std::cerr << "Replay image " << frame_index_ << " size does not match first image." << std::endl;
+    return false;
+  }
+  image_.copyTo(image);
+  return true;
+}
+
+void ReplaySource::rewind()
+{
+  frame_index_ = 0;
+  end_of_stream_ = false;
+  if (video_capture_.isOpened())
+  {
+    video_capture_.set(cv::CAP_PROP_POS_FRAMES,0);
+  }
+  resetPacing();
+}
@@ -0,0 +1,73 @@
+// ----------------------------------------------------------------------------
+// ReplaySource.h
+//
+//
+// Authors:
+// Peter Polidoro polidorop@janelia.hhmi.org
+// ----------------------------------------------------------------------------
+#ifndef _REPLAY_SOURCE_H_
+#define _REPLAY_SOURCE_H_
+#include <iostream>
+#include <vector>
+#include <algorithm>
+
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/videoio.hpp>
+
+#include <boost/filesystem.hpp>
+
+#include "FrameSource.h"
+
+
+// Replays a directory of PNG images, in file name order, or any video file
+// or image sequence pattern cv::VideoCapture can open.
+class ReplaySource : public FrameSource
+{
+public:
+  ReplaySource();
+
+  void setPath(const cv::String & path);
+  void setFrameRate(const double frame_rate);
+  void setLoop(const bool loop);
+  void setPreload(const bool preload);
+
+  void connect();
+  void start();
+  void allocateMemory();
+  unsigned char * getImageDataPointer();
+  cv::Size getImageSize();
+  int getImageType();
+  unsigned int getImageDataSize();
+  double getFrameRate();
+  bool grabImage(cv::Mat & image);
+  bool endOfStream();
+  void stop();
+  void disconnect();
+
+private:
+  static const double FRAME_RATE_DEFAULT = 177;
+
+  boost::filesystem::path path_;
+  double frame_rate_;
+  bool loop_;
+  bool preload_;
+  bool end_of_stream_;
+
+  std::vector<boost::filesystem::path> image_paths_;
+  cv::VideoCapture video_capture_;
+  std::vector<cv::Mat> preloaded_images_;
+  size_t frame_index_;
+
+  cv::Mat read_image_;
+  cv::Mat image_;
+  cv::Size image_size_;
+  int image_type_;
+  unsigned int image_data_size_;
+
+  bool readImage(cv::Mat & image);
+  bool readNextImage(cv::Mat & image);
+  void rewind();
+};
+
+#endif
@@ -8,13 +8,28 @@
 #include "StageController.h"
 
 
-const std::string StageController::DEVICE_NAME = std::string("/dev/ttyACM0");
+const std::string StageController::DEVICE_NAME_DEFAULT = std::string("/dev/ttyACM0");
 const std::string StageController::END_OF_LINE_STRING = std::string("\n");
+const std::string StageController::RESYNC_REQUEST = std::string("[getDeviceId]");
+const std::string StageController::RESYNC_METHOD = std::string("getDeviceId");
 
 // public
 StageController::StageController()
 {
   debug_ = false;
+  device_name_ = DEVICE_NAME_DEFAULT;
+  deadband_ = DEADBAND_DEFAULT;
+  binary_protocol_ = true;
+  binary_protocol_enabled_ = false;
+  sequence_ = 0;
+  x_prev_ = 0;
+  y_prev_ = 0;
+  io_running_ = false;
+  failed_count_ = 0;
+  coalesced_count_ = 0;
+  resync_count_ = 0;
+  trace_id_ = 0;
+  move_in_flight_ = false;
 }
 
 StageController::~StageController()
@@ -24,15 +39,15 @@ StageController::~StageController()
 
 void StageController::connect()
 {
-  boost::filesystem::path com_port_path(DEVICE_NAME);
+  boost::filesystem::path com_port_path(device_name_);
   if (!boost::filesystem::exists(com_port_path))
   {
-    std::cout << std::endl << DEVICE_NAME << " does not exist! Is the stage_controller attached?" << std::endl;
+    std::cout << std::endl << device_name_ << " does not exist! Is the stage_controller attached?" << std::endl;
     throw std::runtime_error("Stage controller com port path does not exist.");
   }
-  std::cout << std::endl << DEVICE_NAME << " exists." << std::endl;
+  std::cout << std::endl << device_name_ << " exists." << std::endl;
 
-  serial_.open(DEVICE_NAME,BAUD);
+  serial_.open(device_name_,BAUD);
   serial_.setTimeout(boost::posix_time::seconds(TIMEOUT));
   serial_.flush();
 
@@ -40,7 +55,7 @@ void StageController::connect()
 
   if (is_open)
   {
-    std::cout << DEVICE_NAME << " is open." << std::endl;
+    std::cout << device_name_ << " is open." << std::endl;
 
     std::string response = writeRequestReadResponse("[getDeviceId]");
 
@@ -51,11 +66,14 @@ void StageController::connect()
     {
       std::cout << response << std::endl;
       std::cout << std::endl << device_name << " not found in device_id response!" << std::endl;
-      std::cout << "Is the stage_controller attached to " << DEVICE_NAME << "?" << std::endl;
+      std::cout << "Is the stage_controller attached to " << device_name_ << "?" << std::endl;
       throw std::runtime_error("Stage controller not found on com port.");
     }
 
     std::cout << std::endl << "stage_controller device_id = " << std::endl << response << std::endl;
+
+    negotiateProtocol();
+    startIo();
   }
   else
   {
@@ -65,6 +83,7 @@ void StageController::connect()
 
 void StageController::disconnect()
 {
+  stopIo();
   if (isOpen())
   {
     serial_.close();
@@ -76,42 +95,72 @@ void StageController::setDebug(const bool debug)
   debug_ = debug;
 }
 
-bool StageController::homeStage()
+void StageController::setDeviceName(const std::string & device_name)
+{
+  device_name_ = device_name;
+}
+
+void StageController::setDeadband(const long deadband)
+{
+  deadband_ = deadband;
+}
+
+void StageController::setBinaryProtocol(const bool binary_protocol)
+{
+  binary_protocol_ = binary_protocol;
+}
+
+boost::shared_future<bool> StageController::homeStage(const Callback & callback)
 {
   x_prev_ = 0;
   y_prev_ = 0;
-  return writeRequestReadBoolResponse("[homeStage]");
+  return enqueue(StageProtocol::HOME_STAGE,0,0,callback);
 }
 
-bool StageController::stageHomed()
+boost::shared_future<bool> StageController::stageHomed(const Callback & callback)
 {
-  writeRequestReadBoolResponse("[stageHomed]");
+  return enqueue(StageProtocol::STAGE_HOMED,0,0,callback);
 }
 
-bool StageController::moveStageTo(const long x, const long y)
+boost::shared_future<bool> StageController::moveStageTo(const long x,
+                                                        const long y,
+                                                        const Callback & callback)
 {
   if (insideDeadband(x,y))
   {
-    return false;
+    return makeReadyFuture(false,callback);
   }
   x_prev_ = x;
   y_prev_ = y;
-  std::stringstream request;
-  request << "[moveStageTo [" << x << "," << y << "]]";
-  return writeRequestReadBoolResponse(request.str());
+  return enqueueMove(StageProtocol::MOVE_STAGE_TO,x,y,callback);
 }
 
-bool StageController::moveStageSoftlyTo(const long x, const long y)
+boost::shared_future<bool> StageController::moveStageSoftlyTo(const long x,
+                                                              const long y,
+                                                              const Callback & callback)
 {
   if (insideDeadband(x,y))
   {
-    return false;
+    return makeReadyFuture(false,callback);
   }
   x_prev_ = x;
   y_prev_ = y;
-  std::stringstream request;
-  request << "[moveStageSoftlyTo [" << x << "," << y << "]]";
-  return writeRequestReadBoolResponse(request.str());
+  return enqueueMove(StageProtocol::MOVE_STAGE_SOFTLY_TO,x,y,callback);
+}
+
+unsigned long StageController::getFailedCount()
+{
+  return failed_count_;
+}
+
+unsigned long StageController::getCoalescedCount()
+{
+  return coalesced_count_;
+}
+
+unsigned long StageController::getResyncCount()
+{
+  return resync_count_;
 }
 
 // private
@@ -165,10 +214,15 @@ std::string StageController::readResponse()
   return response;
 }
 
-bool StageController::readBoolResponse()
+std::string StageController::writeRequestReadResponse(const std::string & request)
 {
-  std::string response = readResponse();
+  // the read blocks until the whole line arrives, no delay is needed
+  writeRequest(request);
+  return readResponse();
+}
 
+bool StageController::parseBoolResponse(const std::string & response)
+{
   size_t position = response.find("true");
 
   if (position != std::string::npos)
@@ -179,26 +233,379 @@ bool StageController::readBoolResponse()
   return false;
 }
 
-std::string StageController::writeRequestReadResponse(const std::string & request)
-{
-  writeRequest(request);
-  boost::this_thread::sleep(boost::posix_time::milliseconds(WRITE_READ_DELAY));
-  return readResponse();
-}
-
-bool StageController::writeRequestReadBoolResponse(const std::string & request)
+bool StageController::responseAnswers(const std::string & response,
+                                      const std::string & method)
 {
-  writeRequest(request);
-  boost::this_thread::sleep(boost::posix_time::milliseconds(WRITE_READ_DELAY));
-  return readBoolResponse();
+  // text responses name the method they answer
+  return (response.find("\"id\":\"" + method + "\"") != std::string::npos);
 }
 
 bool StageController::insideDeadband(const long x, const long y)
 {
   double dist = sqrt(pow((x - x_prev_),2) + pow((y - y_prev_),2));
-  if (dist < (DEADBAND/2))
+  if (dist < (deadband_/2.0))
   {
     return true;
   }
   return false;
 }
+
+boost::shared_future<bool> StageController::enqueue(const StageProtocol::CommandId command_id,
+                                                    const long x,
+                                                    const long y,
+                                                    const Callback & callback)
+{
+  CommandPtr command_ptr(new Command());
+  command_ptr->command_id = command_id;
+  command_ptr->x = x;
+  command_ptr->y = y;
+  command_ptr->callback = callback;
+  command_ptr->move = false;
+  command_ptr->write_tick_count = 0;
+  boost::shared_future<bool> future(command_ptr->promise.get_future());
+  if (!io_running_)
+  {
+    ++failed_count_;
+    complete(command_ptr,false);
+    return future;
+  }
+  {
+    boost::lock_guard<boost::mutex> lock(queue_mutex_);
+    queue_.push_back(command_ptr);
+  }
+  queue_condition_.notify_one();
+  return future;
+}
+
+boost::shared_future<bool> StageController::enqueueMove(const StageProtocol::CommandId command_id,
+                                                        const long x,
+                                                        const long y,
+                                                        const Callback & callback)
+{
+  CommandPtr command_ptr(new Command());
+  command_ptr->command_id = command_id;
+  command_ptr->x = x;
+  command_ptr->y = y;
+  command_ptr->callback = callback;
+  command_ptr->move = true;
+  command_ptr->write_tick_count = 0;
+  boost::shared_future<bool> future(command_ptr->promise.get_future());
+  if (!io_running_)
+  {
+    ++failed_count_;
+    complete(command_ptr,false);
+    return future;
+  }
+  CommandPtr coalesced_ptr;
+  {
+    boost::lock_guard<boost::mutex> lock(queue_mutex_);
+    coalesced_ptr = pending_move_;
+    pending_move_ = command_ptr;
+  }
+  queue_condition_.notify_one();
+  if (coalesced_ptr)
+  {
+    ++coalesced_count_;
+    complete(coalesced_ptr,false);
+  }
+  return future;
+}
+
+boost::shared_future<bool> StageController::makeReadyFuture(const bool value,
+                                                            const Callback & callback)
+{
+  CommandPtr command_ptr(new Command());
+  command_ptr->callback = callback;
+  command_ptr->move = false;
+  command_ptr->write_tick_count = 0;
+  boost::shared_future<bool> future(command_ptr->promise.get_future());
+  complete(command_ptr,value);
+  return future;
+}
+
+void StageController::complete(CommandPtr & command_ptr,
+                               const bool value)
+{
+  command_ptr->promise.set_value(value);
+  if (command_ptr->callback)
+  {
+    command_ptr->callback(value,command_ptr->write_tick_count);
+  }
+}
+
+void StageController::startIo()
+{
+  stopIo();
+  io_running_ = true;
+  io_thread_ = boost::thread(&StageController::io,this);
+}
+
+void StageController::stopIo()
+{
+  if (!io_thread_.joinable())
+  {
+    return;
+  }
+  {
+    boost::lock_guard<boost::mutex> lock(queue_mutex_);
+    io_running_ = false;
+  }
+  queue_condition_.notify_one();
+  io_thread_.join();
+
+  failInFlight();
+  boost::lock_guard<boost::mutex> lock(queue_mutex_);
+  while (!queue_.empty())
+  {
+    ++failed_count_;
+    complete(queue_.front(),false);
+    queue_.pop_front();
+  }
+  if (pending_move_)
+  {
+    ++failed_count_;
+    complete(pending_move_,false);
+    pending_move_.reset();
+  }
+}
+
+void StageController::io()
+{
+  Tracer::setThreadName("stage io");
+  while (io_running_)
+  {
+    // keep up to PIPELINE_DEPTH requests on the wire
+    std::deque<CommandPtr> to_write;
+    {
+      boost::unique_lock<boost::mutex> lock(queue_mutex_);
+      if (queue_.empty() && !pending_move_ && in_flight_.empty() && io_running_)
+      {
+        queue_condition_.timed_wait(lock,boost::posix_time::milliseconds(QUEUE_WAIT_TIMEOUT));
+      }
+      while (!queue_.empty() && ((in_flight_.size() + to_write.size()) < PIPELINE_DEPTH))
+      {
+        to_write.push_back(queue_.front());
+        queue_.pop_front();
+      }
+      // the freshest target goes out once the previous move is answered
+      if (pending_move_ && !move_in_flight_ && ((in_flight_.size() + to_write.size()) < PIPELINE_DEPTH))
+      {
+        to_write.push_back(pending_move_);
+        pending_move_.reset();
+        move_in_flight_ = true;
+      }
+    }
+
+    try
+    {
+      while (!to_write.empty())
+      {
+        in_flight_.push_back(to_write.front());
+        to_write.pop_front();
+        writeCommand(*in_flight_.back());
+      }
+
+      if (in_flight_.empty())
+      {
+        continue;
+      }
+
+      // the controller answers requests in order
+      bool result = readCommandResult(*in_flight_.front());
+      CommandPtr command_ptr = in_flight_.front();
+      in_flight_.pop_front();
+      if (Tracer::enabled())
+      {
+        Tracer::recordAsyncSpan(StageProtocol::getCommandName(command_ptr->command_id),
+                                trace_id_++,
+                                command_ptr->write_tick_count,
+                                cv::getTickCount());
+      }
+      if (command_ptr->move)
+      {
+        move_in_flight_ = false;
+      }
+      complete(command_ptr,result);
+    }
+    catch (const std::exception & e)
+    {
+      // a late answer would be matched to the wrong request, so fail every
+      // request on the wire and resynchronize before sending more
+      std::cerr << "Stage controller io error: " << e.what() << std::endl;
+      failInFlight();
+      while (!to_write.empty())
+      {
+        ++failed_count_;
+        complete(to_write.front(),false);
+        to_write.pop_front();
+      }
+      resync();
+    }
+  }
+}
+
+void StageController::negotiateProtocol()
+{
+  binary_protocol_enabled_ = false;
+  if (!binary_protocol_)
+  {
+    return;
+  }
+  // controllers without binary support answer with an error
+  std::string response = writeRequestReadResponse("[enableBinaryProtocol]");
+  binary_protocol_enabled_ = parseBoolResponse(response);
+  if (binary_protocol_enabled_)
+  {
+    std::cout << std::endl << "Binary stage protocol!" << std::endl;
+  }
+  else
+  {
+    std::cout << std::endl << "Binary stage protocol not supported, using text." << std::endl;
+  }
+}
+
+void StageController::writeCommand(Command & command)
+{
+  if (!binary_protocol_enabled_)
+  {
+    writeRequest(formatTextRequest(command));
+    command.write_tick_count = cv::getTickCount();
+    return;
+  }
+  command.sequence = sequence_++;
+  unsigned char request[StageProtocol::REQUEST_SIZE];
+  StageProtocol::encodeRequest(command.command_id,command.sequence,command.x,command.y,request);
+  if (debug_)
+  {
+    std::cout << formatTextRequest(command) << " sequence: " << (int)command.sequence << std::endl;
+  }
+  serial_.write((const char *)request,StageProtocol::REQUEST_SIZE);
+  command.write_tick_count = cv::getTickCount();
+}
+
+bool StageController::readCommandResult(const Command & command)
+{
+  if (!binary_protocol_enabled_)
+  {
+    std::string response = serial_.readStringUntil(END_OF_LINE_STRING);
+    if (debug_)
+    {
+      std::cout << response << std::endl;
+    }
+    if (!responseAnswers(response,StageProtocol::getCommandName(command.command_id)))
+    {
+      throw std::runtime_error("Stage controller response out of order.");
+    }
+    return parseBoolResponse(response);
+  }
+  unsigned char response[StageProtocol::RESPONSE_SIZE];
+  size_t response_size = 0;
+  for (size_t i=0; i<RESYNC_READ_COUNT_MAX; ++i)
+  {
+    serial_.read((char *)response + response_size,StageProtocol::RESPONSE_SIZE - response_size);
+    boost::uint8_t sequence;
+    bool result;
+    if (!StageProtocol::decodeResponse(response,sequence,result))
+    {
+      // a partial late answer shifts every later frame, so drop a byte and
+      // keep the rest from the next sync byte on
+      const unsigned char * sync = std::find(response + 1,
+                                             response + StageProtocol::RESPONSE_SIZE,
+                                             StageProtocol::RESPONSE_SYNC);
+      response_size = (response + StageProtocol::RESPONSE_SIZE) - sync;
+      memmove(response,sync,response_size);
+      continue;
+    }
+    response_size = 0;
+    if (debug_)
+    {
+      std::cout << "sequence: " << (int)sequence << " result: " << result << std::endl;
+    }
+    if (sequence == command.sequence)
+    {
+      return result;
+    }
+    // a late answer to a request that already failed
+  }
+  throw std::runtime_error("Stage controller response out of sequence.");
+}
+
+std::string StageController::formatTextRequest(const Command & command)
+{
+  std::stringstream request;
+  switch (command.command_id)
+  {
+    case StageProtocol::HOME_STAGE:
+    {
+      request << "[homeStage]";
+      break;
+    }
+    case StageProtocol::STAGE_HOMED:
+    {
+      request << "[stageHomed]";
+      break;
+    }
+    case StageProtocol::MOVE_STAGE_TO:
+    {
+      request << "[moveStageTo [" << command.x << "," << command.y << "]]";
+      break;
+    }
+    case StageProtocol::MOVE_STAGE_SOFTLY_TO:
+    {
+      request << "[moveStageSoftlyTo [" << command.x << "," << command.y << "]]";
+      break;
+    }
+  }
+  return request.str();
+}
+
+void StageController::failInFlight()
+{
+  move_in_flight_ = false;
+  while (!in_flight_.empty())
+  {
+    ++failed_count_;
+    complete(in_flight_.front(),false);
+    in_flight_.pop_front();
+  }
+}
+
+void StageController::resync()
+{
+  ++resync_count_;
+  serial_.flush();
+  if (binary_protocol_enabled_)
+  {
+    // late binary answers are skipped by their sequence number and partial
+    // ones by scanning for the next sync byte, so the reader realigns itself
+    return;
+  }
+  // an answer to a failed request may still be on its way and the flush
+  // only drops what already arrived, so ask for something no pipelined
+  // request asks for and discard every line up to its answer, the
+  // controller answers in order
+  for (size_t attempt=0; attempt<RESYNC_ATTEMPTS_MAX; ++attempt)
+  {
+    try
+    {
+      writeRequest(RESYNC_REQUEST);
+      for (size_t i=0; i<RESYNC_READ_COUNT_MAX; ++i)
+      {
+        std::string response = serial_.readStringUntil(END_OF_LINE_STRING);
+        if (debug_)
+        {
+          std::cout << response << std::endl;
+        }
+        if (responseAnswers(response,RESYNC_METHOD))
+        {
+          return;
+        }
+      }
+    }
+    catch (const std::exception & e)
+    {
+    }
+  }
+  std::cerr << "Stage controller did not resynchronize." << std::endl;
+  serial_.flush();
+}
@@ -10,13 +10,30 @@
 #include <iostream>
 #include <boost/filesystem.hpp>
 #include <sstream>
+#include <deque>
+#include <algorithm>
+#include <cstring>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/thread/thread.hpp>
+#include <boost/thread/future.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/atomic.hpp>
 #include <math.h>
+#include <opencv2/core.hpp>
 
 #include "TimeoutSerial.h"
+#include "StageProtocol.h"
+#include "Tracer.h"
 
 
+// Stage commands never block the caller. They are queued to an I/O thread
+// that streams them to the controller, matches responses in order and
+// completes each command's future, and callback when one is given, from the
+// I/O thread. Moves are coalesced: only one is on the wire at a time and a
+// newer target replaces one still waiting to be sent. When the controller
+// accepts it at connect, commands use the compact StageProtocol frames
+// instead of text.
 class StageController
 {
 public:
@@ -27,34 +44,115 @@ public:
   void disconnect();
 
   void setDebug(const bool debug);
+  void setDeviceName(const std::string & device_name);
+  void setDeadband(const long deadband);
+  void setBinaryProtocol(const bool binary_protocol);
 
-  bool homeStage();
-  bool stageHomed();
-  bool moveStageTo(const long x, const long y);
-  bool moveStageSoftlyTo(const long x, const long y);
+  // called with the result and the tick count when the request was written,
+  // zero when it never was
+  typedef boost::function<void (const bool, const int64)> Callback;
+
+  boost::shared_future<bool> homeStage(const Callback & callback=Callback());
+  boost::shared_future<bool> stageHomed(const Callback & callback=Callback());
+  // moves inside the deadband, or replaced by a newer target before they
+  // were sent, complete with false
+  boost::shared_future<bool> moveStageTo(const long x,
+                                         const long y,
+                                         const Callback & callback=Callback());
+  boost::shared_future<bool> moveStageSoftlyTo(const long x,
+                                               const long y,
+                                               const Callback & callback=Callback());
+
+  unsigned long getFailedCount();
+  unsigned long getCoalescedCount();
+  unsigned long getResyncCount();
 
 private:
-  const static std::string DEVICE_NAME;
+  const static std::string DEVICE_NAME_DEFAULT;
   const static long BAUD = 115200;
   const static std::string END_OF_LINE_STRING;
   const static long TIMEOUT = 1;
   const static size_t READ_ATTEMPTS_MAX = 10;
-  const static size_t WRITE_READ_DELAY = 5;
-  const static long DEADBAND = 1000;
+  const static long DEADBAND_DEFAULT = 1000;
+  // requests written ahead of their responses, small enough not to overrun
+  // the controller receive buffer
+  const static size_t PIPELINE_DEPTH = 4;
+  const static long QUEUE_WAIT_TIMEOUT = 100;
+  // responses skipped as late or partial answers, or read while waiting
+  // for the resync answer before trying again, each within TIMEOUT
+  const static size_t RESYNC_READ_COUNT_MAX = 16;
+  const static size_t RESYNC_ATTEMPTS_MAX = 3;
+  const static std::string RESYNC_REQUEST;
+  const static std::string RESYNC_METHOD;
+
+  struct Command
+  {
+    StageProtocol::CommandId command_id;
+    long x;
+    long y;
+    boost::uint8_t sequence;
+    boost::promise<bool> promise;
+    Callback callback;
+    bool move;
+    int64 write_tick_count;
+  };
+  typedef boost::shared_ptr<Command> CommandPtr;
 
   TimeoutSerial serial_;
+  std::string device_name_;
   bool debug_;
+  long deadband_;
+  bool binary_protocol_;
+  bool binary_protocol_enabled_;
+  boost::uint8_t sequence_;
   long x_prev_;
   long y_prev_;
 
+  boost::thread io_thread_;
+  boost::mutex queue_mutex_;
+  boost::condition_variable queue_condition_;
+  std::deque<CommandPtr> queue_;
+  std::deque<CommandPtr> in_flight_;
+  CommandPtr pending_move_;
+  bool move_in_flight_;
+  boost::atomic<bool> io_running_;
+  boost::atomic<unsigned long> failed_count_;
+  boost::atomic<unsigned long> coalesced_count_;
+  boost::atomic<unsigned long> resync_count_;
+  // stage I/O thread, tells overlapping traced requests apart
+  unsigned long trace_id_;
+
   bool isOpen();
   void writeRequest(const char * request);
   void writeRequest(const std::string & request);
   std::string readResponse();
-  bool readBoolResponse();
   std::string writeRequestReadResponse(const std::string & request);
-  bool writeRequestReadBoolResponse(const std::string & request);
+  static bool parseBoolResponse(const std::string & response);
+  static bool responseAnswers(const std::string & response,
+                              const std::string & method);
   bool insideDeadband(const long x, const long y);
+
+  boost::shared_future<bool> enqueue(const StageProtocol::CommandId command_id,
+                                     const long x,
+                                     const long y,
+                                     const Callback & callback);
+  boost::shared_future<bool> enqueueMove(const StageProtocol::CommandId command_id,
+                                         const long x,
+                                         const long y,
+                                         const Callback & callback);
+  void negotiateProtocol();
+  void writeCommand(Command & command);
+  bool readCommandResult(const Command & command);
+  static std::string formatTextRequest(const Command & command);
+  static boost::shared_future<bool> makeReadyFuture(const bool value,
+                                                    const Callback & callback);
+  static void complete(CommandPtr & command_ptr,
+                       const bool value);
+  void startIo();
+  void stopIo();
+  void io();
+  void failInFlight();
+  void resync();
 };
 
 #endif
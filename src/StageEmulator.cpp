@@ -0,0 +1,381 @@
+// ----------------------------------------------------------------------------
+// StageEmulator.cpp
+//
+//
+// Authors:
+// Peter Polidoro polidorop@janelia.hhmi.org
+// ----------------------------------------------------------------------------
+#include "StageEmulator.h"
+
+
+// public
+StageEmulator::StageEmulator()
+{
+  response_latency_ = RESPONSE_LATENCY_DEFAULT;
+  baud_ = BAUD_DEFAULT;
+  speed_ = SPEED_DEFAULT;
+  binary_protocol_supported_ = true;
+  late_response_period_ = 0;
+  truncate_late_responses_ = false;
+
+  master_fd_ = -1;
+  slave_fd_ = -1;
+  running_ = false;
+  command_count_ = 0;
+  late_response_count_ = 0;
+  move_count_ = 0;
+}
+
+StageEmulator::~StageEmulator()
+{
+  stop();
+}
+
+void StageEmulator::setResponseLatency(const double seconds)
+{
+  response_latency_ = seconds;
+}
+
+void StageEmulator::setBaud(const long baud)
+{
+  baud_ = baud;
+}
+
+void StageEmulator::setSpeed(const double units_per_second)
+{
+  speed_ = units_per_second;
+}
+
+void StageEmulator::setBinaryProtocol(const bool binary_protocol)
+{
+  binary_protocol_supported_ = binary_protocol;
+}
+
+void StageEmulator::setLateResponsePeriod(const unsigned long period)
+{
+  late_response_period_ = period;
+}
+
+void StageEmulator::setTruncateLateResponses(const bool truncate)
+{
+  truncate_late_responses_ = truncate;
+}
+
+void StageEmulator::start()
+{
+  stop();
+
+  master_fd_ = posix_openpt(O_RDWR | O_NOCTTY);
+  if ((master_fd_ < 0) || (grantpt(master_fd_) != 0) || (unlockpt(master_fd_) != 0))
+  {
+    throw std::runtime_error("Unable to create stage emulator pseudo-terminal.");
+  }
+  device_path_ = ptsname(master_fd_);
+
+  // hold the slave open in raw mode so nothing is echoed or line edited
+  // before the stage controller opens it
+  slave_fd_ = open(device_path_.c_str(),O_RDWR | O_NOCTTY);
+  if (slave_fd_ < 0)
+  {
+    throw std::runtime_error("Unable to open stage emulator pseudo-terminal.");
+  }
+  struct termios settings;
+  tcgetattr(slave_fd_,&settings);
+  cfmakeraw(&settings);
+  tcsetattr(slave_fd_,TCSANOW,&settings);
+
+  input_.clear();
+  input_.reserve(READ_SIZE*2);
+  binary_protocol_enabled_ = false;
+  position_ = cv::Point2d(0,0);
+  target_ = position_;
+  position_tick_count_ = cv::getTickCount();
+  homing_ = false;
+  homed_ = false;
+  command_count_ = 0;
+  late_response_count_ = 0;
+  move_count_ = 0;
+
+  running_ = true;
+  thread_ = boost::thread(&StageEmulator::emulate,this);
+
+  std::cout << std::endl << "Stage emulator on " << device_path_ << std::endl;
+}
+
+void StageEmulator::stop()
+{
+  if (thread_.joinable())
+  {
+    running_ = false;
+    thread_.join();
+  }
+  if (slave_fd_ >= 0)
+  {
+    close(slave_fd_);
+    slave_fd_ = -1;
+  }
+  if (master_fd_ >= 0)
+  {
+    close(master_fd_);
+    master_fd_ = -1;
+  }
+}
+
+std::string StageEmulator::getDevicePath()
+{
+  return device_path_;
+}
+
+unsigned long StageEmulator::getCommandCount()
+{
+  return command_count_;
+}
+
+unsigned long StageEmulator::getLateResponseCount()
+{
+  return late_response_count_;
+}
+
+// private
+void StageEmulator::emulate()
+{
+  unsigned char buffer[READ_SIZE];
+  while (running_)
+  {
+    struct pollfd poll_fd;
+    poll_fd.fd = master_fd_;
+    poll_fd.events = POLLIN;
+    poll_fd.revents = 0;
+    if (poll(&poll_fd,1,POLL_TIMEOUT) <= 0)
+    {
+      continue;
+    }
+    ssize_t count = read(master_fd_,buffer,READ_SIZE);
+    if (count <= 0)
+    {
+      continue;
+    }
+    throttle(count);
+    input_.insert(input_.end(),buffer,buffer + count);
+    processInput();
+  }
+}
+
+void StageEmulator::processInput()
+{
+  bool processed = true;
+  while (processed && !input_.empty())
+  {
+    if (binary_protocol_enabled_)
+    {
+      processed = processBinaryRequest();
+    }
+    else
+    {
+      processed = processTextRequest();
+    }
+  }
+}
+
+bool StageEmulator::processTextRequest()
+{
+  std::vector<unsigned char>::iterator end_of_line = std::find(input_.begin(),input_.end(),'\n');
+  if (end_of_line == input_.end())
+  {
+    return false;
+  }
+  std::string request(input_.begin(),end_of_line);
+  input_.erase(input_.begin(),end_of_line + 1);
+
+  // requests look like [method] or [method [x,y]]
+  std::string method;
+  long x = 0;
+  long y = 0;
+  size_t method_start = request.find('[');
+  if (method_start != std::string::npos)
+  {
+    size_t method_end = request.find_first_of(" ]",method_start);
+    method = request.substr(method_start + 1,method_end - method_start - 1);
+    size_t parameters_start = request.find('[',method_start + 1);
+    if (parameters_start != std::string::npos)
+    {
+      char separator;
+      std::istringstream parameters(request.substr(parameters_start + 1));
+      parameters >> x >> separator >> y;
+    }
+  }
+
+  waitToRespond((method == "moveStageTo") || (method == "moveStageSoftlyTo"));
+
+  if (method == "getDeviceId")
+  {
+    writeTextResponse(method,"{\"name\":\"zebrafish_tracker_controller\",\"form_factor\":\"emulator\",\"serial_number\":0}");
+  }
+  else if (method == "enableBinaryProtocol")
+  {
+    writeTextResponse(method,binary_protocol_supported_ ? "true" : "false");
+    binary_protocol_enabled_ = binary_protocol_supported_;
+  }
+  else if (method == "homeStage")
+  {
+    writeTextResponse(method,execute(StageProtocol::HOME_STAGE,x,y) ? "true" : "false");
+  }
+  else if (method == "stageHomed")
+  {
+    writeTextResponse(method,execute(StageProtocol::STAGE_HOMED,x,y) ? "true" : "false");
+  }
+  else if (method == "moveStageTo")
+  {
+    writeTextResponse(method,execute(StageProtocol::MOVE_STAGE_TO,x,y) ? "true" : "false");
+  }
+  else if (method == "moveStageSoftlyTo")
+  {
+    writeTextResponse(method,execute(StageProtocol::MOVE_STAGE_SOFTLY_TO,x,y) ? "true" : "false");
+  }
+  else
+  {
+    std::string response = "{\"id\":\"" + method + "\",\"error\":{\"message\":\"Method not found\",\"code\":-32601}}\n";
+    writeResponse((const unsigned char *)response.data(),response.size());
+  }
+  return true;
+}
+
+bool StageEmulator::processBinaryRequest()
+{
+  // drop bytes until a sync byte starts a frame with a valid crc
+  std::vector<unsigned char>::iterator sync = std::find(input_.begin(),input_.end(),StageProtocol::REQUEST_SYNC);
+  input_.erase(input_.begin(),sync);
+  if (input_.size() < StageProtocol::REQUEST_SIZE)
+  {
+    return false;
+  }
+  StageProtocol::CommandId command_id;
+  boost::uint8_t sequence;
+  boost::int32_t x;
+  boost::int32_t y;
+  if (!StageProtocol::decodeRequest(&input_[0],command_id,sequence,x,y))
+  {
+    input_.erase(input_.begin());
+    return true;
+  }
+  input_.erase(input_.begin(),input_.begin() + StageProtocol::REQUEST_SIZE);
+
+  bool late = waitToRespond((command_id == StageProtocol::MOVE_STAGE_TO) || (command_id == StageProtocol::MOVE_STAGE_SOFTLY_TO));
+
+  unsigned char response[StageProtocol::RESPONSE_SIZE];
+  StageProtocol::encodeResponse(sequence,execute(command_id,x,y),response);
+  size_t response_size = StageProtocol::RESPONSE_SIZE;
+  if (late && truncate_late_responses_)
+  {
+    response_size -= sizeof(boost::uint16_t);
+  }
+  writeResponse(response,response_size);
+  return true;
+}
+
+bool StageEmulator::waitToRespond(const bool move)
+{
+  double delay = response_latency_;
+  bool late = false;
+  if (move && (late_response_period_ > 0) && ((++move_count_ % late_response_period_) == 0))
+  {
+    // later requests queue up behind the late answer, as on the controller
+    delay = LATE_RESPONSE_DELAY;
+    late = true;
+    ++late_response_count_;
+  }
+  if (delay > 0)
+  {
+    boost::this_thread::sleep(boost::posix_time::microseconds((long)(delay*1000000)));
+  }
+  ++command_count_;
+  return late;
+}
+
+bool StageEmulator::execute(const StageProtocol::CommandId command_id,
+                            const long x,
+                            const long y)
+{
+  updatePosition();
+  switch (command_id)
+  {
+    case StageProtocol::HOME_STAGE:
+    {
+      homing_ = true;
+      homed_ = false;
+      target_ = cv::Point2d(0,0);
+      return true;
+    }
+    case StageProtocol::STAGE_HOMED:
+    {
+      return homed_;
+    }
+    case StageProtocol::MOVE_STAGE_TO:
+    case StageProtocol::MOVE_STAGE_SOFTLY_TO:
+    {
+      if (!homed_)
+      {
+        return false;
+      }
+      target_ = cv::Point2d(x,y);
+      return true;
+    }
+  }
+  return false;
+}
+
+void StageEmulator::updatePosition()
+{
+  int64 tick_count = cv::getTickCount();
+  double step = speed_*(tick_count - position_tick_count_)/cv::getTickFrequency();
+  position_tick_count_ = tick_count;
+
+  cv::Point2d offset = target_ - position_;
+  double distance = sqrt(offset.dot(offset));
+  if (distance <= step)
+  {
+    position_ = target_;
+    if (homing_)
+    {
+      homing_ = false;
+      homed_ = true;
+    }
+  }
+  else
+  {
+    position_ = position_ + offset*(step/distance);
+  }
+}
+
+void StageEmulator::writeResponse(const unsigned char * data,
+                                  const size_t size)
+{
+  throttle(size);
+  size_t written = 0;
+  while (written < size)
+  {
+    ssize_t count = write(master_fd_,data + written,size - written);
+    if (count <= 0)
+    {
+      return;
+    }
+    written += count;
+  }
+}
+
+void StageEmulator::writeTextResponse(const std::string & method,
+                                      const std::string & result)
+{
+  std::string response = "{\"id\":\"" + method + "\",\"result\":" + result + "}\n";
+  writeResponse((const unsigned char *)response.data(),response.size());
+}
+
+void StageEmulator::throttle(const size_t byte_count)
+{
+  if (baud_ <= 0)
+  {
+    return;
+  }
+  long microseconds = (1000000L*BITS_PER_BYTE*byte_count)/baud_;
+  boost::this_thread::sleep(boost::posix_time::microseconds(microseconds));
+}
@@ -0,0 +1,115 @@
+// ----------------------------------------------------------------------------
+// StageEmulator.h
+//
+//
+// Authors:
+// Peter Polidoro polidorop@janelia.hhmi.org
+// ----------------------------------------------------------------------------
+#ifndef _STAGE_EMULATOR_H_
+#define _STAGE_EMULATOR_H_
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <cmath>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <opencv2/core.hpp>
+
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+
+#include "StageProtocol.h"
+
+
+// Emulates the stage controller on a pseudo-terminal so the tracker and
+// benchmarks can run without hardware. It answers the text protocol and,
+// once enabled, StageProtocol frames, with a fixed response latency, a
+// simulated serial baud rate and a stage moving at constant speed.
+class StageEmulator
+{
+public:
+  StageEmulator();
+  ~StageEmulator();
+
+  // 0 disables the delay
+  void setResponseLatency(const double seconds);
+  void setBaud(const long baud);
+  void setSpeed(const double units_per_second);
+  void setBinaryProtocol(const bool binary_protocol);
+  // answers every period moves only after LATE_RESPONSE_DELAY, longer than
+  // the stage controller timeout, 0 disables late answers
+  void setLateResponsePeriod(const unsigned long period);
+  // late binary answers lose their crc, as when the controller resets
+  // mid answer, so the next answer arrives right behind a partial frame
+  void setTruncateLateResponses(const bool truncate);
+
+  void start();
+  void stop();
+
+  // serial device path to give the StageController
+  std::string getDevicePath();
+
+  unsigned long getCommandCount();
+  unsigned long getLateResponseCount();
+
+private:
+  static const double RESPONSE_LATENCY_DEFAULT = 0.001;
+  static const long BAUD_DEFAULT = 115200;
+  static const double SPEED_DEFAULT = 200000;
+  static const int BITS_PER_BYTE = 10;
+  static const int POLL_TIMEOUT = 100;
+  static const size_t READ_SIZE = 256;
+  static const double LATE_RESPONSE_DELAY = 1.5;
+
+  double response_latency_;
+  long baud_;
+  double speed_;
+  bool binary_protocol_supported_;
+  unsigned long late_response_period_;
+  bool truncate_late_responses_;
+
+  int master_fd_;
+  int slave_fd_;
+  std::string device_path_;
+
+  boost::thread thread_;
+  boost::atomic<bool> running_;
+  boost::atomic<unsigned long> command_count_;
+  boost::atomic<unsigned long> late_response_count_;
+  unsigned long move_count_;
+
+  std::vector<unsigned char> input_;
+  bool binary_protocol_enabled_;
+
+  cv::Point2d position_;
+  cv::Point2d target_;
+  int64 position_tick_count_;
+  bool homing_;
+  bool homed_;
+
+  void emulate();
+  void processInput();
+  bool processTextRequest();
+  bool processBinaryRequest();
+  // returns true when the answer is late
+  bool waitToRespond(const bool move);
+  bool execute(const StageProtocol::CommandId command_id,
+               const long x,
+               const long y);
+  void updatePosition();
+  void writeResponse(const unsigned char * data,
+                     const size_t size);
+  void writeTextResponse(const std::string & method,
+                         const std::string & result);
+  void throttle(const size_t byte_count);
+};
+
+#endif
@@ -0,0 +1,150 @@
+// ----------------------------------------------------------------------------
+// StageProtocol.cpp
+//
+//
+// Authors:
+// Peter Polidoro polidorop@janelia.hhmi.org
+// ----------------------------------------------------------------------------
+#include "StageProtocol.h"
+
+
+// public
+void StageProtocol::encodeRequest(const CommandId command_id,
+                                  const boost::uint8_t sequence,
+                                  const boost::int32_t x,
+                                  const boost::int32_t y,
+                                  unsigned char * buffer)
+{
+  buffer[0] = REQUEST_SYNC;
+  buffer[1] = sequence;
+  buffer[2] = command_id;
+  writeInt32(x,buffer + 3);
+  writeInt32(y,buffer + 7);
+  writeCrc(REQUEST_SIZE,buffer);
+}
+
+bool StageProtocol::decodeRequest(const unsigned char * buffer,
+                                  CommandId & command_id,
+                                  boost::uint8_t & sequence,
+                                  boost::int32_t & x,
+                                  boost::int32_t & y)
+{
+  if ((buffer[0] != REQUEST_SYNC) || !checkCrc(REQUEST_SIZE,buffer))
+  {
+    return false;
+  }
+  if ((buffer[2] < HOME_STAGE) || (buffer[2] > MOVE_STAGE_SOFTLY_TO))
+  {
+    return false;
+  }
+  sequence = buffer[1];
+  command_id = (CommandId)buffer[2];
+  x = readInt32(buffer + 3);
+  y = readInt32(buffer + 7);
+  return true;
+}
+
+void StageProtocol::encodeResponse(const boost::uint8_t sequence,
+                                   const bool result,
+                                   unsigned char * buffer)
+{
+  buffer[0] = RESPONSE_SYNC;
+  buffer[1] = sequence;
+  buffer[2] = result ? 1 : 0;
+  writeCrc(RESPONSE_SIZE,buffer);
+}
+
+bool StageProtocol::decodeResponse(const unsigned char * buffer,
+                                   boost::uint8_t & sequence,
+                                   bool & result)
+{
+  if ((buffer[0] != RESPONSE_SYNC) || !checkCrc(RESPONSE_SIZE,buffer))
+  {
+    return false;
+  }
+  sequence = buffer[1];
+  result = (buffer[2] != 0);
+  return true;
+}
+
+const char * StageProtocol::getCommandName(const CommandId command_id)
+{
+  switch (command_id)
+  {
+    case HOME_STAGE:
+    {
+      return "homeStage";
+    }
+    case STAGE_HOMED:
+    {
+      return "stageHomed";
+    }
+    case MOVE_STAGE_TO:
+    {
+      return "moveStageTo";
+    }
+    case MOVE_STAGE_SOFTLY_TO:
+    {
+      return "moveStageSoftlyTo";
+    }
+  }
+  return "unknown";
+}
+
+boost::uint16_t StageProtocol::crc16(const unsigned char * data,
+                                     const size_t size)
+{
+  boost::uint16_t crc = CRC_INITIAL;
+  for (size_t i=0; i<size; ++i)
+  {
+    crc ^= (boost::uint16_t)data[i] << 8;
+    for (int bit=0; bit<8; ++bit)
+    {
+      if (crc & 0x8000)
+      {
+        crc = (crc << 1) ^ CRC_POLYNOMIAL;
+      }
+      else
+      {
+        crc = crc << 1;
+      }
+    }
+  }
+  return crc;
+}
+
+// private
+void StageProtocol::writeInt32(const boost::int32_t value,
+                               unsigned char * buffer)
+{
+  boost::uint32_t bits = value;
+  buffer[0] = bits;
+  buffer[1] = bits >> 8;
+  buffer[2] = bits >> 16;
+  buffer[3] = bits >> 24;
+}
+
+boost::int32_t StageProtocol::readInt32(const unsigned char * buffer)
+{
+  boost::uint32_t bits = buffer[0];
+  bits |= (boost::uint32_t)buffer[1] << 8;
+  bits |= (boost::uint32_t)buffer[2] << 16;
+  bits |= (boost::uint32_t)buffer[3] << 24;
+  return (boost::int32_t)bits;
+}
+
+void StageProtocol::writeCrc(const size_t size,
+                             unsigned char * buffer)
+{
+  // the sync byte is left out of the crc
+  boost::uint16_t crc = crc16(buffer + 1,size - 3);
+  buffer[size - 2] = crc;
+  buffer[size - 1] = crc >> 8;
+}
+
+bool StageProtocol::checkCrc(const size_t size,
+                             const unsigned char * buffer)
+{
+  boost::uint16_t crc = crc16(buffer + 1,size - 3);
+  return ((buffer[size - 2] == (unsigned char)crc) && (buffer[size - 1] == (unsigned char)(crc >> 8)));
+}
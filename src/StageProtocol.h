@@ -0,0 +1,75 @@
+// ----------------------------------------------------------------------------
+// StageProtocol.h
+//
+//
+// Authors:
+// Peter Polidoro polidorop@janelia.hhmi.org
+// ----------------------------------------------------------------------------
+#ifndef _STAGE_PROTOCOL_H_
+#define _STAGE_PROTOCOL_H_
+#include <cstddef>
+
+#include <boost/cstdint.hpp>
+
+
+// Fixed size binary frames for stage commands, used instead of the text
+// protocol once the controller accepts [enableBinaryProtocol].
+//
+// request:  0xA5 sequence command x(int32 le) y(int32 le) crc(uint16 le)
+// response: 0x5A sequence result crc(uint16 le)
+//
+// The CRC is CRC-16/CCITT-FALSE over every byte between the sync byte and
+// the CRC. Encoding and decoding work in caller buffers and never allocate.
+class StageProtocol
+{
+public:
+  enum CommandId
+  {
+    HOME_STAGE = 1,
+    STAGE_HOMED = 2,
+    MOVE_STAGE_TO = 3,
+    MOVE_STAGE_SOFTLY_TO = 4,
+  };
+
+  static const size_t REQUEST_SIZE = 13;
+  static const size_t RESPONSE_SIZE = 5;
+  static const unsigned char REQUEST_SYNC = 0xA5;
+  static const unsigned char RESPONSE_SYNC = 0x5A;
+
+  static void encodeRequest(const CommandId command_id,
+                            const boost::uint8_t sequence,
+                            const boost::int32_t x,
+                            const boost::int32_t y,
+                            unsigned char * buffer);
+  static bool decodeRequest(const unsigned char * buffer,
+                            CommandId & command_id,
+                            boost::uint8_t & sequence,
+                            boost::int32_t & x,
+                            boost::int32_t & y);
+
+  static void encodeResponse(const boost::uint8_t sequence,
+                             const bool result,
+                             unsigned char * buffer);
+  static bool decodeResponse(const unsigned char * buffer,
+                             boost::uint8_t & sequence,
+                             bool & result);
+
+  static const char * getCommandName(const CommandId command_id);
+
+  static boost::uint16_t crc16(const unsigned char * data,
+                               const size_t size);
+
+private:
+  static const boost::uint16_t CRC_POLYNOMIAL = 0x1021;
+  static const boost::uint16_t CRC_INITIAL = 0xFFFF;
+
+  static void writeInt32(const boost::int32_t value,
+                         unsigned char * buffer);
+  static boost::int32_t readInt32(const unsigned char * buffer);
+  static void writeCrc(const size_t size,
+                       unsigned char * buffer);
+  static bool checkCrc(const size_t size,
+                       const unsigned char * buffer);
+};
+
+#endif
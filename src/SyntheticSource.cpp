@@ -0,0 +1,143 @@
+// ----------------------------------------------------------------------------
+// SyntheticSource.cpp
+//
+//
+// Authors:
+// Peter Polidoro polidorop@janelia.hhmi.org
+// ----------------------------------------------------------------------------
+#include "SyntheticSource.h"
+
+
+// public
+SyntheticSource::SyntheticSource()
+{
+  image_size_ = cv::Size(IMAGE_WIDTH_DEFAULT,IMAGE_HEIGHT_DEFAULT);
+  image_type_ = CV_8UC1;
+  frame_rate_ = FRAME_RATE_DEFAULT;
+  frame_count_ = 0;
+  frame_count_max_ = 0;
+}
+
+void SyntheticSource::setImageSize(const cv::Size image_size)
+{
+  image_size_ = image_size;
+}
+
+void SyntheticSource::setFrameRate(const double frame_rate)
+{
+  frame_rate_ = frame_rate;
+}
+
+void SyntheticSource::setFrameCountMax(const unsigned long frame_count_max)
+{
+  frame_count_max_ = frame_count_max;
+}
+
+void SyntheticSource::connect()
+{
+  std::cout << std::endl << "Generating synthetic " << image_size_.width << "x" << image_size_.height
+            << " images at frame rate " << frame_rate_ << std::endl;
+}
+
+void SyntheticSource::start()
+{
+  frame_count_ = 0;
+  resetPacing();
+}
+
+void SyntheticSource::allocateMemory()
+{
+  background_ = cv::Mat(image_size_,image_type_);
+  cv::randn(background_,cv::Scalar(BACKGROUND_VALUE),cv::Scalar(BACKGROUND_NOISE));
+  image_ = cv::Mat(image_size_,image_type_);
+}
+
+unsigned char * SyntheticSource::getImageDataPointer()
+{
+  return image_.data;
+}
+
+cv::Size SyntheticSource::getImageSize()
+{
+  return image_size_;
+}
+
+int SyntheticSource::getImageType()
+{
+  return image_type_;
+}
+
+unsigned int SyntheticSource::getImageDataSize()
+{
+  return image_size_.area();
+}
+
+double SyntheticSource::getFrameRate()
+{
+  return frame_rate_;
+}
+
+bool SyntheticSource::grabImage(cv::Mat & image)
+{
+  if (endOfStream())
+  {
+    return false;
+  }
+
+  double t = frame_count_/frame_rate_;
+  cv::Point2f position = computeBlobPosition(t);
+  cv::Point2f position_next = computeBlobPosition(t + 1.0/frame_rate_);
+  double angle = atan2(position_next.y - position.y,position_next.x - position.x)*180.0/CV_PI;
+
+  // draw with fractional bits so the blob moves with sub-pixel resolution
+  const int scale = 1 << SUBPIXEL_SHIFT;
+  background_.copyTo(image);
+  cv::ellipse(image,
+              cv::Point(cvRound(position.x*scale),cvRound(position.y*scale)),
+              cv::Size((BLOB_LENGTH*scale)/2,(BLOB_WIDTH*scale)/2),
+              angle,
+              0,
+              360,
+              cv::Scalar(BLOB_VALUE),
+              cv::FILLED,
+              cv::LINE_AA,
+              SUBPIXEL_SHIFT);
+  blob_position_ = position;
+  ++frame_count_;
+
+  waitForNextFrame(frame_rate_);
+  return true;
+}
+
+bool SyntheticSource::endOfStream()
+{
+  return ((frame_count_max_ > 0) && (frame_count_ >= frame_count_max_));
+}
+
+void SyntheticSource::stop()
+{
+}
+
+void SyntheticSource::disconnect()
+{
+}
+
+cv::Point2f SyntheticSource::getBlobPosition()
+{
+  return blob_position_;
+}
+
+void SyntheticSource::getBackground(cv::Mat & background)
+{
+  background_.copyTo(background);
+}
+
+// private
+cv::Point2f SyntheticSource::computeBlobPosition(const double t)
+{
+  double amplitude_x = image_size_.width*(0.5 - PATH_MARGIN);
+  double amplitude_y = image_size_.height*(0.5 - PATH_MARGIN);
+  double x = image_size_.width/2.0 + amplitude_x*sin(2*CV_PI*t/PATH_PERIOD_X);
+  double y = image_size_.height/2.0 + amplitude_y*sin(2*CV_PI*t/PATH_PERIOD_Y);
+  return cv::Point2f(x,y);
+}
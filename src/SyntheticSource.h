@@ -0,0 +1,73 @@
+// ----------------------------------------------------------------------------
+// SyntheticSource.h
+//
+//
+// Authors:
+// Peter Polidoro polidorop@janelia.hhmi.org
+// ----------------------------------------------------------------------------
+#ifndef _SYNTHETIC_SOURCE_H_
+#define _SYNTHETIC_SOURCE_H_
+#include <iostream>
+#include <math.h>
+
+#include <opencv2/imgproc.hpp>
+
+#include "FrameSource.h"
+
+
+// Generates a dark elliptical blob swimming a Lissajous path over a bright,
+// fixed-pattern-noise background, so the tracking loop can run without a
+// camera or recorded footage.
+class SyntheticSource : public FrameSource
+{
+public:
+  SyntheticSource();
+
+  void setImageSize(const cv::Size image_size);
+  void setFrameRate(const double frame_rate);
+  void setFrameCountMax(const unsigned long frame_count_max);
+
+  void connect();
+  void start();
+  void allocateMemory();
+  unsigned char * getImageDataPointer();
+  cv::Size getImageSize();
+  int getImageType();
+  unsigned int getImageDataSize();
+  double getFrameRate();
+  bool grabImage(cv::Mat & image);
+  bool endOfStream();
+  void stop();
+  void disconnect();
+
+  cv::Point2f getBlobPosition();
+  void getBackground(cv::Mat & background);
+
+private:
+  static const double FRAME_RATE_DEFAULT = 177;
+  static const int IMAGE_WIDTH_DEFAULT = 1280;
+  static const int IMAGE_HEIGHT_DEFAULT = 1024;
+  static const int BACKGROUND_VALUE = 200;
+  static const int BACKGROUND_NOISE = 4;
+  static const int BLOB_VALUE = 120;
+  static const int BLOB_LENGTH = 24;
+  static const int BLOB_WIDTH = 8;
+  static const int SUBPIXEL_SHIFT = 4;
+  static const double PATH_PERIOD_X = 7.0;
+  static const double PATH_PERIOD_Y = 11.0;
+  static const double PATH_MARGIN = 0.1;
+
+  cv::Size image_size_;
+  int image_type_;
+  double frame_rate_;
+  unsigned long frame_count_;
+  unsigned long frame_count_max_;
+
+  cv::Mat background_;
+  cv::Mat image_;
+  cv::Point2f blob_position_;
+
+  cv::Point2f computeBlobPosition(const double t);
+};
+
+#endif
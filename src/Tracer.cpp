@@ -0,0 +1,251 @@
+// ----------------------------------------------------------------------------
+// Tracer.cpp
+//
+//
+// Authors:
+// Peter Polidoro polidorop@janelia.hhmi.org
+// ----------------------------------------------------------------------------
+#include "Tracer.h"
+
+
+boost::atomic<bool> Tracer::enabled_(false);
+std::string Tracer::path_;
+int64 Tracer::tick_count_start_ = 0;
+boost::scoped_array<Tracer::Buffer> Tracer::buffers_;
+size_t Tracer::buffer_count_max_ = 0;
+boost::atomic<size_t> Tracer::buffer_count_(0);
+boost::atomic<unsigned long> Tracer::dropped_count_(0);
+boost::mutex Tracer::buffer_mutex_;
+std::vector<Tracer::Buffer *> Tracer::free_buffers_;
+// after the free list, so it is still there when this releases the buffer
+// of the thread destroying it
+boost::thread_specific_ptr<Tracer::Buffer> Tracer::buffer_ptr_(&Tracer::releaseBuffer);
+boost::mutex Tracer::dump_mutex_;
+
+// public
+void Tracer::enable(const std::string & path)
+{
+  path_ = path;
+  buffer_count_max_ = NAMED_THREAD_COUNT + std::max(boost::thread::hardware_concurrency(),1u);
+  buffers_.reset(new Buffer[buffer_count_max_]);
+  for (size_t i=0; i<buffer_count_max_; ++i)
+  {
+    buffers_[i].thread_name = NULL;
+    buffers_[i].count = 0;
+  }
+  free_buffers_.clear();
+  free_buffers_.reserve(buffer_count_max_);
+  buffer_count_ = 0;
+  dropped_count_ = 0;
+  tick_count_start_ = cv::getTickCount();
+  enabled_.store(true,boost::memory_order_release);
+}
+
+bool Tracer::enabled()
+{
+  return enabled_.load(boost::memory_order_relaxed);
+}
+
+void Tracer::setThreadName(const char * name)
+{
+  if (!enabled())
+  {
+    return;
+  }
+  Buffer * buffer_ptr = getBuffer();
+  if (buffer_ptr)
+  {
+    buffer_ptr->thread_name = name;
+  }
+}
+
+void Tracer::recordSpan(const char * name,
+                        const int64 begin_tick_count,
+                        const int64 end_tick_count)
+{
+  record(name,0,false,begin_tick_count,end_tick_count);
+}
+
+void Tracer::recordAsyncSpan(const char * name,
+                             const unsigned long id,
+                             const int64 begin_tick_count,
+                             const int64 end_tick_count)
+{
+  record(name,id,true,begin_tick_count,end_tick_count);
+}
+
+void Tracer::dump()
+{
+  if (!enabled())
+  {
+    return;
+  }
+  boost::lock_guard<boost::mutex> lock(dump_mutex_);
+
+  std::ofstream stream(path_.c_str());
+  if (!stream)
+  {
+    std::cerr << "Unable to open trace file: " << path_ << std::endl;
+    return;
+  }
+  stream << std::fixed << std::setprecision(3);
+  stream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  bool first = true;
+  size_t event_count = 0;
+  size_t buffer_count = buffer_count_.load(boost::memory_order_acquire);
+  for (size_t thread_id=0; thread_id<buffer_count; ++thread_id)
+  {
+    const Buffer & buffer = buffers_[thread_id];
+    if (buffer.thread_name)
+    {
+      stream << (first ? "\n" : ",\n");
+      stream << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread_id;
+      stream << ",\"args\":{\"name\":\"" << buffer.thread_name << "\"}}";
+      first = false;
+    }
+    unsigned long count = buffer.count.load(boost::memory_order_acquire);
+    unsigned long start = 0;
+    if (count > BUFFER_EVENT_COUNT)
+    {
+      start = count - BUFFER_EVENT_COUNT;
+    }
+    for (unsigned long i=start; i<count; ++i)
+    {
+      // copy the span, then check it was not rewritten meanwhile
+      const Event & event = buffer.events[i & (BUFFER_EVENT_COUNT - 1)];
+      if (event.stamp.load(boost::memory_order_acquire) != (i + 1))
+      {
+        continue;
+      }
+      Span span = event.span;
+      boost::atomic_thread_fence(boost::memory_order_acquire);
+      if (event.stamp.load(boost::memory_order_relaxed) != (i + 1))
+      {
+        continue;
+      }
+      writeEvent(stream,span,thread_id,first);
+      ++event_count;
+    }
+  }
+  stream << "\n]}\n";
+  stream.close();
+
+  std::cout << std::endl << "Trace written: " << path_ << " events: " << event_count << std::endl;
+  if (getDroppedCount() > 0)
+  {
+    std::cout << "trace events dropped: " << getDroppedCount() << std::endl;
+  }
+}
+
+unsigned long Tracer::getDroppedCount()
+{
+  return dropped_count_.load(boost::memory_order_relaxed);
+}
+
+// private
+Tracer::Buffer * Tracer::getBuffer()
+{
+  Buffer * buffer_ptr = buffer_ptr_.get();
+  if (buffer_ptr)
+  {
+    return buffer_ptr;
+  }
+  boost::lock_guard<boost::mutex> lock(buffer_mutex_);
+  if (!free_buffers_.empty())
+  {
+    // the ring keeps the events of the thread that exited
+    buffer_ptr = free_buffers_.back();
+    free_buffers_.pop_back();
+  }
+  else
+  {
+    size_t buffer_count = buffer_count_.load(boost::memory_order_relaxed);
+    if (buffer_count == buffer_count_max_)
+    {
+      return NULL;
+    }
+    buffer_ptr = &buffers_[buffer_count];
+    buffer_ptr->events.reset(new Event[BUFFER_EVENT_COUNT]);
+    for (unsigned long i=0; i<BUFFER_EVENT_COUNT; ++i)
+    {
+      buffer_ptr->events[i].stamp.store(0,boost::memory_order_relaxed);
+    }
+    buffer_count_.store(buffer_count + 1,boost::memory_order_release);
+  }
+  buffer_ptr->thread_name = NULL;
+  buffer_ptr_.reset(buffer_ptr);
+  return buffer_ptr;
+}
+
+void Tracer::record(const char * name,
+                    const unsigned long id,
+                    const bool async,
+                    const int64 begin_tick_count,
+                    const int64 end_tick_count)
+{
+  Buffer * buffer_ptr = getBuffer();
+  if (!buffer_ptr)
+  {
+    // more traced threads than rings
+    dropped_count_.fetch_add(1,boost::memory_order_relaxed);
+    return;
+  }
+  unsigned long count = buffer_ptr->count.load(boost::memory_order_relaxed);
+  Event & event = buffer_ptr->events[count & (BUFFER_EVENT_COUNT - 1)];
+  event.stamp.store(0,boost::memory_order_relaxed);
+  boost::atomic_thread_fence(boost::memory_order_release);
+  event.span.name = name;
+  event.span.begin_tick_count = begin_tick_count;
+  event.span.end_tick_count = end_tick_count;
+  event.span.id = id;
+  event.span.async = async;
+  event.stamp.store(count + 1,boost::memory_order_release);
+  buffer_ptr->count.store(count + 1,boost::memory_order_release);
+}
+
+void Tracer::writeEvent(std::ostream & stream,
+                        const Span & span,
+                        const size_t thread_id,
+                        bool & first)
+{
+  double begin = getMicroseconds(span.begin_tick_count);
+  double end = getMicroseconds(span.end_tick_count);
+  stream << (first ? "\n" : ",\n");
+  first = false;
+  if (!span.async)
+  {
+    stream << "{\"name\":\"" << span.name << "\",\"cat\":\"tracker\",\"ph\":\"X\",\"pid\":1,\"tid\":" << thread_id;
+    stream << ",\"ts\":" << begin << ",\"dur\":" << (end - begin) << "}";
+    return;
+  }
+  stream << "{\"name\":\"" << span.name << "\",\"cat\":\"stage\",\"ph\":\"b\",\"id\":" << span.id;
+  stream << ",\"pid\":1,\"tid\":" << thread_id << ",\"ts\":" << begin << "},\n";
+  stream << "{\"name\":\"" << span.name << "\",\"cat\":\"stage\",\"ph\":\"e\",\"id\":" << span.id;
+  stream << ",\"pid\":1,\"tid\":" << thread_id << ",\"ts\":" << end << "}";
+}
+
+double Tracer::getMicroseconds(const int64 tick_count)
+{
+  return (1000000.0*(tick_count - tick_count_start_))/cv::getTickFrequency();
+}
+
+void Tracer::releaseBuffer(Buffer * buffer_ptr)
+{
+  boost::lock_guard<boost::mutex> lock(buffer_mutex_);
+  free_buffers_.push_back(buffer_ptr);
+}
+
+// TraceSpan
+TraceSpan::TraceSpan(const char * name)
+{
+  name_ = name;
+  begin_tick_count_ = Tracer::enabled() ? cv::getTickCount() : 0;
+}
+
+TraceSpan::~TraceSpan()
+{
+  if (begin_tick_count_ != 0)
+  {
+    Tracer::recordSpan(name_,begin_tick_count_,cv::getTickCount());
+  }
+}
@@ -0,0 +1,125 @@
+// ----------------------------------------------------------------------------
+// Tracer.h
+//
+//
+// Authors:
+// Peter Polidoro polidorop@janelia.hhmi.org
+// ----------------------------------------------------------------------------
+#ifndef _TRACER_H_
+#define _TRACER_H_
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <opencv2/core.hpp>
+
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+#include <boost/scoped_array.hpp>
+
+
+// Records begin and end spans from every thread into preallocated per
+// thread rings and writes them as Chrome trace JSON, which chrome://tracing
+// and Perfetto open. Each ring keeps its newest events and is handed to the
+// next new thread once its thread exits. While tracing is disabled a span
+// costs one relaxed load.
+class Tracer
+{
+public:
+  // before any traced thread starts, rings are allocated as threads first
+  // record
+  static void enable(const std::string & path);
+  static bool enabled();
+
+  // names the calling thread in the trace
+  static void setThreadName(const char * name);
+  // names are stored as pointers, so they must be string literals
+  static void recordSpan(const char * name,
+                         const int64 begin_tick_count,
+                         const int64 end_tick_count);
+  // for spans that overlap others on the same thread, like pipelined
+  // stage requests, id tells overlapping spans apart
+  static void recordAsyncSpan(const char * name,
+                              const unsigned long id,
+                              const int64 begin_tick_count,
+                              const int64 end_tick_count);
+
+  // any thread, others may keep recording while the trace is written
+  static void dump();
+  static unsigned long getDroppedCount();
+
+private:
+  // tracking, capture, stage io, background, display, recorder, saver,
+  // compressed writer and track log, each encoder needs one more
+  static const size_t NAMED_THREAD_COUNT = 9;
+  // power of two
+  static const unsigned long BUFFER_EVENT_COUNT = 65536;
+
+  struct Span
+  {
+    const char * name;
+    int64 begin_tick_count;
+    int64 end_tick_count;
+    unsigned long id;
+    bool async;
+  };
+  struct Event
+  {
+    // index + 1 once the span is written, 0 while it is being written, so
+    // dump leaves out events overwritten while the trace is written
+    boost::atomic<unsigned long> stamp;
+    Span span;
+  };
+  struct Buffer
+  {
+    const char * thread_name;
+    boost::scoped_array<Event> events;
+    // events ever recorded, published after each event is written
+    boost::atomic<unsigned long> count;
+  };
+
+  static boost::atomic<bool> enabled_;
+  static std::string path_;
+  static int64 tick_count_start_;
+  static boost::scoped_array<Buffer> buffers_;
+  static size_t buffer_count_max_;
+  // buffers ever handed out, each allocated before it is published
+  static boost::atomic<size_t> buffer_count_;
+  static boost::atomic<unsigned long> dropped_count_;
+  static boost::thread_specific_ptr<Buffer> buffer_ptr_;
+  static boost::mutex buffer_mutex_;
+  static std::vector<Buffer *> free_buffers_;
+  static boost::mutex dump_mutex_;
+
+  static Buffer * getBuffer();
+  static void record(const char * name,
+                     const unsigned long id,
+                     const bool async,
+                     const int64 begin_tick_count,
+                     const int64 end_tick_count);
+  static void writeEvent(std::ostream & stream,
+                         const Span & span,
+                         const size_t thread_id,
+                         bool & first);
+  static double getMicroseconds(const int64 tick_count);
+  // buffers belong to the tracer, an exiting thread only hands its buffer
+  // back for reuse
+  static void releaseBuffer(Buffer * buffer_ptr);
+};
+
+// Records a span from construction to destruction on the calling thread.
+class TraceSpan
+{
+public:
+  explicit TraceSpan(const char * name);
+  ~TraceSpan();
+
+private:
+  const char * name_;
+  int64 begin_tick_count_;
+};
+
+#endif
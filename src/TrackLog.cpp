@@ -0,0 +1,211 @@
+// ----------------------------------------------------------------------------
+// TrackLog.cpp
+//
+//
+// Authors:
+// Peter Polidoro polidorop@janelia.hhmi.org
+// ----------------------------------------------------------------------------
+#include "TrackLog.h"
+
+
+// public
+TrackLog::TrackLog()
+{
+  tick_period_ = 1.0/cv::getTickFrequency();
+  memset(pending_,0,sizeof(pending_));
+  filled_count_ = 0;
+  running_ = false;
+  written_count_ = 0;
+  dropped_count_ = 0;
+}
+
+TrackLog::~TrackLog()
+{
+  stop();
+}
+
+void TrackLog::setPath(const std::string & path)
+{
+  path_ = path;
+}
+
+bool TrackLog::enabled()
+{
+  return !path_.empty();
+}
+
+void TrackLog::start()
+{
+  stop();
+
+  stream_.open(path_.c_str(),std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!stream_)
+  {
+    throw std::runtime_error(std::string("Unable to open track log file ") + path_);
+  }
+  TrackLogLayout::FileHeader file_header;
+  file_header.magic = TrackLogLayout::MAGIC;
+  file_header.version = TrackLogLayout::VERSION;
+  file_header.column_count = TrackLogLayout::getColumnCount();
+  file_header.block_record_count = BLOCK_RECORD_COUNT;
+  stream_.write((const char *)&file_header,sizeof(file_header));
+  for (size_t i=0; i<TrackLogLayout::getColumnCount(); ++i)
+  {
+    TrackLogLayout::ColumnHeader column_header;
+    TrackLogLayout::fillColumnHeader(i,column_header);
+    stream_.write((const char *)&column_header,sizeof(column_header));
+  }
+
+  blocks_.reset(new Block[BLOCK_COUNT]);
+  for (size_t i=0; i<BLOCK_COUNT; ++i)
+  {
+    blocks_[i].record_count = 0;
+    blocks_[i].full = false;
+  }
+  columns_.resize(BLOCK_RECORD_COUNT*sizeof(TrackLogLayout::Record));
+  filled_count_ = 0;
+
+  running_ = true;
+  thread_ = boost::thread(&TrackLog::write,this);
+}
+
+void TrackLog::stop()
+{
+  if (!thread_.joinable())
+  {
+    return;
+  }
+  unsigned long filled_count = filled_count_.load(boost::memory_order_relaxed);
+  Block & block = blocks_[filled_count & (BLOCK_COUNT - 1)];
+  if (!block.full.load(boost::memory_order_acquire) && (block.record_count > 0))
+  {
+    block.full.store(true,boost::memory_order_release);
+    filled_count_.store(filled_count + 1,boost::memory_order_release);
+  }
+  running_ = false;
+  wakeup_.notify();
+  thread_.join();
+  stream_.close();
+}
+
+void TrackLog::setFrame(const unsigned long record_id,
+                        const Frame & frame,
+                        const TrackState & track_state,
+                        const cv::Point2d & stage_target_position,
+                        const bool stage_commanded)
+{
+  TrackLogLayout::Record & record = pending_[record_id & (LatencyMonitor::RING_SIZE - 1)];
+  record.frame_id = frame.frame_id;
+  record.source_frame_count = frame.source_frame_count;
+  record.image_x = track_state.position.x;
+  record.image_y = track_state.position.y;
+  record.orientation = track_state.orientation;
+  record.elongation = track_state.elongation;
+  record.stage_target_x = stage_target_position.x;
+  record.stage_target_y = stage_target_position.y;
+  record.found = track_state.found;
+  record.stage_commanded = stage_commanded;
+}
+
+void TrackLog::append(const unsigned long record_id,
+                      const int64 * tick_counts)
+{
+  unsigned long filled_count = filled_count_.load(boost::memory_order_relaxed);
+  Block & block = blocks_[filled_count & (BLOCK_COUNT - 1)];
+  if (block.full.load(boost::memory_order_acquire))
+  {
+    // the writer is a whole ring of blocks behind
+    dropped_count_.fetch_add(1,boost::memory_order_relaxed);
+    return;
+  }
+  TrackLogLayout::Record & record = block.records[block.record_count];
+  record = pending_[record_id & (LatencyMonitor::RING_SIZE - 1)];
+  // the latency monitor already moved the exposure onto the host clock
+  record.exposure_time = getTime(tick_counts[LatencyMonitor::EXPOSURE]);
+  record.retrieve_time = getTime(tick_counts[LatencyMonitor::RETRIEVE]);
+  record.background_time = getTime(tick_counts[LatencyMonitor::BACKGROUND]);
+  record.blob_time = getTime(tick_counts[LatencyMonitor::BLOB]);
+  record.convert_time = getTime(tick_counts[LatencyMonitor::CONVERT]);
+  record.write_time = getTime(tick_counts[LatencyMonitor::SERIAL_WRITE]);
+  record.ack_time = getTime(tick_counts[LatencyMonitor::SERIAL_ACK]);
+  if (++block.record_count == BLOCK_RECORD_COUNT)
+  {
+    block.full.store(true,boost::memory_order_release);
+    filled_count_.store(filled_count + 1,boost::memory_order_release);
+    wakeup_.notify();
+  }
+}
+
+void TrackLog::drop(const unsigned long)
+{
+  dropped_count_.fetch_add(1,boost::memory_order_relaxed);
+}
+
+unsigned long TrackLog::getWrittenCount()
+{
+  return written_count_.load(boost::memory_order_relaxed);
+}
+
+unsigned long TrackLog::getDroppedCount()
+{
+  return dropped_count_.load(boost::memory_order_relaxed);
+}
+
+// private
+void TrackLog::write()
+{
+  Tracer::setThreadName("track log");
+  unsigned long written_count = 0;
+  while (true)
+  {
+    unsigned long generation = wakeup_.getGeneration();
+    Block & block = blocks_[written_count & (BLOCK_COUNT - 1)];
+    if (block.full.load(boost::memory_order_acquire))
+    {
+      writeBlock(block);
+      block.record_count = 0;
+      block.full.store(false,boost::memory_order_release);
+      ++written_count;
+      continue;
+    }
+    if (!running_ && (written_count == filled_count_.load(boost::memory_order_acquire)))
+    {
+      break;
+    }
+    wakeup_.wait(generation);
+  }
+  stream_.flush();
+}
+
+void TrackLog::writeBlock(const Block & block)
+{
+  TraceSpan trace_span("TrackLog::writeBlock");
+  unsigned char * column_ptr = &columns_[0];
+  for (size_t i=0; i<TrackLogLayout::getColumnCount(); ++i)
+  {
+    const TrackLogLayout::Column & column = TrackLogLayout::getColumn(i);
+    size_t size = TrackLogLayout::getColumnSize(column.type);
+    for (size_t j=0; j<block.record_count; ++j)
+    {
+      memcpy(column_ptr,(const unsigned char *)&block.records[j] + column.offset,size);
+      column_ptr += size;
+    }
+  }
+  TrackLogLayout::BlockHeader block_header;
+  block_header.record_count = block.record_count;
+  block_header.reserved = 0;
+  stream_.write((const char *)&block_header,sizeof(block_header));
+  stream_.write((const char *)&columns_[0],column_ptr - &columns_[0]);
+  // a crash loses at most the blocks still in memory
+  stream_.flush();
+  written_count_.fetch_add(block.record_count,boost::memory_order_relaxed);
+}
+
+double TrackLog::getTime(const int64 tick_count)
+{
+  if (tick_count == 0)
+  {
+    return 0;
+  }
+  return tick_count*tick_period_;
+}
@@ -0,0 +1,105 @@
+// ----------------------------------------------------------------------------
+// TrackLog.h
+//
+//
+// Authors:
+// Peter Polidoro polidorop@janelia.hhmi.org
+// ----------------------------------------------------------------------------
+#ifndef _TRACK_LOG_H_
+#define _TRACK_LOG_H_
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <cstring>
+
+#include <opencv2/core.hpp>
+
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+#include <boost/scoped_array.hpp>
+
+#include "Frame.h"
+#include "TrackState.h"
+#include "LatencyMonitor.h"
+#include "TrackLogLayout.h"
+#include "Tracer.h"
+#include "Wakeup.h"
+
+
+// Logs one fixed size record per processed frame, with its timing at every
+// boundary through the stage acknowledge, cheap enough to leave on. The
+// tracking loop fills the frame fields when it converts the track and
+// completes the record once the latency monitor drains it, then appends it
+// to a preallocated block. A writer thread transposes full blocks into
+// columns and appends them to the file, so tracking never touches the disk.
+class TrackLog
+{
+public:
+  TrackLog();
+  ~TrackLog();
+
+  // power of two
+  static const size_t BLOCK_RECORD_COUNT = 256;
+
+  void setPath(const std::string & path);
+  bool enabled();
+  void start();
+  // hands over the last partial block and waits for it to be written
+  void stop();
+
+  // tracking thread, before the latency record can be drained
+  void setFrame(const unsigned long record_id,
+                const Frame & frame,
+                const TrackState & track_state,
+                const cv::Point2d & stage_target_position,
+                const bool stage_commanded);
+  // tracking thread, as a LatencyMonitor::DrainCallback
+  void append(const unsigned long record_id,
+              const int64 * tick_counts);
+  // tracking thread, as a LatencyMonitor::DropCallback, the frame is left
+  // out of the log
+  void drop(const unsigned long record_id);
+
+  unsigned long getWrittenCount();
+  // frames left out because the writer fell behind or the latency monitor
+  // gave up on them
+  unsigned long getDroppedCount();
+
+private:
+  static const size_t BLOCK_COUNT = 8;
+
+  struct Block
+  {
+    TrackLogLayout::Record records[BLOCK_RECORD_COUNT];
+    size_t record_count;
+    boost::atomic<bool> full;
+  };
+
+  std::string path_;
+  double tick_period_;
+
+  // tracking thread only, indexed like the latency monitor ring
+  TrackLogLayout::Record pending_[LatencyMonitor::RING_SIZE];
+
+  boost::scoped_array<Block> blocks_;
+  // blocks handed over, written by the tracking thread only
+  boost::atomic<unsigned long> filled_count_;
+  boost::atomic<bool> running_;
+  boost::atomic<unsigned long> written_count_;
+  boost::atomic<unsigned long> dropped_count_;
+
+  // writer thread only
+  std::ofstream stream_;
+  std::vector<unsigned char> columns_;
+
+  boost::thread thread_;
+  Wakeup wakeup_;
+
+  void write();
+  void writeBlock(const Block & block);
+  double getTime(const int64 tick_count);
+};
+
+#endif
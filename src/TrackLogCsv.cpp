@@ -0,0 +1,146 @@
+// ----------------------------------------------------------------------------
+// TrackLogCsv.cpp
+//
+//
+// Authors:
+// Peter Polidoro polidorop@janelia.hhmi.org
+// ----------------------------------------------------------------------------
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <cstdlib>
+
+#include <opencv2/core.hpp>
+
+#include <boost/cstdint.hpp>
+
+#include "TrackLogLayout.h"
+#include "TrackLogReader.h"
+
+
+// Exports a track log written with --track-log as CSV, one row per frame.
+static const int TIME_PRECISION = 15;
+
+static void writeHeader(std::ostream & stream,
+                        const std::vector<int> & column_indices)
+{
+  for (size_t i=0; i<column_indices.size(); ++i)
+  {
+    if (i > 0)
+    {
+      stream << ",";
+    }
+    stream << TrackLogLayout::getColumn(column_indices[i]).name;
+  }
+  stream << "\n";
+}
+
+static void writeRow(std::ostream & stream,
+                     const std::vector<int> & column_indices,
+                     const TrackLogLayout::Record & record)
+{
+  for (size_t i=0; i<column_indices.size(); ++i)
+  {
+    const TrackLogLayout::Column & column = TrackLogLayout::getColumn(column_indices[i]);
+    const unsigned char * value_ptr = (const unsigned char *)&record + column.offset;
+    if (i > 0)
+    {
+      stream << ",";
+    }
+    switch (column.type)
+    {
+      case TrackLogLayout::UINT8:
+        stream << (unsigned int)*(const boost::uint8_t *)value_ptr;
+        break;
+      case TrackLogLayout::UINT64:
+        stream << *(const boost::uint64_t *)value_ptr;
+        break;
+      case TrackLogLayout::DOUBLE:
+        stream << *(const double *)value_ptr;
+        break;
+    }
+  }
+  stream << "\n";
+}
+
+int main(int argc, char * argv[])
+{
+  const cv::String keys =
+    "{help h usage ?  |                                   | Print usage and exit.                              }"
+    "{@input          |                                   | Track log the tracker wrote with --track-log.      }"
+    "{@output         |                                   | CSV file, standard output when empty.              }"
+    "{columns         |                                   | Comma separated columns to export, all when empty. }"
+    ;
+  cv::CommandLineParser parser(argc,argv,keys);
+  std::string input_path = parser.get<cv::String>("@input");
+  if (parser.has("help") || input_path.empty())
+  {
+    parser.printMessage();
+    return EXIT_SUCCESS;
+  }
+  std::string output_path = parser.get<cv::String>("@output");
+
+  std::vector<std::string> column_names;
+  std::stringstream columns_ss(parser.get<cv::String>("columns"));
+  std::string column_name;
+  while (std::getline(columns_ss,column_name,','))
+  {
+    column_names.push_back(column_name);
+  }
+  std::vector<int> column_indices;
+  for (size_t i=0; i<TrackLogLayout::getColumnCount(); ++i)
+  {
+    column_indices.push_back(i);
+  }
+
+  TrackLogReader track_log_reader;
+  try
+  {
+    track_log_reader.open(input_path);
+    if (!column_names.empty())
+    {
+      // only the selected columns are read from the file
+      track_log_reader.selectColumns(column_names);
+      column_indices.clear();
+      for (size_t i=0; i<column_names.size(); ++i)
+      {
+        column_indices.push_back(TrackLogLayout::findColumn(column_names[i].c_str()));
+      }
+    }
+  }
+  catch (const std::exception & e)
+  {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::ofstream output_stream;
+  if (!output_path.empty())
+  {
+    output_stream.open(output_path.c_str(),std::ios::out | std::ios::trunc);
+    if (!output_stream)
+    {
+      std::cerr << "Unable to open CSV file " << output_path << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  std::ostream & stream = output_path.empty() ? std::cout : output_stream;
+  stream << std::setprecision(TIME_PRECISION);
+
+  writeHeader(stream,column_indices);
+  TrackLogLayout::Record record;
+  unsigned long record_count = 0;
+  while (track_log_reader.read(record))
+  {
+    writeRow(stream,column_indices,record);
+    ++record_count;
+  }
+  if (!output_path.empty())
+  {
+    std::cout << "frames exported: " << record_count << std::endl;
+  }
+  return EXIT_SUCCESS;
+}
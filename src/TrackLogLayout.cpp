@@ -0,0 +1,78 @@
+// ----------------------------------------------------------------------------
+// TrackLogLayout.cpp
+//
+//
+// Authors:
+// Peter Polidoro polidorop@janelia.hhmi.org
+// ----------------------------------------------------------------------------
+#include "TrackLogLayout.h"
+
+
+// in file order
+static const TrackLogLayout::Column COLUMNS[] =
+{
+  {"frame_id",TrackLogLayout::UINT64,offsetof(TrackLogLayout::Record,frame_id)},
+  {"source_frame_count",TrackLogLayout::UINT64,offsetof(TrackLogLayout::Record,source_frame_count)},
+  {"exposure_time",TrackLogLayout::DOUBLE,offsetof(TrackLogLayout::Record,exposure_time)},
+  {"retrieve_time",TrackLogLayout::DOUBLE,offsetof(TrackLogLayout::Record,retrieve_time)},
+  {"background_time",TrackLogLayout::DOUBLE,offsetof(TrackLogLayout::Record,background_time)},
+  {"blob_time",TrackLogLayout::DOUBLE,offsetof(TrackLogLayout::Record,blob_time)},
+  {"convert_time",TrackLogLayout::DOUBLE,offsetof(TrackLogLayout::Record,convert_time)},
+  {"write_time",TrackLogLayout::DOUBLE,offsetof(TrackLogLayout::Record,write_time)},
+  {"ack_time",TrackLogLayout::DOUBLE,offsetof(TrackLogLayout::Record,ack_time)},
+  {"image_x",TrackLogLayout::DOUBLE,offsetof(TrackLogLayout::Record,image_x)},
+  {"image_y",TrackLogLayout::DOUBLE,offsetof(TrackLogLayout::Record,image_y)},
+  {"orientation",TrackLogLayout::DOUBLE,offsetof(TrackLogLayout::Record,orientation)},
+  {"elongation",TrackLogLayout::DOUBLE,offsetof(TrackLogLayout::Record,elongation)},
+  {"stage_target_x",TrackLogLayout::DOUBLE,offsetof(TrackLogLayout::Record,stage_target_x)},
+  {"stage_target_y",TrackLogLayout::DOUBLE,offsetof(TrackLogLayout::Record,stage_target_y)},
+  {"found",TrackLogLayout::UINT8,offsetof(TrackLogLayout::Record,found)},
+  {"stage_commanded",TrackLogLayout::UINT8,offsetof(TrackLogLayout::Record,stage_commanded)},
+};
+
+// public
+size_t TrackLogLayout::getColumnCount()
+{
+  return sizeof(COLUMNS)/sizeof(COLUMNS[0]);
+}
+
+const TrackLogLayout::Column & TrackLogLayout::getColumn(const size_t column_index)
+{
+  return COLUMNS[column_index];
+}
+
+int TrackLogLayout::findColumn(const char * name)
+{
+  for (size_t i=0; i<getColumnCount(); ++i)
+  {
+    if (strncmp(COLUMNS[i].name,name,COLUMN_NAME_SIZE) == 0)
+    {
+      return i;
+    }
+  }
+  return -1;
+}
+
+size_t TrackLogLayout::getColumnSize(const ColumnType type)
+{
+  switch (type)
+  {
+    case UINT8:
+      return sizeof(boost::uint8_t);
+    case UINT64:
+      return sizeof(boost::uint64_t);
+    case DOUBLE:
+      return sizeof(double);
+  }
+  return 0;
+}
+
+void TrackLogLayout::fillColumnHeader(const size_t column_index,
+                                      ColumnHeader & column_header)
+{
+  const Column & column = COLUMNS[column_index];
+  memset(&column_header,0,sizeof(column_header));
+  strncpy(column_header.name,column.name,COLUMN_NAME_SIZE - 1);
+  column_header.type = column.type;
+  column_header.size = getColumnSize(column.type);
+}
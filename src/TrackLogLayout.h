@@ -0,0 +1,97 @@
+// ----------------------------------------------------------------------------
+// TrackLogLayout.h
+//
+//
+// Authors:
+// Peter Polidoro polidorop@janelia.hhmi.org
+// ----------------------------------------------------------------------------
+#ifndef _TRACK_LOG_LAYOUT_H_
+#define _TRACK_LOG_LAYOUT_H_
+#include <cstddef>
+#include <cstring>
+
+#include <boost/cstdint.hpp>
+
+
+// File layout written by TrackLog and read by TrackLogReader: a file header,
+// one column header per column, then blocks. Each block is a block header
+// followed by every column in turn, record_count values each, so a reader
+// can pull one column without touching the rest.
+//
+// Times are seconds on the host tick clock, 0 when the frame never reached
+// that boundary. exposure_time is estimated from the frame source timestamp.
+class TrackLogLayout
+{
+public:
+  static const boost::uint32_t MAGIC = 0x5a46544c;
+  static const boost::uint32_t VERSION = 1;
+  static const size_t COLUMN_NAME_SIZE = 24;
+
+  struct Record
+  {
+    boost::uint64_t frame_id;
+    boost::uint64_t source_frame_count;
+    double exposure_time;
+    double retrieve_time;
+    double background_time;
+    double blob_time;
+    double convert_time;
+    double write_time;
+    double ack_time;
+    double image_x;
+    double image_y;
+    double orientation;
+    double elongation;
+    double stage_target_x;
+    double stage_target_y;
+    boost::uint8_t found;
+    boost::uint8_t stage_commanded;
+  };
+
+  enum ColumnType
+  {
+    UINT8,
+    UINT64,
+    DOUBLE,
+  };
+
+  struct Column
+  {
+    const char * name;
+    ColumnType type;
+    // of the value in Record
+    size_t offset;
+  };
+
+  struct FileHeader
+  {
+    boost::uint32_t magic;
+    boost::uint32_t version;
+    boost::uint32_t column_count;
+    // records in a full block
+    boost::uint32_t block_record_count;
+  };
+
+  struct ColumnHeader
+  {
+    char name[COLUMN_NAME_SIZE];
+    boost::uint32_t type;
+    boost::uint32_t size;
+  };
+
+  struct BlockHeader
+  {
+    boost::uint32_t record_count;
+    boost::uint32_t reserved;
+  };
+
+  static size_t getColumnCount();
+  static const Column & getColumn(const size_t column_index);
+  // -1 when no column has that name
+  static int findColumn(const char * name);
+  static size_t getColumnSize(const ColumnType type);
+  static void fillColumnHeader(const size_t column_index,
+                               ColumnHeader & column_header);
+};
+
+#endif
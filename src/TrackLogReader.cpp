@@ -0,0 +1,150 @@
+// ----------------------------------------------------------------------------
+// TrackLogReader.cpp
+//
+//
+// Authors:
+// Peter Polidoro polidorop@janelia.hhmi.org
+// ----------------------------------------------------------------------------
+#include "TrackLogReader.h"
+
+
+// public
+TrackLogReader::TrackLogReader()
+{
+  memset(&file_header_,0,sizeof(file_header_));
+  record_index_ = 0;
+}
+
+void TrackLogReader::open(const std::string & path)
+{
+  close();
+
+  stream_.open(path.c_str(),std::ios::in | std::ios::binary);
+  if (!stream_)
+  {
+    throw std::runtime_error(std::string("Unable to open track log file ") + path);
+  }
+  stream_.read((char *)&file_header_,sizeof(file_header_));
+  if (!stream_ ||
+      (file_header_.magic != TrackLogLayout::MAGIC) ||
+      (file_header_.version != TrackLogLayout::VERSION))
+  {
+    close();
+    throw std::runtime_error(std::string("Not a track log file ") + path);
+  }
+  size_t column_size_max = 0;
+  for (size_t i=0; i<file_header_.column_count; ++i)
+  {
+    TrackLogLayout::ColumnHeader column_header;
+    stream_.read((char *)&column_header,sizeof(column_header));
+    if (!stream_)
+    {
+      close();
+      throw std::runtime_error(std::string("Truncated track log file ") + path);
+    }
+    column_header.name[TrackLogLayout::COLUMN_NAME_SIZE - 1] = '\0';
+    int column_index = TrackLogLayout::findColumn(column_header.name);
+    if ((column_index >= 0) &&
+        (TrackLogLayout::getColumnSize(TrackLogLayout::getColumn(column_index).type) != column_header.size))
+    {
+      column_index = -1;
+    }
+    column_indices_.push_back(column_index);
+    column_sizes_.push_back(column_header.size);
+    columns_selected_.push_back(column_index >= 0);
+    column_size_max = std::max(column_size_max,(size_t)column_header.size);
+  }
+  columns_.resize(file_header_.block_record_count*column_size_max);
+  records_.reserve(file_header_.block_record_count);
+}
+
+void TrackLogReader::close()
+{
+  if (stream_.is_open())
+  {
+    stream_.close();
+  }
+  stream_.clear();
+  column_indices_.clear();
+  column_sizes_.clear();
+  columns_selected_.clear();
+  records_.clear();
+  record_index_ = 0;
+}
+
+void TrackLogReader::selectColumns(const std::vector<std::string> & column_names)
+{
+  std::vector<bool> layout_columns_selected(TrackLogLayout::getColumnCount(),false);
+  for (size_t i=0; i<column_names.size(); ++i)
+  {
+    int column_index = TrackLogLayout::findColumn(column_names[i].c_str());
+    if (column_index < 0)
+    {
+      throw std::runtime_error(std::string("Unknown track log column ") + column_names[i]);
+    }
+    layout_columns_selected[column_index] = true;
+  }
+  for (size_t i=0; i<column_indices_.size(); ++i)
+  {
+    columns_selected_[i] = (column_indices_[i] >= 0) && layout_columns_selected[column_indices_[i]];
+  }
+}
+
+bool TrackLogReader::read(TrackLogLayout::Record & record)
+{
+  while (record_index_ == records_.size())
+  {
+    if (!readBlock())
+    {
+      return false;
+    }
+  }
+  record = records_[record_index_++];
+  return true;
+}
+
+// private
+bool TrackLogReader::readBlock()
+{
+  records_.clear();
+  record_index_ = 0;
+  if (!stream_.is_open())
+  {
+    return false;
+  }
+  TrackLogLayout::BlockHeader block_header;
+  stream_.read((char *)&block_header,sizeof(block_header));
+  if (!stream_ || (block_header.record_count > file_header_.block_record_count))
+  {
+    return false;
+  }
+  size_t record_count = block_header.record_count;
+  if (record_count == 0)
+  {
+    return true;
+  }
+  TrackLogLayout::Record record;
+  memset(&record,0,sizeof(record));
+  records_.assign(record_count,record);
+  for (size_t i=0; i<column_indices_.size(); ++i)
+  {
+    size_t size = column_sizes_[i];
+    if (!columns_selected_[i])
+    {
+      stream_.seekg(record_count*size,std::ios::cur);
+      continue;
+    }
+    stream_.read((char *)&columns_[0],record_count*size);
+    if (!stream_)
+    {
+      records_.clear();
+      return false;
+    }
+    size_t offset = TrackLogLayout::getColumn(column_indices_[i]).offset;
+    for (size_t j=0; j<record_count; ++j)
+    {
+      memcpy((unsigned char *)&records_[j] + offset,&columns_[j*size],size);
+    }
+  }
+  return true;
+}
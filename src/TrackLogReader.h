@@ -0,0 +1,55 @@
+// ----------------------------------------------------------------------------
+// TrackLogReader.h
+//
+//
+// Authors:
+// Peter Polidoro polidorop@janelia.hhmi.org
+// ----------------------------------------------------------------------------
+#ifndef _TRACK_LOG_READER_H_
+#define _TRACK_LOG_READER_H_
+#include <fstream>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+
+#include "TrackLogLayout.h"
+
+
+// Reads a track log written by TrackLog back into records, one block at a
+// time. Columns are matched by name, so columns this build does not know are
+// skipped and columns the file lacks read as 0. Built as a library, so tools
+// that need only a few columns can select them and seek over the rest.
+class TrackLogReader
+{
+public:
+  TrackLogReader();
+
+  // selects every column
+  void open(const std::string & path);
+  void close();
+  // after open, only these layout columns are read, the rest read as 0,
+  // throws on a name the layout does not know
+  void selectColumns(const std::vector<std::string> & column_names);
+  // false at the end of the log, a last block truncated within the
+  // selected columns is ignored
+  bool read(TrackLogLayout::Record & record);
+
+private:
+  std::ifstream stream_;
+  TrackLogLayout::FileHeader file_header_;
+  // per file column, the layout column it fills or -1
+  std::vector<int> column_indices_;
+  std::vector<size_t> column_sizes_;
+  // per file column, read rather than seeked over
+  std::vector<bool> columns_selected_;
+
+  std::vector<unsigned char> columns_;
+  std::vector<TrackLogLayout::Record> records_;
+  size_t record_index_;
+
+  bool readBlock();
+};
+
+#endif
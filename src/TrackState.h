@@ -0,0 +1,27 @@
+// ----------------------------------------------------------------------------
+// TrackState.h
+//
+//
+// Authors:
+// Peter Polidoro polidorop@janelia.hhmi.org
+// ----------------------------------------------------------------------------
+#ifndef _TRACK_STATE_H_
+#define _TRACK_STATE_H_
+#include <opencv2/core.hpp>
+
+
+// Floating point tracker output, kept in sub-pixel image coordinates until
+// it is converted to a stage target.
+struct TrackState
+{
+  // intensity weighted centroid
+  cv::Point2d position;
+  // major axis angle from the image x axis in radians, -pi/2 to pi/2
+  double orientation;
+  // major over minor axis length, 1 for a round blob
+  double elongation;
+  // false when the blob was lost and position is the last known one
+  bool found;
+};
+
+#endif
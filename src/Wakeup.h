@@ -0,0 +1,70 @@
+// ----------------------------------------------------------------------------
+// Wakeup.h
+//
+//
+// Authors:
+// Peter Polidoro polidorop@janelia.hhmi.org
+// ----------------------------------------------------------------------------
+#ifndef _WAKEUP_H_
+#define _WAKEUP_H_
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+#include <boost/noncopyable.hpp>
+
+
+// Wakes worker threads waiting for work handed to them through lock-free
+// structures. A worker reads the generation, checks for work and waits only
+// while the generation is unchanged, so a notify that lands between the
+// check and the wait is never lost. Notifying only takes the lock when a
+// worker is actually asleep, so the tracking thread can notify every frame.
+class Wakeup : private boost::noncopyable
+{
+public:
+  Wakeup()
+  {
+    generation_ = 0;
+    waiting_count_ = 0;
+  }
+
+  // any thread, after handing over work or changing what the worker waits on
+  void notify()
+  {
+    generation_.fetch_add(1,boost::memory_order_seq_cst);
+    if (waiting_count_.load(boost::memory_order_seq_cst) == 0)
+    {
+      return;
+    }
+    {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+    }
+    condition_.notify_all();
+  }
+
+  // worker, before checking for work
+  unsigned long getGeneration()
+  {
+    return generation_.load(boost::memory_order_seq_cst);
+  }
+
+  // worker, returns once notify has been called since getGeneration
+  void wait(const unsigned long generation)
+  {
+    waiting_count_.fetch_add(1,boost::memory_order_seq_cst);
+    {
+      boost::unique_lock<boost::mutex> lock(mutex_);
+      while (generation_.load(boost::memory_order_seq_cst) == generation)
+      {
+        condition_.wait(lock);
+      }
+    }
+    waiting_count_.fetch_sub(1,boost::memory_order_seq_cst);
+  }
+
+private:
+  boost::atomic<unsigned long> generation_;
+  boost::atomic<int> waiting_count_;
+  boost::mutex mutex_;
+  boost::condition_variable condition_;
+};
+
+#endif
@@ -15,16 +15,42 @@ void ZebrafishTracker::interruptSignalHandler(int sig)
   run_enabled_ = 0;
 }
 
+volatile sig_atomic_t ZebrafishTracker::trace_dump_requested_ = 0;
+
+void ZebrafishTracker::traceSignalHandler(int sig)
+{
+  trace_dump_requested_ = 1;
+}
+
+volatile sig_atomic_t ZebrafishTracker::record_trigger_requested_ = 0;
+
+void ZebrafishTracker::recordSignalHandler(int sig)
+{
+  record_trigger_requested_ = 1;
+}
+
 // public
 ZebrafishTracker::ZebrafishTracker()
 {
   signal(SIGINT,ZebrafishTracker::interruptSignalHandler);
+  signal(SIGUSR1,ZebrafishTracker::traceSignalHandler);
+  signal(SIGUSR2,ZebrafishTracker::recordSignalHandler);
 
   stage_homed_ = false;
   stage_homing_ = false;
   paralyzed_ = false;
   blind_ = false;
   recalibrate_ = false;
+  benchmarking_ = false;
+  emulating_stage_ = false;
+  predicting_ = false;
+  lead_extra_ = 0;
+  stage_latency_ticks_ = 0;
+
+  frame_source_ptr_ = &camera_;
+  capture_enabled_ = false;
+  capture_finished_ = false;
+  record_duration_ = 0;
 }
 
 void ZebrafishTracker::processCommandLineArgs(int argc, char * argv[])
@@ -36,8 +62,35 @@ void ZebrafishTracker::processCommandLineArgs(int argc, char * argv[])
     "{m mouse         |                                   | Track mouse click location instead of blob.        }"
     "{p paralyze      |                                   | Do not communicate with stage so it does not move. }"
     "{b blind         |                                   | Do not communicate with camera.                    }"
-    "{r recalibrate   |                                   | Recalibrate with chessboard before running.        }"
+    "{r recalibrate   |                                   | Recalibrate with chessboard mounted on stage before running. }"
     "{hide            |                                   | Do not display images.                             }"
+    "{preview         |                                   | Publish a downscaled preview to this shared memory name, like /zebrafish_preview. }"
+    "{background      | mog2                              | Background model, mog2 or average.                 }"
+    "{unmasked        |                                   | Update average background under the fish too.      }"
+    "{blob            | largest                           | Blob selection, largest, closest or all foreground pixels. }"
+    "{deadband        | 1000                              | Stage deadband diameter, closer targets do not move the stage. }"
+    "{device          | /dev/ttyACM0                      | Stage controller serial device.                    }"
+    "{emulate-stage   |                                   | Emulate the stage controller on a pseudo-terminal. }"
+    "{emulate-late    | 0                                 | Emulated stage answers every this many moves after the controller timeout. }"
+    "{text-stage      |                                   | Use the text stage protocol even if binary is supported. }"
+    "{predict         |                                   | Lead the stage target by the measured latency with a constant velocity filter. }"
+    "{lead            | 0                                 | Extra prediction lead in milliseconds, for exposure and stage motion. }"
+    "{window          | 0                                 | Max fish speed in pixels per frame, searches a window around the fish instead of the full frame. }"
+    "{replay          |                                   | Replay png image directory or video instead of camera. }"
+    "{synthetic       |                                   | Generate synthetic blob images instead of camera.  }"
+    "{fast            |                                   | Replay frames as fast as possible, not in real time. }"
+    "{loop            |                                   | Loop replay when it reaches the end.               }"
+    "{preload         |                                   | Load all replay frames into memory before running. }"
+    "{copy-frames     |                                   | Retrieve camera frames into a driver image and copy them, instead of straight into the frame. }"
+    "{benchmark       |                                   | Benchmark image processing and exit.               }"
+    "{buffers         | 1                                 | Camera buffer count, more than 1 buffers frames instead of dropping. }"
+    "{record          |                                   | Record raw frames into a ring file at this path, SIGUSR2 saves the ring. }"
+    "{record-seconds  | 10                                | Seconds of frames the recording ring holds.        }"
+    "{compress        |                                   | Record PNG compressed frames to this file on a worker pool. }"
+    "{compress-workers| 2                                 | Compressed recording encoder thread count.         }"
+    "{compress-block  |                                   | Wait for the encoders instead of dropping frames when they fall behind. }"
+    "{track-log       |                                   | Log per frame track and timing records to this binary columnar file. }"
+    "{trace           |                                   | Write pipeline spans as Chrome trace JSON to this path on exit or SIGUSR1. }"
     ;
 
   cv::CommandLineParser parser(argc,argv,keys);
@@ -57,6 +110,13 @@ void ZebrafishTracker::processCommandLineArgs(int argc, char * argv[])
   cv::String configuration_path = parser.get<cv::String>("configuration");
   configuration_.setConfigurationRepositoryPath(configuration_path);
 
+  // before any traced thread starts
+  if (parser.has("trace"))
+  {
+    Tracer::enable(parser.get<cv::String>("trace"));
+    std::cout << std::endl << "Tracing!" << std::endl;
+  }
+
   if (parser.has("debug"))
   {
     stage_controller_.setDebug(true);
@@ -66,6 +126,11 @@ void ZebrafishTracker::processCommandLineArgs(int argc, char * argv[])
   {
     image_processor_.hide();
   }
+  if (parser.has("preview"))
+  {
+    image_processor_.setPreviewName(parser.get<cv::String>("preview"));
+    std::cout << std::endl << "Preview!" << std::endl;
+  }
 
   if (parser.has("mouse"))
   {
@@ -77,6 +142,65 @@ void ZebrafishTracker::processCommandLineArgs(int argc, char * argv[])
     image_processor_.setMode(ImageProcessor::BLOB);
   }
 
+  cv::String background = parser.get<cv::String>("background");
+  if (background == "average")
+  {
+    image_processor_.setBackgroundMode(ImageProcessor::RUNNING_AVERAGE);
+    image_processor_.setBackgroundMasked(!parser.has("unmasked"));
+    std::cout << std::endl << "Running average background!" << std::endl;
+  }
+  else if (background != "mog2")
+  {
+    throw std::runtime_error("Unknown background model.");
+  }
+
+  cv::String blob = parser.get<cv::String>("blob");
+  if (blob == "closest")
+  {
+    image_processor_.setBlobSelection(ImageProcessor::CLOSEST);
+    std::cout << std::endl << "Closest blob!" << std::endl;
+  }
+  else if (blob == "all")
+  {
+    image_processor_.setBlobSelection(ImageProcessor::ALL_PIXELS);
+    std::cout << std::endl << "All foreground pixels!" << std::endl;
+  }
+  else if (blob != "largest")
+  {
+    throw std::runtime_error("Unknown blob selection.");
+  }
+
+  int window = parser.get<int>("window");
+  if (window > 0)
+  {
+    image_processor_.setTrackingWindow(window);
+    std::cout << std::endl << "Tracking window!" << std::endl;
+  }
+
+  long deadband = parser.get<int>("deadband");
+  stage_controller_.setDeadband(deadband);
+
+  if (parser.has("predict"))
+  {
+    predicting_ = true;
+    lead_extra_ = parser.get<double>("lead")/1000;
+    std::cout << std::endl << "Predicting!" << std::endl;
+  }
+
+  stage_controller_.setDeviceName(parser.get<cv::String>("device"));
+  if (parser.has("emulate-stage"))
+  {
+    emulating_stage_ = true;
+    stage_emulator_.setLateResponsePeriod(parser.get<int>("emulate-late"));
+    std::cout << std::endl << "Emulating stage!" << std::endl;
+  }
+
+  if (parser.has("text-stage"))
+  {
+    stage_controller_.setBinaryProtocol(false);
+    std::cout << std::endl << "Text stage protocol!" << std::endl;
+  }
+
   if (parser.has("paralyze"))
   {
     paralyzed_ = true;
@@ -94,6 +218,80 @@ void ZebrafishTracker::processCommandLineArgs(int argc, char * argv[])
     recalibrate_ = true;
     std::cout << std::endl << "Recalibrate!" << std::endl;
   }
+
+  if (parser.has("benchmark"))
+  {
+    benchmarking_ = true;
+    std::cout << std::endl << "Benchmark!" << std::endl;
+  }
+
+  if (parser.has("replay"))
+  {
+    replay_source_.setPath(parser.get<cv::String>("replay"));
+    replay_source_.setLoop(parser.has("loop"));
+    replay_source_.setPreload(parser.has("preload"));
+    frame_source_ptr_ = &replay_source_;
+    std::cout << std::endl << "Replay!" << std::endl;
+  }
+  else if (parser.has("synthetic"))
+  {
+    frame_source_ptr_ = &synthetic_source_;
+    std::cout << std::endl << "Synthetic!" << std::endl;
+  }
+
+  int buffer_count = parser.get<int>("buffers");
+  if (buffer_count > 1)
+  {
+    camera_.setBufferCount(buffer_count);
+    std::cout << std::endl << "Buffer frames! buffer count: " << buffer_count << std::endl;
+  }
+
+  if (parser.has("record"))
+  {
+    frame_recorder_.setPath(parser.get<cv::String>("record"));
+    record_duration_ = parser.get<double>("record-seconds");
+    std::cout << std::endl << "Record!" << std::endl;
+  }
+
+  if (parser.has("compress"))
+  {
+    compressed_recorder_.setPath(parser.get<cv::String>("compress"));
+    compressed_recorder_.setWorkerCount(parser.get<int>("compress-workers"));
+    if (parser.has("compress-block"))
+    {
+      compressed_recorder_.setPolicy(CompressedRecorder::BLOCK);
+    }
+    std::cout << std::endl << "Compressed recording!" << std::endl;
+  }
+
+  if (parser.has("track-log"))
+  {
+    track_log_.setPath(parser.get<cv::String>("track-log"));
+    std::cout << std::endl << "Track log!" << std::endl;
+  }
+
+  if (parser.has("copy-frames"))
+  {
+    camera_.setDirectRetrieve(false);
+    std::cout << std::endl << "Copy frames!" << std::endl;
+  }
+
+  if (parser.has("fast"))
+  {
+    frame_source_ptr_->setPacing(FrameSource::AS_FAST_AS_POSSIBLE);
+    std::cout << std::endl << "Fast!" << std::endl;
+  }
+}
+
+bool ZebrafishTracker::benchmarking()
+{
+  return benchmarking_;
+}
+
+void ZebrafishTracker::benchmark()
+{
+  Benchmark benchmark;
+  benchmark.run();
 }
 
 void ZebrafishTracker::connectHardware()
@@ -106,6 +304,7 @@ void ZebrafishTracker::disconnectHardware()
 {
   disconnectCamera();
   disconnectStageController();
+  Tracer::dump();
 }
 
 void ZebrafishTracker::enableGpu()
@@ -133,23 +332,51 @@ void ZebrafishTracker::allocateMemory()
     return;
   }
 
-  camera_.allocateMemory();
-  unsigned char * image_data_ptr = camera_.getImageDataPointer();
-  cv::Size image_size = camera_.getImageSize();
-  int image_type = camera_.getImageType();
-  unsigned int image_data_size = camera_.getImageDataSize();
+  frame_source_ptr_->allocateMemory();
+  unsigned char * image_data_ptr = frame_source_ptr_->getImageDataPointer();
+  cv::Size image_size = frame_source_ptr_->getImageSize();
+  int image_type = frame_source_ptr_->getImageType();
+  unsigned int image_data_size = frame_source_ptr_->getImageDataSize();
   image_processor_.allocateMemory(image_data_ptr,image_size,image_type,image_data_size);
+  // the ring, the tracking loop, the capture thread and the recorder each
+  // hold frames
+  size_t frame_count = FRAME_RING_SLOT_COUNT + FRAME_POOL_SPARE_COUNT;
+  if (frame_recorder_.enabled())
+  {
+    size_t record_frame_count = ceil(record_duration_*frame_source_ptr_->getFrameRate());
+    frame_recorder_.allocateMemory(image_size,image_type,record_frame_count);
+    frame_count += FrameRecorder::HELD_FRAME_COUNT;
+  }
+  if (compressed_recorder_.enabled())
+  {
+    compressed_recorder_.start(image_size,image_type);
+    frame_count += CompressedRecorder::JOB_COUNT;
+  }
+  frame_pool_.allocateMemory(image_size,image_type,frame_count);
+  frame_ring_.allocateMemory(FRAME_RING_SLOT_COUNT);
+  if (track_log_.enabled())
+  {
+    track_log_.start();
+    latency_monitor_.setDrainCallback(boost::bind(&TrackLog::append,&track_log_,_1,_2));
+    latency_monitor_.setDropCallback(boost::bind(&TrackLog::drop,&track_log_,_1));
+  }
 }
 
 void ZebrafishTracker::findCalibration()
 {
-  if (recalibrate_)
+  if (recalibrate_ && usingCamera() && !paralyzed_)
   {
     camera_.setRecalibrationShutterSpeed();
     camera_.reconfigure();
-    calibration_.recalibrate();
+    calibration_.recalibrate(camera_,stage_controller_);
     camera_.setNormalShutterSpeed();
     camera_.reconfigure();
+    // recalibration leaves the stage homed
+    stage_homed_ = true;
+  }
+  else if (recalibrate_)
+  {
+    std::cout << std::endl << "Recalibration needs the camera and the stage, keeping the last calibration." << std::endl;
   }
 
   coordinate_converter_.updateHomographyImageToStage();
@@ -159,33 +386,126 @@ void ZebrafishTracker::run()
 {
   std::cout << std::endl << "Running! Press ctrl-c to stop." << std::endl << std::endl;
 
-  cv::Mat image;
-  cv::Point tracked_image_point;
-  cv::Point stage_target_position;
+  Tracer::setThreadName("tracking");
+  frame_recorder_.start();
+  startCapture();
+
+  TrackState track_state;
+  cv::Point2d target_image_point;
+  cv::Point2d stage_target_position;
+  boost::shared_future<bool> stage_move_future;
   while(run_enabled_ && !blind_)
   {
-    camera_.grabImage(image);
-    image_processor_.update(image);
-    image_processor_.getTrackedImagePoint(tracked_image_point);
-    coordinate_converter_.convertImagePointToStagePoint(tracked_image_point,stage_target_position);
+    if (trace_dump_requested_)
+    {
+      trace_dump_requested_ = 0;
+      Tracer::dump();
+    }
+    if (record_trigger_requested_)
+    {
+      record_trigger_requested_ = 0;
+      frame_recorder_.trigger();
+    }
+    // spin on the ring rather than block so a new frame is picked up as soon
+    // as the capture thread publishes it
+    bool capture_finished = capture_finished_;
+    FramePtr frame_ptr = frame_ring_.acquireNewest();
+    if (!frame_ptr)
+    {
+      if (capture_finished)
+      {
+        std::cout << std::endl << "End of frame source." << std::endl;
+        break;
+      }
+      boost::this_thread::yield();
+      continue;
+    }
+    unsigned long latency_record_id = latency_monitor_.begin(frame_ptr->source_timestamp,frame_ptr->tick_count);
+    image_processor_.update(frame_ptr->image);
+    image_processor_.getTrackState(track_state);
+    int64 background_tick_count;
+    int64 blob_tick_count;
+    image_processor_.getStageTickCounts(background_tick_count,blob_tick_count);
+    latency_monitor_.stamp(latency_record_id,LatencyMonitor::BACKGROUND,background_tick_count);
+    latency_monitor_.stamp(latency_record_id,LatencyMonitor::BLOB,blob_tick_count);
+    target_image_point = track_state.position;
+    if (predicting_)
+    {
+      // aim where the fish will be once the stage gets there and search the
+      // next frame where it is expected to be
+      double frame_time = frame_ptr->tick_count/cv::getTickFrequency();
+      motion_predictor_.update(track_state,frame_time);
+      if (motion_predictor_.initialized())
+      {
+        target_image_point = motion_predictor_.predictPosition(frame_time + getLead(frame_ptr->tick_count));
+        image_processor_.setSearchPrior(motion_predictor_.predictPosition(frame_time + motion_predictor_.getFramePeriod()));
+      }
+    }
+    coordinate_converter_.convertImagePointToStagePoint(target_image_point,stage_target_position);
+    latency_monitor_.stamp(latency_record_id,LatencyMonitor::CONVERT,cv::getTickCount());
+    // the stage I/O thread finishes the record once the move is answered
+    bool moving = !paralyzed_ && stage_homed_;
+    if (track_log_.enabled())
+    {
+      track_log_.setFrame(latency_record_id,*frame_ptr,track_state,stage_target_position,moving);
+    }
+    if (!moving)
+    {
+      latency_monitor_.finish(latency_record_id);
+    }
+    latency_monitor_.update();
     if (!paralyzed_)
     {
       if (stage_homed_)
       {
-        stage_controller_.moveStageTo(stage_target_position.x,stage_target_position.y);
+        stage_move_future = stage_controller_.moveStageTo(cvRound(stage_target_position.x),
+                                                          cvRound(stage_target_position.y),
+                                                          boost::bind(&ZebrafishTracker::stageMoveCompleted,this,cv::getTickCount(),latency_record_id,_1,_2));
       }
       else if (stage_homing_)
       {
-        stage_homed_ = stage_controller_.stageHomed();
-        stage_homing_ = !stage_homed_;
+        // poll without waiting, asking again once the last answer is in
+        if (stage_homed_future_.is_ready())
+        {
+          stage_homed_ = stage_homed_future_.get();
+          stage_homing_ = !stage_homed_;
+          if (stage_homing_)
+          {
+            stage_homed_future_ = stage_controller_.stageHomed();
+          }
+        }
       }
       else
       {
         stage_controller_.homeStage();
+        stage_homed_future_ = stage_controller_.stageHomed();
         stage_homing_ = true;
       }
     }
+    if (frame_recorder_.enabled())
+    {
+      frame_recorder_.record(frame_ptr,track_state);
+    }
+    if (compressed_recorder_.enabled())
+    {
+      compressed_recorder_.record(frame_ptr,track_state);
+    }
   }
+  stopCapture();
+  frame_recorder_.stop();
+  compressed_recorder_.stop();
+  // moves are answered in order, so once the last one is answered every
+  // latency record is finished, stopping the stage I/O fails any move
+  // still unanswered so its record reaches the track log too
+  if (stage_move_future.valid())
+  {
+    stage_move_future.timed_wait(boost::posix_time::milliseconds(STAGE_FLUSH_TIMEOUT));
+  }
+  stage_controller_.disconnect();
+  latency_monitor_.update();
+  track_log_.stop();
+  printRecordCounts();
+  latency_monitor_.report();
 }
 
 // private
@@ -196,6 +516,13 @@ void ZebrafishTracker::connectCamera()
     return;
   }
 
+  if (!usingCamera())
+  {
+    frame_source_ptr_->connect();
+    frame_source_ptr_->start();
+    return;
+  }
+
   camera_.printLibraryInfo();
 
   size_t camera_count = camera_.count();
@@ -223,6 +550,13 @@ void ZebrafishTracker::disconnectCamera()
     return;
   }
 
+  if (!usingCamera())
+  {
+    frame_source_ptr_->stop();
+    frame_source_ptr_->disconnect();
+    return;
+  }
+
   std::cout << std::endl << "Stopping camera capture." << std::endl;
   camera_.stop();
 
@@ -230,6 +564,138 @@ void ZebrafishTracker::disconnectCamera()
   camera_.disconnect();
 }
 
+bool ZebrafishTracker::usingCamera()
+{
+  return (frame_source_ptr_ == &camera_);
+}
+
+void ZebrafishTracker::startCapture()
+{
+  if (blind_)
+  {
+    return;
+  }
+  capture_enabled_ = true;
+  capture_finished_ = false;
+  capture_thread_ = boost::thread(&ZebrafishTracker::capture,this);
+}
+
+void ZebrafishTracker::stopCapture()
+{
+  if (!capture_thread_.joinable())
+  {
+    return;
+  }
+  capture_enabled_ = false;
+  capture_thread_.join();
+  printCaptureCounts();
+}
+
+void ZebrafishTracker::capture()
+{
+  Tracer::setThreadName("capture");
+  unsigned long frame_id = 0;
+  FramePtr frame_ptr;
+  while (run_enabled_ && capture_enabled_)
+  {
+    // keep the same frame until an image is actually grabbed into it
+    if (!frame_ptr)
+    {
+      frame_ptr = frame_pool_.acquire();
+      if (!frame_ptr)
+      {
+        boost::this_thread::yield();
+        continue;
+      }
+    }
+    if (!frame_source_ptr_->grabFrame(*frame_ptr))
+    {
+      if (frame_source_ptr_->endOfStream())
+      {
+        break;
+      }
+      continue;
+    }
+    frame_ptr->frame_id = frame_id++;
+    frame_ring_.publish(frame_ptr);
+    frame_ptr.reset();
+  }
+  capture_finished_ = true;
+}
+
+void ZebrafishTracker::printCaptureCounts()
+{
+  std::cout << std::endl << "frames skipped by source: " << frame_source_ptr_->getSkippedFrameCount() << std::endl;
+  std::cout << "frames produced: " << frame_ring_.getProducedCount() << std::endl;
+  std::cout << "frames consumed: " << frame_ring_.getConsumedCount() << std::endl;
+  std::cout << "frames overwritten: " << frame_ring_.getOverwrittenCount() << std::endl;
+  std::cout << "frame pool exhausted: " << frame_pool_.getExhaustedCount() << std::endl;
+}
+
+void ZebrafishTracker::printRecordCounts()
+{
+  if (frame_recorder_.enabled())
+  {
+    std::cout << std::endl << "frames recorded: " << frame_recorder_.getRecordedCount() << std::endl;
+    std::cout << "frames dropped by recorder: " << frame_recorder_.getDroppedCount() << std::endl;
+    std::cout << "recordings saved: " << frame_recorder_.getSavedCount() << std::endl;
+  }
+  if (compressed_recorder_.enabled())
+  {
+    std::cout << std::endl << "frames compressed: " << compressed_recorder_.getWrittenCount() << std::endl;
+    std::cout << "frames dropped by compressed recorder: " << compressed_recorder_.getDroppedCount() << std::endl;
+    std::cout << "frames blocked on compressed recorder: " << compressed_recorder_.getBlockedCount() << std::endl;
+    if (compressed_recorder_.getEncodedByteCount() > 0)
+    {
+      std::cout << "compression ratio: " << ((double)compressed_recorder_.getRawByteCount()/compressed_recorder_.getEncodedByteCount()) << std::endl;
+    }
+  }
+  if (track_log_.enabled())
+  {
+    std::cout << std::endl << "frames logged: " << track_log_.getWrittenCount() << std::endl;
+    std::cout << "frames dropped by track log: " << track_log_.getDroppedCount() << std::endl;
+  }
+}
+
+double ZebrafishTracker::getLead(const int64 frame_tick_count)
+{
+  // frame age so far plus the time a move takes to reach the stage
+  double lead = (cv::getTickCount() - frame_tick_count)/cv::getTickFrequency();
+  if (!paralyzed_)
+  {
+    lead += stage_latency_ticks_.load(boost::memory_order_relaxed)/cv::getTickFrequency();
+  }
+  return lead + lead_extra_;
+}
+
+void ZebrafishTracker::stageMoveCompleted(const int64 tick_count_start,
+                                          const unsigned long latency_record_id,
+                                          const bool moved,
+                                          const int64 write_tick_count)
+{
+  int64 tick_count = cv::getTickCount();
+  // coalesced and deadband moves complete without a round trip
+  if (!moved)
+  {
+    latency_monitor_.finish(latency_record_id);
+    return;
+  }
+  latency_monitor_.stamp(latency_record_id,LatencyMonitor::SERIAL_WRITE,write_tick_count);
+  latency_monitor_.stamp(latency_record_id,LatencyMonitor::SERIAL_ACK,tick_count);
+  latency_monitor_.finish(latency_record_id);
+  int64 latency_ticks = tick_count - tick_count_start;
+  int64 stage_latency_ticks = stage_latency_ticks_.load(boost::memory_order_relaxed);
+  if (stage_latency_ticks == 0)
+  {
+    stage_latency_ticks = latency_ticks;
+  }
+  else
+  {
+    stage_latency_ticks += (latency_ticks - stage_latency_ticks) >> STAGE_LATENCY_SHIFT;
+  }
+  stage_latency_ticks_.store(stage_latency_ticks,boost::memory_order_relaxed);
+}
+
 void ZebrafishTracker::connectStageController()
 {
   if (paralyzed_)
@@ -237,6 +703,12 @@ void ZebrafishTracker::connectStageController()
     return;
   }
 
+  if (emulating_stage_)
+  {
+    stage_emulator_.start();
+    stage_controller_.setDeviceName(stage_emulator_.getDevicePath());
+  }
+
   std::cout << std::endl << "Connecting stage controller." << std::endl;
   stage_controller_.connect();
 }
@@ -250,4 +722,7 @@ void ZebrafishTracker::disconnectStageController()
 
   std::cout << std::endl << "Disconnecting stage controller." << std::endl;
   stage_controller_.disconnect();
+  std::cout << "stage targets coalesced: " << stage_controller_.getCoalescedCount() << std::endl;
+  std::cout << "stage commands failed: " << stage_controller_.getFailedCount() << std::endl;
+  stage_emulator_.stop();
 }
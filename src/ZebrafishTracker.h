@@ -9,6 +9,9 @@
 #define _ZEBRAFISH_TRACKER_H_
 #include <iostream>
 #include <signal.h>
+#include <boost/thread.hpp>
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
 #include <opencv2/core.hpp>
 #include <opencv2/core/cuda.hpp>
 
@@ -18,11 +21,25 @@
 // #endif
 
 #include "Configuration.h"
+#include "FrameSource.h"
 #include "Camera.h"
+#include "ReplaySource.h"
+#include "SyntheticSource.h"
+#include "Frame.h"
+#include "FramePool.h"
+#include "FrameRing.h"
 #include "ImageProcessor.h"
 #include "StageController.h"
+#include "StageEmulator.h"
 #include "Calibration.h"
 #include "CoordinateConverter.h"
+#include "MotionPredictor.h"
+#include "Benchmark.h"
+#include "LatencyMonitor.h"
+#include "Tracer.h"
+#include "FrameRecorder.h"
+#include "CompressedRecorder.h"
+#include "TrackLog.h"
 
 
 class ZebrafishTracker
@@ -31,6 +48,8 @@ public:
   ZebrafishTracker();
 
   void processCommandLineArgs(int argc, char * argv[]);
+  bool benchmarking();
+  void benchmark();
   void connectHardware();
   void disconnectHardware();
   void enableGpu();
@@ -41,22 +60,66 @@ public:
 private:
   Configuration configuration_;
   Camera camera_;
+  ReplaySource replay_source_;
+  SyntheticSource synthetic_source_;
+  FrameSource * frame_source_ptr_;
+  FramePool frame_pool_;
+  FrameRing frame_ring_;
+  boost::thread capture_thread_;
+  boost::atomic<bool> capture_enabled_;
+  boost::atomic<bool> capture_finished_;
+  FrameRecorder frame_recorder_;
+  double record_duration_;
+  CompressedRecorder compressed_recorder_;
   ImageProcessor image_processor_;
+  // declared first so the controller disconnects before the emulator stops
+  StageEmulator stage_emulator_;
+  bool emulating_stage_;
   StageController stage_controller_;
   bool stage_homed_;
   bool stage_homing_;
+  boost::shared_future<bool> stage_homed_future_;
+  MotionPredictor motion_predictor_;
+  bool predicting_;
+  double lead_extra_;
+  // smoothed stage move round trip, written by the stage I/O thread
+  boost::atomic<int64> stage_latency_ticks_;
+  static const int STAGE_LATENCY_SHIFT = 3;
+  // longest wait at exit for the last stage move to be answered
+  static const long STAGE_FLUSH_TIMEOUT = 1000;
+  LatencyMonitor latency_monitor_;
+  TrackLog track_log_;
   Calibration calibration_;
   CoordinateConverter coordinate_converter_;
   bool paralyzed_;
   bool blind_;
   bool recalibrate_;
   bool gpu_enabled_;
+  bool benchmarking_;
+
+  static const size_t FRAME_RING_SLOT_COUNT = 4;
+  static const size_t FRAME_POOL_SPARE_COUNT = 4;
 
   volatile static sig_atomic_t run_enabled_;
   static void interruptSignalHandler(int sig);
+  volatile static sig_atomic_t trace_dump_requested_;
+  static void traceSignalHandler(int sig);
+  volatile static sig_atomic_t record_trigger_requested_;
+  static void recordSignalHandler(int sig);
 
   void connectCamera();
   void disconnectCamera();
+  bool usingCamera();
+  void startCapture();
+  void stopCapture();
+  void capture();
+  void printCaptureCounts();
+  void printRecordCounts();
+  double getLead(const int64 frame_tick_count);
+  void stageMoveCompleted(const int64 tick_count_start,
+                          const unsigned long latency_record_id,
+                          const bool moved,
+                          const int64 write_tick_count);
   void connectStageController();
   void disconnectStageController();
 };